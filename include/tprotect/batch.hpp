@@ -0,0 +1,475 @@
+// batch.hpp: Incremental Batch Processing Of Directory Trees
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+#include <tprotect/checkpoint.hpp>
+#include <tprotect/content_hash.hpp>
+#include <tprotect/durable_output.hpp>
+#include <tprotect/global.hpp>
+#include <tprotect/mapped_file.hpp>
+#include <tprotect/parallel.hpp>
+
+namespace tprotect
+{
+/**
+ * @brief What a previous run saw of each input, so the next one can skip it
+ *
+ * Stored as text: a header line naming the cipher configuration, then one `hash size mtime path` line per input.
+ * A manifest whose configuration differs from the current run is ignored entirely
+ *
+ */
+class batch_manifest
+{
+  public:
+    struct entry
+    {
+        std::uint64_t size;
+        std::int64_t mtime; // nanoseconds since the filesystem clock epoch
+        std::uint64_t hash;
+    };
+
+    [[nodiscard]] static batch_manifest load(const std::filesystem::path &path,
+                                             const std::string_view configuration) noexcept
+    {
+        batch_manifest manifest{};
+        std::ifstream ifs{path};
+        std::string line;
+        if (!ifs || !std::getline(ifs, line) || line != std::format("{} {}", magic, configuration))
+        {
+            return manifest; // missing, unreadable or for another configuration: start over
+        }
+        while (std::getline(ifs, line))
+        {
+            entry value{};
+            int consumed{};
+            if (std::sscanf(line.c_str(), "%" SCNx64 " %" SCNu64 " %" SCNd64 " %n", &value.hash, &value.size,
+                            &value.mtime, &consumed) == 3 &&
+                consumed > 0)
+            {
+                manifest.entries_.emplace(line.substr(static_cast<std::size_t>(consumed)), value);
+            }
+        }
+        return manifest;
+    }
+
+    // Written to a temporary file and renamed, so an interrupted run leaves the old manifest intact
+    [[nodiscard]] eresult<void> save(const std::filesystem::path &path, const std::string_view configuration,
+                                     const durability_options &durability = {}) const noexcept
+    {
+        const auto temporary{std::filesystem::path{path} += ".tmp"};
+        {
+            std::ofstream ofs{temporary};
+            if (!ofs)
+            {
+                return std::unexpected{"Failed to open manifest"};
+            }
+            ofs << magic << ' ' << configuration << '\n';
+            for (const auto &[name, value] : entries_)
+            {
+                ofs << std::format("{:016x} {} {} {}\n", value.hash, value.size, value.mtime, name);
+            }
+            if (!ofs)
+            {
+                return std::unexpected{"Failed to write manifest"};
+            }
+        }
+        group_commit commits{durability};
+        return commits.commit(temporary, path)
+            .and_then([&] { return commits.flush(); })
+            .transform_error([](const std::string &error) {
+                return std::format("Failed to replace manifest: {}", error);
+            });
+    }
+
+    [[nodiscard]] const entry *find(const std::string &name) const noexcept
+    {
+        const auto it{entries_.find(name)};
+        return it == entries_.end() ? nullptr : &it->second;
+    }
+
+    void set(std::string name, const entry value) noexcept
+    {
+        entries_.insert_or_assign(std::move(name), value);
+    }
+
+  private:
+    static constexpr std::string_view magic{"tprotect-manifest-1"};
+
+    std::map<std::string, entry> entries_;
+};
+
+struct batch_report
+{
+    std::size_t unchanged;   // skipped on metadata alone
+    std::size_t rehashed;    // metadata changed but the content did not
+    std::size_t transformed; // run through the cipher
+    std::size_t linked;      // output shared with an identical input
+    std::size_t resumed;     // completed by an interrupted run, according to its checkpoint
+    std::chrono::duration<double> elapsed;
+    bool durable; // outputs were synced before the run returned
+
+    // Outputs written per second, to weigh durability against throughput
+    [[nodiscard]] double files_per_second() const noexcept
+    {
+        return elapsed.count() > 0. ? static_cast<double>(transformed + linked) / elapsed.count() : 0.;
+    }
+};
+
+/**
+ * @brief Apply `transform` to every regular file under `input_root`, mirroring the tree under `output_root`
+ *
+ * Inputs whose size and modification time match the manifest are skipped without being read. Inputs whose metadata
+ * changed are hashed, and skipped if the content did not. Of the inputs that did change, each distinct content is
+ * transformed once; the other outputs with that content are reflinked, hard-linked or, failing both, copied from it.
+ * Outputs are always replaced by rename, never rewritten in place, so shared outputs are never modified through a
+ * sibling
+ *
+ * With `durability.enabled`, outputs and the manifest are synced in groups (see `group_commit`) before this returns.
+ * With a `checkpoint`, the set of completed outputs is saved periodically, so a crashed run can be resumed without
+ * redoing them; the manifest alone is only written at the end
+ *
+ * @param configuration identifies the cipher and key; changing it invalidates the manifest
+ */
+[[nodiscard]] inline eresult<batch_report> run_batch(
+    const std::filesystem::path &input_root, const std::filesystem::path &output_root,
+    const std::filesystem::path &manifest_path, const std::string &configuration,
+    const std::function<cresult<std::string>(std::string_view)> &transform,
+    const durability_options &durability = {}, checkpointer *const checkpoint = nullptr) noexcept
+{
+    const auto started{std::chrono::steady_clock::now()};
+    enum class status
+    {
+        unchanged,
+        rehashed,
+        changed,
+    };
+    struct input
+    {
+        std::string name; // relative to the roots, in generic form
+        batch_manifest::entry metadata;
+        status state;
+    };
+
+    std::error_code error;
+    std::vector<input> inputs;
+    for (std::filesystem::recursive_directory_iterator it{input_root, error}, end{}; !error && it != end;
+         it.increment(error))
+    {
+        if (it->is_regular_file(error))
+        {
+            inputs.push_back({std::filesystem::relative(it->path(), input_root, error).generic_string(), {}, {}});
+        }
+    }
+    if (error)
+    {
+        return std::unexpected{std::format("Failed to list {}: {}", input_root.string(), error.message())};
+    }
+    std::ranges::sort(inputs, {}, &input::name);
+
+    const auto previous{batch_manifest::load(manifest_path, configuration)};
+    std::mutex error_mutex;
+    std::string first_error{};
+    const auto fail{[&](const std::string &message) {
+        std::lock_guard<std::mutex> guard{error_mutex};
+        if (first_error.empty())
+        {
+            first_error = message;
+        }
+    }};
+
+    // Classify every input, reading only those whose metadata changed
+    parallel_for(inputs.size(), [&](const std::size_t i, std::size_t) {
+        auto &current{inputs[i]};
+        const auto source{input_root / current.name};
+        std::error_code stat_error;
+        current.metadata.size = std::filesystem::file_size(source, stat_error);
+        if (!stat_error)
+        {
+            current.metadata.mtime = std::filesystem::last_write_time(source, stat_error).time_since_epoch().count();
+        }
+        if (stat_error)
+        {
+            fail(std::format("{}: {}", source.string(), stat_error.message()));
+            return;
+        }
+
+        const auto *const known{previous.find(current.name)};
+        const bool has_output{std::filesystem::exists(output_root / current.name, stat_error)};
+        if (known && has_output && known->size == current.metadata.size && known->mtime == current.metadata.mtime)
+        {
+            current.metadata.hash = known->hash;
+            current.state = status::unchanged;
+            return;
+        }
+
+        const auto file{mapped_file::open(source.string())};
+        if (!file)
+        {
+            fail(file.error().message());
+            return;
+        }
+        current.metadata.hash = content_hash(file->view());
+        current.state =
+            known && has_output && known->hash == current.metadata.hash ? status::rehashed : status::changed;
+    });
+    if (!first_error.empty())
+    {
+        return std::unexpected{std::move(first_error)};
+    }
+
+    // Group changed inputs by content; an up-to-date output with the same content can seed a group
+    std::map<std::uint64_t, std::vector<std::size_t>> groups;
+    std::map<std::uint64_t, std::size_t> current_outputs;
+    batch_report report{};
+    for (std::size_t i{}; i < inputs.size(); ++i)
+    {
+        switch (inputs[i].state)
+        {
+        case status::unchanged:
+            report.unchanged++;
+            current_outputs.try_emplace(inputs[i].metadata.hash, i);
+            break;
+        case status::rehashed:
+            report.rehashed++;
+            current_outputs.try_emplace(inputs[i].metadata.hash, i);
+            break;
+        case status::changed:
+            groups[inputs[i].metadata.hash].push_back(i);
+            break;
+        }
+    }
+    std::vector<std::pair<oresult<std::size_t>, std::vector<std::size_t>>> work;
+    for (auto &[hash, members] : groups)
+    {
+        const auto seed{current_outputs.find(hash)};
+        work.emplace_back(seed == current_outputs.end() ? oresult<std::size_t>{} : seed->second, std::move(members));
+    }
+
+    group_commit commits{durability};
+    // Write `target`'s replacement beside it, to be committed later
+    const auto stage_output{[&](const std::filesystem::path &target, auto &&produce) -> eresult<std::filesystem::path> {
+        std::error_code io_error;
+        std::filesystem::create_directories(target.parent_path(), io_error);
+        const auto temporary{std::filesystem::path{target} += ".tprotect-tmp"};
+        std::filesystem::remove(temporary, io_error);
+        if (auto result{produce(temporary)}; !result)
+        {
+            std::filesystem::remove(temporary, io_error);
+            return std::unexpected{std::move(result.error())};
+        }
+        return temporary;
+    }};
+    const auto replace_output{[&](const std::filesystem::path &target, auto &&produce) -> eresult<void> {
+        return stage_output(target, produce).and_then([&](const std::filesystem::path &temporary) {
+            return commits.commit(temporary, target);
+        });
+    }};
+    const auto link_output{[&](const std::filesystem::path &from, const std::filesystem::path &to) {
+        return replace_output(to, [&](const std::filesystem::path &temporary) -> eresult<void> {
+#ifdef __linux__
+            // A reflink shares extents copy-on-write, so the outputs stay independent files
+            if (const int source_fd{::open(from.c_str(), O_RDONLY | O_CLOEXEC)}; source_fd >= 0)
+            {
+                const int target_fd{::open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644)};
+                const bool cloned{target_fd >= 0 && ::ioctl(target_fd, FICLONE, source_fd) == 0};
+                if (target_fd >= 0)
+                {
+                    ::close(target_fd);
+                }
+                ::close(source_fd);
+                if (cloned)
+                {
+                    return {};
+                }
+                std::error_code cleanup_error;
+                std::filesystem::remove(temporary, cleanup_error);
+            }
+#endif
+            std::error_code link_error;
+            std::filesystem::create_hard_link(from, temporary, link_error);
+            if (link_error)
+            {
+                link_error.clear();
+                std::filesystem::copy_file(from, temporary, link_error);
+            }
+            if (link_error)
+            {
+                return std::unexpected{std::format("{}: {}", to.string(), link_error.message())};
+            }
+            return {};
+        });
+    }};
+
+    // With a checkpoint, outputs completed by an interrupted run of the same job are not redone. Its bitmap is only
+    // trusted if the inputs are exactly as they were then. A run that ends, even failing, leaves the manifest instead
+    std::uint64_t listing{content_hash(configuration)};
+    for (const auto &current : inputs)
+    {
+        listing = content_hash(current.name, listing ^ current.metadata.hash ^ current.metadata.size) ^
+                  static_cast<std::uint64_t>(current.metadata.mtime);
+    }
+    std::vector<char> completed(inputs.size()); // not `std::vector<bool>`, which workers cannot write concurrently
+    if (const auto saved{checkpoint ? checkpoint->load() : std::nullopt})
+    {
+        binary_reader reader{*saved};
+        if (const auto bits{reader.get<std::uint64_t>() == listing ? reader.get_bits(inputs.size()) : std::nullopt})
+        {
+            completed = *bits;
+        }
+    }
+    const auto save_checkpoint{[&] {
+        std::vector<char> snapshot(completed.size());
+        for (std::size_t i{}; i < completed.size(); ++i)
+        {
+            snapshot[i] = std::atomic_ref<char>{completed[i]}.load(std::memory_order_relaxed);
+        }
+        // Everything in the snapshot was committed before it was taken, so this makes it all durable
+        if (const auto flushed{commits.flush()}; flushed)
+        {
+            binary_writer writer{};
+            writer.put(listing).put_bits(snapshot);
+            [[maybe_unused]] const auto saved{checkpoint->save(writer.bytes())}; // a failed save only costs redoing
+        }
+    }};
+    std::mutex checkpoint_mutex;
+
+    std::atomic<std::size_t> transformed{}, linked{}, resumed{};
+    parallel_for(work.size(), [&](const std::size_t w, std::size_t) {
+        const auto &[seed, all_members] = work[w];
+        std::vector<std::size_t> members;
+        std::ranges::copy_if(all_members, std::back_inserter(members), [&](const std::size_t i) {
+            return !completed[i];
+        });
+        resumed += all_members.size() - members.size();
+        if (members.empty())
+        {
+            return;
+        }
+
+        // The first output of new content is staged, not committed, until its siblings are linked from it, as a
+        // pending group commit may not have renamed it into place yet
+        std::size_t first_link{};
+        std::filesystem::path origin{seed ? output_root / inputs[*seed].name : std::filesystem::path{}};
+        if (const auto done{std::ranges::find_if(all_members, [&](const std::size_t i) { return completed[i]; })};
+            !seed && done != all_members.end())
+        {
+            origin = output_root / inputs[*done].name; // written by the interrupted run, so already in place
+        }
+        if (origin.empty())
+        {
+            const auto &producer{inputs[members.front()]};
+            const auto result{
+                mapped_file::open((input_root / producer.name).string())
+                    .and_then([&](const mapped_file &file) { return transform(file.view()); })
+                    .transform_error(&compact_error::message) // on this worker, where the context lives
+                    .and_then([&](const std::string &output) {
+                        return stage_output(output_root / producer.name,
+                                            [&](const std::filesystem::path &temporary) -> eresult<void> {
+                                                std::ofstream ofs{temporary, std::ios::binary};
+                                                ofs.write(output.data(), static_cast<std::streamsize>(output.size()));
+                                                if (!ofs)
+                                                {
+                                                    return std::unexpected{"Failed to write output"};
+                                                }
+                                                return {};
+                                            });
+                    })};
+            if (!result)
+            {
+                fail(std::format("{}: {}", producer.name, result.error()));
+                return;
+            }
+            origin = *result;
+            first_link = 1;
+        }
+
+        for (std::size_t m{first_link}; m < members.size(); ++m)
+        {
+            if (const auto result{link_output(origin, output_root / inputs[members[m]].name)}; !result)
+            {
+                fail(result.error());
+                return;
+            }
+            linked++;
+            std::atomic_ref<char>{completed[members[m]]}.store(true, std::memory_order_relaxed);
+        }
+        if (first_link == 1)
+        {
+            if (const auto result{commits.commit(origin, output_root / inputs[members.front()].name)}; !result)
+            {
+                fail(result.error());
+                return;
+            }
+            transformed++;
+            std::atomic_ref<char>{completed[members.front()]}.store(true, std::memory_order_relaxed);
+        }
+
+        if (checkpoint && checkpoint->due())
+        {
+            if (std::unique_lock<std::mutex> lock{checkpoint_mutex, std::try_to_lock}; lock)
+            {
+                save_checkpoint(); // one worker pays for it; the others carry on
+            }
+        }
+    });
+    report.transformed = transformed;
+    report.linked = linked;
+    report.resumed = resumed;
+    report.durable = commits.durable();
+
+    // Only record what actually completed, so a failed run is retried next time. A failed group may hold any output,
+    // so then none count as completed
+    const auto committed{commits.flush()};
+    if (!committed)
+    {
+        fail(committed.error());
+    }
+    batch_manifest next{};
+    for (std::size_t i{}; i < inputs.size(); ++i)
+    {
+        if (inputs[i].state != status::changed || (completed[i] && committed))
+        {
+            next.set(inputs[i].name, inputs[i].metadata);
+        }
+    }
+    if (const auto saved{next.save(manifest_path, configuration, durability)}; !saved)
+    {
+        return std::unexpected{saved.error()};
+    }
+    if (checkpoint)
+    {
+        checkpoint->remove(); // the manifest now records everything that completed
+    }
+    if (!first_error.empty())
+    {
+        return std::unexpected{std::move(first_error)};
+    }
+    report.elapsed = std::chrono::steady_clock::now() - started;
+    return report;
+}
+} // namespace tprotect
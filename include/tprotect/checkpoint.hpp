@@ -0,0 +1,223 @@
+// checkpoint.hpp: Periodic Checkpoints For Resumable Jobs
+
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <tprotect/content_hash.hpp>
+#include <tprotect/durable_output.hpp>
+#include <tprotect/global.hpp>
+
+namespace tprotect
+{
+/**
+ * @brief Appends fixed-width little-endian fields to a checkpoint payload
+ *
+ */
+class binary_writer
+{
+  public:
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    binary_writer &put(const T value) noexcept
+    {
+        static_assert(std::endian::native == std::endian::little, "checkpoints are little-endian");
+        bytes_.append(reinterpret_cast<const char *>(&value), sizeof value);
+        return *this;
+    }
+
+    binary_writer &put_bytes(const std::string_view bytes) noexcept
+    {
+        put(static_cast<std::uint64_t>(bytes.size()));
+        bytes_.append(bytes);
+        return *this;
+    }
+
+    // One bit per flag, so a million-file job costs 125 KB
+    binary_writer &put_bits(const std::vector<char> &flags) noexcept
+    {
+        std::string packed((flags.size() + 7) / 8, '\0');
+        for (std::size_t i{}; i < flags.size(); ++i)
+        {
+            packed[i / 8] = static_cast<char>(packed[i / 8] | (flags[i] ? 1 << (i % 8) : 0));
+        }
+        return put_bytes(packed);
+    }
+
+    [[nodiscard]] const std::string &bytes() const noexcept
+    {
+        return bytes_;
+    }
+
+  private:
+    std::string bytes_;
+};
+
+/**
+ * @brief Reads back what `binary_writer` wrote; every read fails, rather than overruns, once the payload is short
+ *
+ */
+class binary_reader
+{
+  public:
+    explicit binary_reader(const std::string_view bytes) noexcept : bytes_{bytes}
+    {
+    }
+
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    [[nodiscard]] oresult<T> get() noexcept
+    {
+        if (bytes_.size() < sizeof(T))
+        {
+            return std::nullopt;
+        }
+        T value;
+        std::memcpy(&value, bytes_.data(), sizeof value);
+        bytes_.remove_prefix(sizeof value);
+        return value;
+    }
+
+    [[nodiscard]] oresult<std::string_view> get_bytes() noexcept
+    {
+        const auto size{get<std::uint64_t>()};
+        if (!size || bytes_.size() < *size)
+        {
+            return std::nullopt;
+        }
+        const auto result{bytes_.substr(0, *size)};
+        bytes_.remove_prefix(*size);
+        return result;
+    }
+
+    [[nodiscard]] oresult<std::vector<char>> get_bits(const std::size_t count) noexcept
+    {
+        const auto packed{get_bytes()};
+        if (!packed || packed->size() != (count + 7) / 8)
+        {
+            return std::nullopt;
+        }
+        std::vector<char> flags(count);
+        for (std::size_t i{}; i < count; ++i)
+        {
+            flags[i] = static_cast<char>(((*packed)[i / 8] >> (i % 8)) & 1);
+        }
+        return flags;
+    }
+
+  private:
+    std::string_view bytes_;
+};
+
+/**
+ * @brief Saves a job's progress every `interval`, and hands it back when the same job is started again
+ *
+ * The file holds a magic, the job kind, a fingerprint of the job's inputs and settings, and an opaque payload with
+ * its checksum. It is replaced atomically and durably, so a crash mid-save leaves the previous checkpoint. A
+ * checkpoint for another kind or fingerprint, or a damaged one, is ignored, so a changed job starts over.
+ *
+ * The cost is bounded by the interval: `due()` is a clock read, and jobs only gather and write their state when it
+ * returns true. An empty path disables checkpointing
+ *
+ */
+class checkpointer
+{
+  public:
+    checkpointer() noexcept = default;
+
+    checkpointer(std::filesystem::path path, const std::string_view kind, const std::uint64_t fingerprint,
+                 const std::chrono::milliseconds interval = std::chrono::seconds{30}) noexcept
+        : path_{std::move(path)}, kind_{content_hash(kind)}, fingerprint_{fingerprint}, interval_{interval}
+    {
+    }
+
+    [[nodiscard]] bool enabled() const noexcept
+    {
+        return !path_.empty();
+    }
+
+    // The payload of a matching checkpoint, if there is one
+    [[nodiscard]] oresult<std::string> load() const noexcept
+    {
+        if (!enabled())
+        {
+            return std::nullopt;
+        }
+        std::ifstream ifs{path_, std::ios::binary};
+        const std::string file{std::istreambuf_iterator{ifs}, {}};
+        binary_reader reader{file};
+        const auto magic_read{reader.get<std::uint64_t>()};
+        const auto kind{reader.get<std::uint64_t>()};
+        const auto fingerprint{reader.get<std::uint64_t>()};
+        const auto checksum{reader.get<std::uint64_t>()};
+        const auto payload{reader.get_bytes()};
+        if (!magic_read || *magic_read != magic || kind != kind_ || fingerprint != fingerprint_ || !payload ||
+            checksum != content_hash(*payload))
+        {
+            return std::nullopt;
+        }
+        return std::string{*payload};
+    }
+
+    [[nodiscard]] bool due() const noexcept
+    {
+        return enabled() && clock::now().time_since_epoch().count() - last_save_.load(std::memory_order_relaxed) >=
+                                std::chrono::duration_cast<clock::duration>(interval_).count();
+    }
+
+    [[nodiscard]] eresult<void> save(const std::string_view payload) noexcept
+    {
+        std::lock_guard<std::mutex> guard{mutex_};
+        last_save_.store(clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        binary_writer writer{};
+        writer.put(magic).put(kind_).put(fingerprint_).put(content_hash(payload)).put_bytes(payload);
+
+        const auto temporary{std::filesystem::path{path_} += ".tmp"};
+        {
+            std::ofstream ofs{temporary, std::ios::binary | std::ios::trunc};
+            ofs.write(writer.bytes().data(), static_cast<std::streamsize>(writer.bytes().size()));
+            if (!ofs.flush())
+            {
+                return std::unexpected{std::format("Failed to write checkpoint {}", temporary.string())};
+            }
+        }
+        group_commit commits{{.enabled = true, .window = {}}};
+        return commits.commit(temporary, path_).and_then([&] { return commits.flush(); });
+    }
+
+    // Once the job has finished, so the next run starts afresh
+    void remove() noexcept
+    {
+        if (enabled())
+        {
+            std::error_code error;
+            std::filesystem::remove(path_, error);
+        }
+    }
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::uint64_t magic{0x0031'5450'4b43'5054ull}; // "TPCKPT1" in file order
+
+    std::filesystem::path path_;
+    std::uint64_t kind_{};
+    std::uint64_t fingerprint_{};
+    std::chrono::milliseconds interval_{};
+    std::atomic<clock::rep> last_save_{clock::now().time_since_epoch().count()}; // read by `due()` on any thread
+    std::mutex mutex_;                                                          // serializes saves
+};
+} // namespace tprotect
@@ -0,0 +1,190 @@
+// affine_cipher.hpp: The Affine Cipher And Its Key Recovery
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <tprotect/cipher/byte_map.hpp>
+#include <tprotect/cipher/frequency_analyzer.hpp>
+#include <tprotect/cipher/letters.hpp>
+#include <tprotect/global.hpp>
+#include <tprotect/parallel.hpp>
+
+namespace tprotect::cipher
+{
+struct affine_key
+{
+    int a; // multiplier, coprime to 26
+    int b; // offset
+    double fit; // chi-squared distance per letter of the decryption from English, when recovered
+};
+
+/**
+ * @brief E(x) = a * x + b mod 26 on letter indices, preserving case; a = 1 is the shift cipher
+ *
+ * Both directions are precomputed into a `byte_map`, so the bulk work is a table lookup per byte. A multiplier that
+ * shares a factor with 26 has no inverse, and makes encryption fail
+ *
+ */
+class affine_cipher
+{
+  public:
+    static constexpr std::array<int, 12> multipliers{1, 3, 5, 7, 9, 11, 15, 17, 19, 21, 23, 25};
+
+    affine_cipher(const int a, const int b) noexcept
+    {
+        set_key(a, b);
+    }
+
+    void set_key(const int a, const int b) noexcept
+    {
+        a_ = (a % 26 + 26) % 26;
+        b_ = (b % 26 + 26) % 26;
+        const auto inverse{inverse_of(a_)};
+        valid_ = inverse.has_value();
+        if (!valid_)
+        {
+            return;
+        }
+        std::array<char, 52> encryption{}, decryption{};
+        for (int x{}; x < 26; ++x)
+        {
+            const int image{(a_ * x + b_) % 26};
+            encryption[x] = static_cast<char>('A' + image);
+            encryption[26 + x] = static_cast<char>('a' + image);
+            const int preimage{(*inverse * (x - b_ + 26)) % 26};
+            decryption[x] = static_cast<char>('A' + preimage);
+            decryption[26 + x] = static_cast<char>('a' + preimage);
+        }
+        encryption_ = byte_map::letters(encryption);
+        decryption_ = byte_map::letters(decryption);
+    }
+
+    [[nodiscard]] cresult<std::string> encrypt(const std::string_view input) const noexcept
+    {
+        if (!valid_)
+        {
+            return std::unexpected{compact_error{errc::invalid_key, std::format("a = {}", a_)}};
+        }
+        return encryption_.apply(input);
+    }
+
+    [[nodiscard]] cresult<std::string> decrypt(const std::string_view input) const noexcept
+    {
+        if (!valid_)
+        {
+            return std::unexpected{compact_error{errc::invalid_key, std::format("a = {}", a_)}};
+        }
+        return decryption_.apply(input);
+    }
+
+    // Either direction as a byte table, to fuse with other per-byte stages; the identity for an invalid key
+    [[nodiscard]] const byte_map &encryption_table() const noexcept
+    {
+        return encryption_;
+    }
+
+    [[nodiscard]] const byte_map &decryption_table() const noexcept
+    {
+        return decryption_;
+    }
+
+    [[nodiscard]] bool valid() const noexcept
+    {
+        return valid_;
+    }
+
+    [[nodiscard]] static constexpr oresult<int> inverse_of(const int a) noexcept
+    {
+        for (int candidate{1}; candidate < 26; ++candidate)
+        {
+            if (a * candidate % 26 == 1)
+            {
+                return candidate;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Case-folded letter counts, in parallel over chunks of a large text
+    [[nodiscard]] static std::array<std::uint64_t, 26> histogram(const std::string_view text,
+                                                                 const std::size_t chunk_size = 1 << 20) noexcept
+    {
+        // Every byte indexes a counter, each cased letter its own and the rest a spare, so the loop has no branches
+        std::vector<std::array<std::uint64_t, 53>> partial(worker_count());
+        parallel_for((text.size() + chunk_size - 1) / chunk_size, [&](const std::size_t i, const std::size_t slot) {
+            const auto chunk{text.substr(i * chunk_size, chunk_size)};
+            auto &counts{partial[slot]};
+            for (const char ch : chunk)
+            {
+                counts[letter_symbol(ch)]++;
+            }
+        });
+        std::array<std::uint64_t, 26> result{};
+        for (const auto &counts : partial)
+        {
+            for (std::size_t letter{}; letter < result.size(); ++letter)
+            {
+                result[letter] += counts[letter] + counts[26 + letter];
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief The key of the 312 valid ones whose decryption best fits English letter frequencies
+     *
+     * Decrypting under (a, b) turns plaintext letter p back from ciphertext letter a * p + b, so each key's
+     * chi-squared statistic is read off the one histogram with 26 lookups; no key ever touches the text
+     *
+     */
+    [[nodiscard]] static affine_key recover(const std::array<std::uint64_t, 26> &counts) noexcept
+    {
+        double total{};
+        for (const auto count : counts)
+        {
+            total += static_cast<double>(count);
+        }
+
+        affine_key best{1, 0, std::numeric_limits<double>::max()};
+        if (total <= 0.)
+        {
+            return best;
+        }
+        for (const int a : multipliers)
+        {
+            for (int b{}; b < 26; ++b)
+            {
+                const auto cipher_letter{[a, b](const std::size_t plain) {
+                    return (static_cast<std::size_t>(a) * plain + static_cast<std::size_t>(b)) % 26;
+                }};
+                const double distance{frequency_analyzer::english_distance(counts, total, cipher_letter)};
+                if (distance / total < best.fit)
+                {
+                    best = {a, b, distance / total};
+                }
+            }
+        }
+        return best;
+    }
+
+    [[nodiscard]] static affine_key recover(const std::string_view ciphertext) noexcept
+    {
+        return recover(histogram(ciphertext));
+    }
+
+  private:
+    int a_{1};
+    int b_{};
+    bool valid_{};
+    byte_map encryption_{};
+    byte_map decryption_{};
+};
+} // namespace tprotect::cipher
@@ -0,0 +1,97 @@
+// byte_map.hpp: Table-Driven Byte Translation
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <tprotect/parallel.hpp>
+
+namespace tprotect::cipher
+{
+/**
+ * @brief A 256-entry byte translation table, the bulk path of every cipher that maps letters one to one
+ *
+ * Applying it is one load and one store per byte, with no branches on the byte's class, so the loop is unrolled and
+ * runs at memory speed; large inputs are split into chunks translated in parallel, each written by the thread that
+ * translates it
+ *
+ */
+class byte_map
+{
+  public:
+    // The identity
+    constexpr byte_map() noexcept
+    {
+        for (std::size_t i{}; i < table_.size(); ++i)
+        {
+            table_[i] = static_cast<std::uint8_t>(i);
+        }
+    }
+
+    /**
+     * @brief Map the 52 letters "A-Za-z" to `images`, in that order, and every other byte to itself
+     *
+     */
+    [[nodiscard]] static constexpr byte_map letters(const std::array<char, 52> &images) noexcept
+    {
+        byte_map result{};
+        for (std::size_t i{}; i < 26; ++i)
+        {
+            result.table_['A' + i] = static_cast<std::uint8_t>(images[i]);
+            result.table_['a' + i] = static_cast<std::uint8_t>(images[26 + i]);
+        }
+        return result;
+    }
+
+    constexpr void set(const char byte, const char image) noexcept
+    {
+        table_[static_cast<std::uint8_t>(byte)] = static_cast<std::uint8_t>(image);
+    }
+
+    [[nodiscard]] constexpr char operator[](const char byte) const noexcept
+    {
+        return static_cast<char>(table_[static_cast<std::uint8_t>(byte)]);
+    }
+
+    void apply(const char *const input, char *const output, const std::size_t size) const noexcept
+    {
+        const auto *const in{reinterpret_cast<const std::uint8_t *>(input)};
+        auto *const out{reinterpret_cast<std::uint8_t *>(output)};
+        std::size_t i{};
+        for (; i + 8 <= size; i += 8)
+        {
+            out[i] = table_[in[i]];
+            out[i + 1] = table_[in[i + 1]];
+            out[i + 2] = table_[in[i + 2]];
+            out[i + 3] = table_[in[i + 3]];
+            out[i + 4] = table_[in[i + 4]];
+            out[i + 5] = table_[in[i + 5]];
+            out[i + 6] = table_[in[i + 6]];
+            out[i + 7] = table_[in[i + 7]];
+        }
+        for (; i < size; ++i)
+        {
+            out[i] = table_[in[i]];
+        }
+    }
+
+    [[nodiscard]] std::string apply(const std::string_view input, const std::size_t chunk_size = 1 << 20) const noexcept
+    {
+        const std::size_t size{input.size()}, chunks{(size + chunk_size - 1) / chunk_size};
+        return fill_string(size, [&](char *const data) {
+            parallel_for(chunks, [&](const std::size_t i, std::size_t) {
+                const std::size_t begin{i * chunk_size};
+                apply(input.data() + begin, data + begin, std::min(chunk_size, size - begin));
+            });
+        });
+    }
+
+  private:
+    std::array<std::uint8_t, 256> table_{};
+};
+} // namespace tprotect::cipher
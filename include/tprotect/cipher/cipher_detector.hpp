@@ -0,0 +1,145 @@
+// cipher_detector.hpp: Telling Ciphers Apart From Their Ciphertext
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include <tprotect/cipher/affine_cipher.hpp>
+#include <tprotect/cipher/frequency_analyzer.hpp>
+#include <tprotect/cipher/letters.hpp>
+
+namespace tprotect::cipher
+{
+/**
+ * @brief Letter counts of a text, with the statistics that separate the ciphers
+ *
+ */
+struct letter_statistics
+{
+    std::array<std::size_t, 52> counts{}; // A-Z, then a-z
+    std::size_t letters{};
+    bool letters_only{true}; // no spaces, digits or punctuation, as the polygraphic ciphers emit
+
+    [[nodiscard]] static letter_statistics of(const std::string_view text) noexcept
+    {
+        letter_statistics result{};
+        for (const char ch : text)
+        {
+            if (const auto symbol{letter_symbol(ch)}; symbol != no_letter)
+            {
+                result.counts[symbol]++;
+                result.letters++;
+            }
+            else
+            {
+                result.letters_only = result.letters_only && (ch == '\n' || ch == '\r');
+            }
+        }
+        return result;
+    }
+
+    [[nodiscard]] std::array<std::size_t, 26> folded() const noexcept
+    {
+        std::array<std::size_t, 26> result{};
+        for (std::size_t i{}; i < 26; ++i)
+        {
+            result[i] = counts[i] + counts[26 + i];
+        }
+        return result;
+    }
+
+    // The chance that two letters drawn at random are the same: about 0.066 for English, 1/26 for uniform text
+    template <std::size_t N>
+    [[nodiscard]] static double coincidence(const std::array<std::size_t, N> &counts) noexcept
+    {
+        double pairs{}, total{};
+        for (const auto count : counts)
+        {
+            pairs += static_cast<double>(count) * static_cast<double>(count > 0 ? count - 1 : 0);
+            total += static_cast<double>(count);
+        }
+        return total > 1 ? pairs / (total * (total - 1)) : 0.;
+    }
+};
+
+/**
+ * @brief The `transposition_cipher` key whose decryption of `text` fits English letter frequencies best
+ *
+ * @param fit if given, receives the chi-squared distance of that decryption per letter; below about 0.2 is English
+ */
+[[nodiscard]] inline int best_shift(const std::string_view text, double *const fit = nullptr) noexcept
+{
+    return frequency_analyzer::best_shift(letter_statistics::of(text).folded(), fit);
+}
+
+/**
+ * @brief Guess which of this project's ciphers produced `text`, by name as the command line takes it
+ *
+ * Homophonic ciphertext spreads its letters evenly over all 52 symbols. Playfair and Hill emit bare uppercase letters
+ * and flatten the letter frequencies, and Playfair never repeats a letter within a pair nor uses J. What remains is
+ * monoalphabetic: a transposition if some shift makes it English, else an affine cipher if some affine key does, and
+ * a substitution otherwise. Plaintext is reported as a transposition, which `best_shift()` then finds to be 0. Needs
+ * a few hundred letters to be reliable
+ *
+ * @return empty if `text` has no letters
+ */
+[[nodiscard]] inline std::string_view detect_cipher(const std::string_view text) noexcept
+{
+    const auto statistics{letter_statistics::of(text)};
+    if (statistics.letters == 0)
+    {
+        return {};
+    }
+
+    std::size_t symbols_used{};
+    for (const auto count : statistics.counts)
+    {
+        symbols_used += count > 0;
+    }
+    if (symbols_used > 40 && letter_statistics::coincidence(statistics.counts) < 0.03)
+    {
+        return "homophonic";
+    }
+
+    const auto folded{statistics.folded()};
+    const bool uppercase_only{std::all_of(statistics.counts.begin() + 26, statistics.counts.end(),
+                                          [](const std::size_t count) { return count == 0; })};
+    if (statistics.letters_only && uppercase_only)
+    {
+        bool playfair{statistics.letters % 2 == 0 && folded['J' - 'A'] == 0};
+        char previous{};
+        std::size_t position{};
+        for (std::size_t i{}; i < text.size() && playfair; ++i)
+        {
+            if (letter_index(text[i]) >= 0) // uppercase, as every letter is here
+            {
+                playfair = position % 2 == 0 || text[i] != previous;
+                previous = text[i];
+                position++;
+            }
+        }
+        if (playfair)
+        {
+            return "playfair";
+        }
+        if (letter_statistics::coincidence(folded) < 0.055)
+        {
+            return "hill";
+        }
+    }
+
+    double fit{};
+    [[maybe_unused]] const auto shift{best_shift(text, &fit)};
+    if (fit < 0.2)
+    {
+        return "transposition";
+    }
+    std::array<std::uint64_t, 26> counts{};
+    std::ranges::copy(folded, counts.begin());
+    return affine_cipher::recover(counts).fit < 0.2 ? "affine" : "substitution";
+}
+} // namespace tprotect::cipher
@@ -0,0 +1,399 @@
+// corpus_analyzer.hpp: Pooled Statistics Over Many Short Ciphertexts
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <format>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <tprotect/cipher/frequency_analyzer.hpp>
+#include <tprotect/cipher/letters.hpp>
+#include <tprotect/cipher/ngram_model.hpp>
+#include <tprotect/cipher/substitution_solver.hpp>
+#include <tprotect/global.hpp>
+#include <tprotect/mapped_file.hpp>
+#include <tprotect/parallel.hpp>
+
+namespace tprotect::cipher
+{
+/**
+ * @brief Letter counts of one message or of a pool of messages
+ *
+ */
+struct message_statistics
+{
+    std::array<long long, 52> counts{}; // A-Z (0-25), a-z (26-51)
+    long long total_letters{};
+
+    void add(const std::string_view text) noexcept
+    {
+        std::array<long long, 53> tally{};
+        for (const char ch : text)
+        {
+            tally[letter_symbol(ch)]++;
+        }
+        for (std::size_t i{}; i < counts.size(); ++i)
+        {
+            counts[i] += tally[i];
+            total_letters += tally[i];
+        }
+    }
+
+    void merge(const message_statistics &other) noexcept
+    {
+        for (std::size_t i{}; i < counts.size(); ++i)
+        {
+            counts[i] += other.counts[i];
+        }
+        total_letters += other.total_letters;
+    }
+
+    // Counts with 'A' and 'a' folded together
+    [[nodiscard]] std::array<long long, 26> folded() const noexcept
+    {
+        std::array<long long, 26> result{};
+        for (std::size_t i{}; i < 26; ++i)
+        {
+            result[i] = counts[i] + counts[26 + i];
+        }
+        return result;
+    }
+
+    [[nodiscard]] double index_of_coincidence() const noexcept
+    {
+        if (total_letters < 2)
+        {
+            return 0.;
+        }
+        double sum{};
+        for (const long long n : folded())
+        {
+            sum += static_cast<double>(n) * static_cast<double>(n - 1);
+        }
+        return sum / (static_cast<double>(total_letters) * static_cast<double>(total_letters - 1));
+    }
+};
+
+/**
+ * @brief A group of messages that look like they share one key
+ *
+ */
+struct corpus_cluster
+{
+    std::vector<std::size_t> members; // indices into `corpus_analyzer::messages()`
+    message_statistics pooled;
+    int shift;           // best `transposition_cipher` key for the pooled histogram
+    std::string mapping; // best-guess `substitution_cipher` mapping for the pooled histogram
+};
+
+class corpus_analyzer
+{
+  public:
+    /**
+     * @brief Analyze a set of files, each one treated as a separate message
+     *
+     * Every file is memory-mapped only while it is being counted, so thousands of inputs do not pin their pages
+     *
+     * @return eresult<corpus_analyzer> the statistics, or the first file that could not be mapped
+     */
+    [[nodiscard]] static eresult<corpus_analyzer> from_files(const std::vector<std::string> &file_names) noexcept
+    {
+        corpus_analyzer analyzer{};
+        analyzer.file_names_ = file_names;
+        analyzer.messages_.resize(file_names.size());
+
+        std::mutex error_mutex;
+        std::string error{};
+        analyzer.count(file_names.size(), [&](const std::size_t i, auto &&tally) {
+            if (const auto file{mapped_file::open(file_names[i])}; file)
+            {
+                tally(file->view());
+            }
+            else
+            {
+                std::lock_guard<std::mutex> guard{error_mutex};
+                if (error.empty())
+                {
+                    error = file.error().message(); // formatted here, where the context lives
+                }
+            }
+        });
+
+        if (!error.empty())
+        {
+            return std::unexpected{std::move(error)};
+        }
+        return {std::move(analyzer)};
+    }
+
+    [[nodiscard]] const std::vector<message_statistics> &messages() const noexcept
+    {
+        return messages_;
+    }
+
+    [[nodiscard]] const message_statistics &pooled() const noexcept
+    {
+        return pooled_;
+    }
+
+    /**
+     * @brief Split the messages into groups that appear to be under different keys
+     *
+     * This is k-means over the letter distributions, seeded with farthest-first traversal so the result is
+     * deterministic. Centroids are the pooled (length-weighted) distributions of their members, so long messages pull
+     * harder than short ones
+     *
+     * @param cluster_count the number of keys to assume, clamped to the number of non-empty messages
+     * @return std::vector<corpus_cluster> non-empty clusters, largest first
+     */
+    [[nodiscard]] std::vector<corpus_cluster> cluster(const std::size_t cluster_count,
+                                                      const int iterations = 32) const noexcept
+    {
+        using profile = std::array<double, 52>;
+
+        const auto normalize{[](const message_statistics &stats) {
+            profile result{};
+            if (stats.total_letters > 0)
+            {
+                for (std::size_t i{}; i < result.size(); ++i)
+                {
+                    result[i] = static_cast<double>(stats.counts[i]) / static_cast<double>(stats.total_letters);
+                }
+            }
+            return result;
+        }};
+        const auto distance{[](const profile &a, const profile &b) {
+            double sum{};
+            for (std::size_t i{}; i < a.size(); ++i)
+            {
+                sum += (a[i] - b[i]) * (a[i] - b[i]);
+            }
+            return sum;
+        }};
+
+        std::vector<std::size_t> candidates;
+        for (std::size_t i{}; i < messages_.size(); ++i)
+        {
+            if (messages_[i].total_letters > 0)
+            {
+                candidates.push_back(i);
+            }
+        }
+        const std::size_t k{std::clamp<std::size_t>(cluster_count, 1, std::max<std::size_t>(1, candidates.size()))};
+        if (candidates.empty())
+        {
+            return {};
+        }
+
+        std::vector<profile> profiles(messages_.size());
+        parallel_for(messages_.size(),
+                     [&](const std::size_t i, std::size_t) { profiles[i] = normalize(messages_[i]); });
+
+        // Farthest-first seeding, starting from the longest message
+        std::vector<profile> centroids{profiles[*std::ranges::max_element(
+            candidates, {}, [&](const std::size_t i) { return messages_[i].total_letters; })]};
+        std::vector<double> nearest(messages_.size(), std::numeric_limits<double>::max());
+        while (centroids.size() < k)
+        {
+            for (const std::size_t i : candidates)
+            {
+                nearest[i] = std::min(nearest[i], distance(profiles[i], centroids.back()));
+            }
+            centroids.push_back(profiles[*std::ranges::max_element(candidates, {}, [&](const std::size_t i) {
+                return nearest[i];
+            })]);
+        }
+
+        std::vector<std::size_t> assignment(messages_.size(), k);
+        for (int iteration{}; iteration < iterations; ++iteration)
+        {
+            std::atomic<bool> changed{};
+            parallel_for(candidates.size(), [&](const std::size_t c, std::size_t) {
+                const std::size_t i{candidates[c]};
+                std::size_t best{};
+                double best_distance{std::numeric_limits<double>::max()};
+                for (std::size_t j{}; j < centroids.size(); ++j)
+                {
+                    if (const double d{distance(profiles[i], centroids[j])}; d < best_distance)
+                    {
+                        best = j;
+                        best_distance = d;
+                    }
+                }
+                if (assignment[i] != best)
+                {
+                    assignment[i] = best;
+                    changed.store(true, std::memory_order_relaxed);
+                }
+            });
+            if (!changed.load(std::memory_order_relaxed))
+            {
+                break;
+            }
+
+            std::vector<message_statistics> pooled(k);
+            for (const std::size_t i : candidates)
+            {
+                pooled[assignment[i]].merge(messages_[i]);
+            }
+            for (std::size_t j{}; j < k; ++j)
+            {
+                if (pooled[j].total_letters > 0) // an emptied cluster keeps its old centroid
+                {
+                    centroids[j] = normalize(pooled[j]);
+                }
+            }
+        }
+
+        std::vector<corpus_cluster> clusters(k);
+        for (const std::size_t i : candidates)
+        {
+            clusters[assignment[i]].members.push_back(i);
+            clusters[assignment[i]].pooled.merge(messages_[i]);
+        }
+        std::erase_if(clusters, [](const corpus_cluster &cluster) { return cluster.members.empty(); });
+        for (auto &cluster : clusters)
+        {
+            cluster.shift = recover_shift(cluster.pooled);
+            cluster.mapping = recover_mapping(cluster.pooled);
+        }
+        std::ranges::sort(clusters, std::greater<>{}, [](const corpus_cluster &cluster) {
+            return cluster.members.size();
+        });
+        return clusters;
+    }
+
+    /**
+     * @brief Find the shift that best explains a histogram as shifted English
+     *
+     * @return int the `transposition_cipher` key minimising the chi-squared statistic against
+     * `frequency_analyzer::get_english_frequencies()`
+     */
+    [[nodiscard]] static int recover_shift(const message_statistics &stats) noexcept
+    {
+        return frequency_analyzer::best_shift(stats.folded());
+    }
+
+    /**
+     * @brief Guess a substitution mapping by matching frequency ranks against English
+     *
+     * The most frequent ciphertext symbols are assigned to the most frequent lowercase letters, and the remainder to
+     * uppercase letters in the same order. This is a quick guess; `solve_substitution` searches for the key the pooled
+     * trigrams support
+     *
+     * @return std::string a 52-character mapping in the format accepted by `substitution_cipher::set_key`
+     */
+    [[nodiscard]] static std::string recover_mapping(const message_statistics &stats) noexcept
+    {
+        constexpr auto english{frequency_analyzer::get_english_frequencies()};
+        std::array<int, 26> plain_order{};
+        std::iota(plain_order.begin(), plain_order.end(), 0);
+        std::ranges::stable_sort(plain_order, std::greater<>{}, [&](const int i) { return english[i]; });
+
+        std::array<int, 52> cipher_order{};
+        std::iota(cipher_order.begin(), cipher_order.end(), 0);
+        std::ranges::stable_sort(cipher_order, std::greater<>{}, [&](const int i) { return stats.counts[i]; });
+
+        const auto symbol{[](const int i) { return static_cast<char>(i < 26 ? 'A' + i : 'a' + (i - 26)); }};
+        std::string mapping(52, '?'); // a-z (0-25), A-Z (26-51), as in `substitution_cipher`
+        for (std::size_t rank{}; rank < 26; ++rank)
+        {
+            mapping[plain_order[rank]] = symbol(cipher_order[rank]);
+            mapping[26 + plain_order[rank]] = symbol(cipher_order[26 + rank]);
+        }
+        return mapping;
+    }
+
+    /**
+     * @brief Pool the symbol trigrams of a cluster's messages, for `substitution_solver`
+     *
+     * Every member file is mapped again only while it is counted; workers count into tables of their own, which are
+     * merged at the end, so no trigram spans two messages
+     *
+     * @return eresult<symbol_trigrams> the pooled counts, or the first file that could not be mapped
+     */
+    [[nodiscard]] eresult<symbol_trigrams> trigrams(const corpus_cluster &cluster) const noexcept
+    {
+        std::vector<symbol_trigrams> tables(worker_count());
+        std::mutex error_mutex;
+        std::string error{};
+        parallel_for(cluster.members.size(), [&](const std::size_t i, const std::size_t worker) {
+            if (const auto file{mapped_file::open(file_names_[cluster.members[i]])}; file)
+            {
+                tables[worker].add(file->view());
+            }
+            else
+            {
+                std::lock_guard<std::mutex> guard{error_mutex};
+                if (error.empty())
+                {
+                    error = file.error().message(); // formatted here, where the context lives
+                }
+            }
+        });
+
+        if (!error.empty())
+        {
+            return std::unexpected{std::move(error)};
+        }
+        for (std::size_t i{1}; i < tables.size(); ++i)
+        {
+            tables.front().merge(tables[i]);
+        }
+        return std::move(tables.front());
+    }
+
+    /**
+     * @brief Recover a substitution key from pooled trigrams, running `restarts` shards of the solver in parallel
+     *
+     * @return substitution_solution the best-scoring shard's key, scored per trigram
+     */
+    [[nodiscard]] static substitution_solution solve_substitution(const symbol_trigrams &pooled,
+                                                                  const ngram_model &model,
+                                                                  const std::size_t restarts,
+                                                                  const std::size_t iterations) noexcept
+    {
+        const substitution_solver solver{pooled, model};
+        std::mutex best_mutex;
+        substitution_solution best{{}, std::numeric_limits<double>::lowest(), 0};
+        parallel_for(std::max<std::size_t>(1, restarts), [&](const std::size_t shard, std::size_t) {
+            auto solution{solver.solve_shard(shard, iterations, [] { return false; },
+                                             [](const substitution_solution &) {})};
+            std::lock_guard<std::mutex> guard{best_mutex};
+            if (solution.score > best.score || (solution.score == best.score && solution.shard < best.shard))
+            {
+                best = std::move(solution);
+            }
+        });
+        return best;
+    }
+
+  private:
+    corpus_analyzer() noexcept = default;
+
+    // `visit(i, tally)` must call `tally(text)` with the contents of message `i`, if it has any
+    template <typename Visit> void count(const std::size_t message_count, Visit &&visit) noexcept
+    {
+        parallel_for(message_count, [&](const std::size_t i, std::size_t) {
+            visit(i, [&](const std::string_view text) { messages_[i].add(text); });
+        });
+
+        for (const auto &message : messages_)
+        {
+            pooled_.merge(message);
+        }
+    }
+
+    std::vector<std::string> file_names_;
+    std::vector<message_statistics> messages_;
+    message_statistics pooled_{};
+};
+} // namespace tprotect::cipher
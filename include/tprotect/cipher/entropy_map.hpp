@@ -0,0 +1,215 @@
+// entropy_map.hpp: Per-Block Byte Statistics For Triaging Binary Files
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <tprotect/global.hpp>
+#include <tprotect/mapped_file.hpp>
+#include <tprotect/parallel.hpp>
+
+namespace tprotect::cipher
+{
+/**
+ * @brief What one block of a file looks like, byte by byte
+ *
+ */
+struct block_statistics
+{
+    float entropy;     // Shannon entropy of the bytes, in bits per byte from 0 to 8
+    float printable;   // the share of printable ASCII bytes, counting tab, LF and CR
+    float coincidence; // the index of coincidence of the case-folded letters, 0 with fewer than two
+
+    /**
+     * @brief Whether the block reads like natural-language text, plain or under a classical cipher
+     *
+     * Such text is almost all printable, with the entropy of an alphabet and a few marks; compressed or encrypted
+     * binary data sits near 8 bits per byte, and code or tables rarely stay printable
+     *
+     */
+    [[nodiscard]] bool text_like() const noexcept
+    {
+        return printable > .95f && entropy > 3.f && entropy < 5.5f;
+    }
+};
+
+/**
+ * @brief Entropy, printable ratio and letter coincidence for every fixed-size block of a file
+ *
+ * Each block gets a full 256-bin histogram, counted into four interleaved sub-histograms so runs of the same byte do
+ * not queue on one counter, then summed; blocks are counted in parallel. The result is one small record per block, so
+ * even a multi-gigabyte capture maps to an array that any view can scan per frame
+ *
+ */
+class entropy_map
+{
+  public:
+    static constexpr std::size_t default_block_size{64 * 1024};
+
+    entropy_map() noexcept = default;
+
+    [[nodiscard]] static entropy_map build(const std::string_view bytes,
+                                           const std::size_t block_size = default_block_size) noexcept
+    {
+        entropy_map result{};
+        result.block_size_ = std::max<std::size_t>(1, block_size);
+        result.size_ = bytes.size();
+        result.blocks_.resize((bytes.size() + result.block_size_ - 1) / result.block_size_);
+        parallel_for(result.blocks_.size(), [&](const std::size_t i, std::size_t) {
+            result.blocks_[i] = measure(bytes.substr(i * result.block_size_, result.block_size_));
+        });
+        return result;
+    }
+
+    // Map and scan a file; the mapping is released once the map is built
+    [[nodiscard]] static cresult<entropy_map> open(const std::string &file_name,
+                                                   const std::size_t block_size = default_block_size) noexcept
+    {
+        return mapped_file::open(file_name).transform(
+            [&](const mapped_file &file) { return build(file.view(), block_size); });
+    }
+
+    [[nodiscard]] std::span<const block_statistics> blocks() const noexcept
+    {
+        return blocks_;
+    }
+
+    [[nodiscard]] std::size_t block_size() const noexcept
+    {
+        return block_size_;
+    }
+
+    // The size of the scanned bytes
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    /**
+     * @brief Blocks [first, last) merged into `bins` consecutive groups, each the mean of its blocks, for drawing a
+     * zoomed view one bin per pixel
+     *
+     */
+    [[nodiscard]] std::vector<block_statistics> resample(std::size_t first, std::size_t last,
+                                                         const std::size_t bins) const noexcept
+    {
+        last = std::min(last, blocks_.size());
+        first = std::min(first, last);
+        std::vector<block_statistics> result(bins);
+        if (first == last || bins == 0)
+        {
+            return result;
+        }
+        const double span{static_cast<double>(last - first) / static_cast<double>(bins)};
+        for (std::size_t bin{}; bin < bins; ++bin)
+        {
+            // Every bin covers at least one block, so zooming in past one block per bin repeats blocks
+            const auto begin{first + static_cast<std::size_t>(static_cast<double>(bin) * span)};
+            const auto end{std::max(begin + 1, first + static_cast<std::size_t>(static_cast<double>(bin + 1) * span))};
+            block_statistics sum{};
+            for (std::size_t i{begin}; i < end; ++i)
+            {
+                sum.entropy += blocks_[i].entropy;
+                sum.printable += blocks_[i].printable;
+                sum.coincidence += blocks_[i].coincidence;
+            }
+            const auto count{static_cast<float>(end - begin)};
+            result[bin] = {sum.entropy / count, sum.printable / count, sum.coincidence / count};
+        }
+        return result;
+    }
+
+    /**
+     * @brief The next run of text-like blocks at or after block `from`, wrapping around to the start
+     *
+     * @return the run's first block and its end, or nothing if no block is text-like
+     */
+    [[nodiscard]] std::optional<std::pair<std::size_t, std::size_t>> next_text(const std::size_t from) const noexcept
+    {
+        const std::size_t count{blocks_.size()};
+        for (std::size_t step{}; step < count; ++step)
+        {
+            const std::size_t first{(from + step) % count};
+            if (blocks_[first].text_like())
+            {
+                std::size_t end{first + 1};
+                while (end < count && blocks_[end].text_like())
+                {
+                    end++;
+                }
+                return std::pair{first, end};
+            }
+        }
+        return std::nullopt;
+    }
+
+    [[nodiscard]] static block_statistics measure(const std::string_view block) noexcept
+    {
+        const auto *const in{reinterpret_cast<const std::uint8_t *>(block.data())};
+        const std::size_t size{block.size()};
+        std::array<std::array<std::uint32_t, 256>, 4> partial{};
+        std::size_t i{};
+        for (; i + 4 <= size; i += 4)
+        {
+            partial[0][in[i]]++;
+            partial[1][in[i + 1]]++;
+            partial[2][in[i + 2]]++;
+            partial[3][in[i + 3]]++;
+        }
+        for (; i < size; ++i)
+        {
+            partial[0][in[i]]++;
+        }
+        std::array<std::uint32_t, 256> counts{};
+        for (std::size_t value{}; value < counts.size(); ++value)
+        {
+            counts[value] = partial[0][value] + partial[1][value] + partial[2][value] + partial[3][value];
+        }
+
+        block_statistics result{};
+        if (size == 0)
+        {
+            return result;
+        }
+        const double total{static_cast<double>(size)};
+        double entropy{};
+        std::uint64_t printable{counts['\t'] + counts['\n'] + counts['\r']};
+        for (std::size_t value{}; value < counts.size(); ++value)
+        {
+            if (counts[value] > 0)
+            {
+                const double p{counts[value] / total};
+                entropy -= p * std::log2(p);
+            }
+            printable += value >= 0x20 && value < 0x7f ? counts[value] : 0;
+        }
+
+        double pairs{}, letters{};
+        for (std::size_t letter{}; letter < 26; ++letter)
+        {
+            const double n{static_cast<double>(counts['A' + letter] + counts['a' + letter])};
+            pairs += n * (n - 1);
+            letters += n;
+        }
+        result.entropy = static_cast<float>(entropy);
+        result.printable = static_cast<float>(static_cast<double>(printable) / total);
+        result.coincidence = letters > 1 ? static_cast<float>(pairs / (letters * (letters - 1))) : 0.f;
+        return result;
+    }
+
+  private:
+    std::size_t block_size_{default_block_size};
+    std::size_t size_{};
+    std::vector<block_statistics> blocks_;
+};
+} // namespace tprotect::cipher
@@ -4,9 +4,13 @@
 
 #include <algorithm>
 #include <array>
+#include <cstddef>
+#include <limits>
 #include <string_view>
 #include <vector>
 
+#include <tprotect/cipher/letters.hpp>
+
 namespace tprotect::cipher
 {
 struct letter_frequency
@@ -36,34 +40,40 @@ class frequency_analyzer
     {
         // Count frequencies
         std::array<int, 52> counts{}; // A-Z (0-25), a-z (26-51)
-        int total_letters{};
 
         for (const char ch : text)
         {
-            if (ch >= 'A' && ch <= 'Z')
-            {
-                counts[ch - 'A']++;
-                total_letters++;
-            }
-            else if (ch >= 'a' && ch <= 'z')
+            if (const auto symbol{letter_symbol(ch)}; symbol != no_letter)
             {
-                if (case_sensitive)
-                {
-                    counts[26 + (ch - 'a')]++;
-                }
-                else
-                {
-                    counts[ch - 'a']++;
-                }
-                total_letters++;
+                counts[case_sensitive ? symbol : symbol % 26]++;
             }
         }
 
+        return summarize(counts, case_sensitive);
+    }
+
+    /**
+     * @brief Turn raw letter counts into a frequency table
+     *
+     * @param counts A-Z (0-25), a-z (26-51); when not case sensitive, only A-Z is read
+     * @param case_sensitive If true, 'A' and 'a' are reported separately
+     * @return std::vector<letter_frequency> Sorted by frequency (descending)
+     */
+    template <typename Count>
+    [[nodiscard]] static std::vector<letter_frequency> summarize(const std::array<Count, 52> &counts,
+                                                                 bool case_sensitive = false) noexcept
+    {
+        const int letter_range{case_sensitive ? 52 : 26};
+        Count total_letters{};
+        for (int i{}; i < letter_range; ++i)
+        {
+            total_letters += counts[i];
+        }
+
         // Build result vector
         std::vector<letter_frequency> result;
         result.reserve(52);
 
-        const int letter_range{case_sensitive ? 52 : 26};
         for (int i{}; i < letter_range; ++i)
         {
             if (counts[i] > 0)
@@ -81,7 +91,7 @@ class frequency_analyzer
                 const float percentage{total_letters > 0
                                            ? (static_cast<float>(counts[i]) * 100.f / static_cast<float>(total_letters))
                                            : 0.f};
-                result.push_back({letter, counts[i], percentage});
+                result.push_back({letter, static_cast<int>(counts[i]), percentage});
             }
         }
 
@@ -91,6 +101,62 @@ class frequency_analyzer
         return result;
     }
 
+    /**
+     * @brief Chi-squared statistic of case-folded letter counts against English, where plaintext letter `p` was
+     * enciphered as letter `cipher_letter(p)`
+     *
+     * Key searches over a histogram score every candidate key with this, so no key touches the text
+     *
+     * @param total the sum of `counts`, greater than zero
+     */
+    template <typename Count, typename F>
+    [[nodiscard]] static constexpr double english_distance(const std::array<Count, 26> &counts, const double total,
+                                                           const F &cipher_letter) noexcept
+    {
+        constexpr auto english{get_english_frequencies()};
+        double distance{};
+        for (std::size_t plain{}; plain < 26; ++plain)
+        {
+            const double expected{static_cast<double>(english[plain]) / 100. * total};
+            const double observed{static_cast<double>(counts[cipher_letter(plain)])};
+            distance += (observed - expected) * (observed - expected) / expected;
+        }
+        return distance;
+    }
+
+    /**
+     * @brief The `transposition_cipher` key whose decryption of case-folded `counts` fits English best
+     *
+     * @param fit if given, receives the chi-squared distance of that decryption per letter; below about 0.2 is English
+     */
+    template <typename Count>
+    [[nodiscard]] static int best_shift(const std::array<Count, 26> &counts, double *const fit = nullptr) noexcept
+    {
+        double total{};
+        for (const auto count : counts)
+        {
+            total += static_cast<double>(count);
+        }
+
+        int best{};
+        double best_distance{std::numeric_limits<double>::max()};
+        for (std::size_t shift{}; shift < 26 && total > 0.; ++shift)
+        {
+            const double distance{
+                english_distance(counts, total, [shift](const std::size_t plain) { return (plain + shift) % 26; })};
+            if (distance < best_distance)
+            {
+                best_distance = distance;
+                best = static_cast<int>(shift);
+            }
+        }
+        if (fit)
+        {
+            *fit = total > 0. ? best_distance / total : std::numeric_limits<double>::max();
+        }
+        return best;
+    }
+
     /**
      * @brief Get standard English letter frequencies for comparison
      *
@@ -0,0 +1,389 @@
+// hill_cipher.hpp: The Hill Cipher And Known-Plaintext Key Recovery
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <tprotect/cipher/letters.hpp>
+#include <tprotect/global.hpp>
+#include <tprotect/parallel.hpp>
+
+namespace tprotect::cipher
+{
+/**
+ * @brief A square matrix of residues mod 26, row-major, of order up to `max_order`
+ *
+ */
+struct modular_matrix
+{
+    static constexpr std::size_t max_order{5};
+
+    std::size_t order{};
+    std::array<std::uint8_t, max_order * max_order> cells{};
+
+    [[nodiscard]] std::uint8_t &at(const std::size_t row, const std::size_t column) noexcept
+    {
+        return cells[row * order + column];
+    }
+
+    [[nodiscard]] std::uint8_t at(const std::size_t row, const std::size_t column) const noexcept
+    {
+        return cells[row * order + column];
+    }
+
+    [[nodiscard]] modular_matrix operator*(const modular_matrix &other) const noexcept
+    {
+        modular_matrix product{order};
+        for (std::size_t row{}; row < order; ++row)
+        {
+            for (std::size_t column{}; column < order; ++column)
+            {
+                unsigned sum{};
+                for (std::size_t k{}; k < order; ++k)
+                {
+                    sum += at(row, k) * other.at(k, column);
+                }
+                product.at(row, column) = static_cast<std::uint8_t>(sum % 26);
+            }
+        }
+        return product;
+    }
+
+    /**
+     * @brief The inverse mod 26, if there is one
+     *
+     * 26 is not prime, so Gauss-Jordan elimination cannot always find a unit pivot mod 26 even when the inverse
+     * exists. Instead the inverse is found in the fields mod 2 and mod 13 and the two are combined by the Chinese
+     * remainder theorem
+     *
+     */
+    [[nodiscard]] std::optional<modular_matrix> inverse() const noexcept
+    {
+        const auto over_two{inverse_mod_prime(2)};
+        const auto over_thirteen{inverse_mod_prime(13)};
+        if (!over_two || !over_thirteen)
+        {
+            return std::nullopt;
+        }
+        modular_matrix result{order};
+        for (std::size_t i{}; i < order * order; ++i)
+        {
+            // x = b (mod 13) and x = a (mod 2) give x = b + 13 * ((a - b) mod 2)
+            const auto a{over_two->cells[i]}, b{over_thirteen->cells[i]};
+            result.cells[i] = static_cast<std::uint8_t>(b + 13 * ((a + b) & 1));
+        }
+        return result;
+    }
+
+  private:
+    [[nodiscard]] std::optional<modular_matrix> inverse_mod_prime(const unsigned prime) const noexcept
+    {
+        const auto reciprocal{[prime](const unsigned value) {
+            unsigned result{1};
+            for (unsigned power{prime - 2}, base{value % prime}; power > 0; power >>= 1, base = base * base % prime)
+            {
+                result = power & 1 ? result * base % prime : result;
+            }
+            return result;
+        }};
+
+        // [this | identity] reduced to [identity | inverse]
+        std::array<std::array<unsigned, max_order * 2>, max_order> rows{};
+        for (std::size_t row{}; row < order; ++row)
+        {
+            for (std::size_t column{}; column < order; ++column)
+            {
+                rows[row][column] = at(row, column) % prime;
+            }
+            rows[row][order + row] = 1;
+        }
+        for (std::size_t column{}; column < order; ++column)
+        {
+            std::size_t pivot{column};
+            while (pivot < order && rows[pivot][column] == 0)
+            {
+                ++pivot;
+            }
+            if (pivot == order)
+            {
+                return std::nullopt; // singular
+            }
+            std::swap(rows[pivot], rows[column]);
+            const unsigned scale{reciprocal(rows[column][column])};
+            for (auto &cell : rows[column])
+            {
+                cell = cell * scale % prime;
+            }
+            for (std::size_t row{}; row < order; ++row)
+            {
+                if (const unsigned factor{rows[row][column]}; row != column && factor != 0)
+                {
+                    for (std::size_t k{}; k < order * 2; ++k)
+                    {
+                        rows[row][k] = (rows[row][k] + (prime - factor) * rows[column][k]) % prime;
+                    }
+                }
+            }
+        }
+
+        modular_matrix result{order};
+        for (std::size_t row{}; row < order; ++row)
+        {
+            for (std::size_t column{}; column < order; ++column)
+            {
+                result.at(row, column) = static_cast<std::uint8_t>(rows[row][order + column]);
+            }
+        }
+        return result;
+    }
+};
+
+/**
+ * @brief Block substitution by an invertible matrix mod 26: each block of n letters is multiplied by the key
+ *
+ * The key is n*n letters read row-major, for n from 2 to `modular_matrix::max_order`, e.g. "GYBNQKURP" for n = 3.
+ * Only letters are enciphered, the output is uppercase letters without spacing and the last block is padded with X
+ *
+ */
+class hill_cipher
+{
+  public:
+    explicit hill_cipher(const std::string_view key) noexcept
+    {
+        set_key(key);
+    }
+
+    explicit hill_cipher(const modular_matrix &key) noexcept
+    {
+        set_key(key);
+    }
+
+    [[nodiscard]] cresult<std::string> encrypt(const std::string_view input) const noexcept
+    {
+        if (!inverse_)
+        {
+            return std::unexpected{compact_error{errc::invalid_key, key_text_}};
+        }
+        auto letters{extract_letters(input)};
+        letters.resize((letters.size() + key_.order - 1) / key_.order * key_.order, std::uint8_t{'X' - 'A'});
+        return multiply(key_, letters);
+    }
+
+    [[nodiscard]] cresult<std::string> decrypt(const std::string_view input) const noexcept
+    {
+        if (!inverse_)
+        {
+            return std::unexpected{compact_error{errc::invalid_key, key_text_}};
+        }
+        const auto letters{extract_letters(input)};
+        if (letters.size() % key_.order != 0)
+        {
+            return std::unexpected{compact_error{errc::corrupt_data}}; // Hill ciphertext is always whole blocks
+        }
+        return multiply(*inverse_, letters);
+    }
+
+    void set_key(const std::string_view key) noexcept
+    {
+        const auto letters{extract_letters(key)};
+        modular_matrix matrix{};
+        while ((matrix.order + 1) * (matrix.order + 1) <= letters.size())
+        {
+            ++matrix.order;
+        }
+        if (matrix.order * matrix.order != letters.size() || matrix.order < 2 ||
+            matrix.order > modular_matrix::max_order)
+        {
+            key_ = {};
+            inverse_.reset();
+            key_text_ = key;
+            return;
+        }
+        std::ranges::copy(letters, matrix.cells.begin());
+        set_key(matrix);
+    }
+
+    // Singular keys make encryption fail, since the text could not be decrypted
+    void set_key(const modular_matrix &key) noexcept
+    {
+        key_ = key;
+        inverse_ = key.order >= 2 ? key.inverse() : std::nullopt;
+        key_text_ = to_string(key);
+    }
+
+    [[nodiscard]] static std::string to_string(const modular_matrix &key) noexcept
+    {
+        std::string text(key.order * key.order, 'A');
+        for (std::size_t i{}; i < text.size(); ++i)
+        {
+            text[i] = static_cast<char>('A' + key.cells[i]);
+        }
+        return text;
+    }
+
+  private:
+    // Whole chunks of blocks per call, with the order fixed at compile time so the row products unroll and the loop
+    // over blocks can be vectorized
+    template <std::size_t N>
+    static void multiply_blocks(const modular_matrix &matrix, const std::uint8_t *in, std::uint8_t *out,
+                                const std::size_t count) noexcept
+    {
+        std::array<std::uint16_t, N * N> cells{};
+        for (std::size_t i{}; i < N * N; ++i)
+        {
+            cells[i] = matrix.cells[i];
+        }
+        for (std::size_t block{}; block < count; ++block, in += N, out += N)
+        {
+            for (std::size_t row{}; row < N; ++row)
+            {
+                std::uint16_t sum{}; // at most 5 * 25 * 25, so 16 bits suffice
+                for (std::size_t k{}; k < N; ++k)
+                {
+                    sum = static_cast<std::uint16_t>(sum + cells[row * N + k] * in[k]);
+                }
+                out[row] = static_cast<std::uint8_t>(sum % 26);
+            }
+        }
+    }
+
+    [[nodiscard]] static std::string multiply(const modular_matrix &matrix,
+                                              const std::vector<std::uint8_t> &letters) noexcept
+    {
+        return transform_blocks(letters, matrix.order,
+                                [&](const std::uint8_t *in, std::uint8_t *out, const std::size_t count) {
+                                    switch (matrix.order)
+                                    {
+                                    case 2:
+                                        return multiply_blocks<2>(matrix, in, out, count);
+                                    case 3:
+                                        return multiply_blocks<3>(matrix, in, out, count);
+                                    case 4:
+                                        return multiply_blocks<4>(matrix, in, out, count);
+                                    default:
+                                        return multiply_blocks<5>(matrix, in, out, count);
+                                    }
+                                });
+    }
+
+    modular_matrix key_{};
+    std::optional<modular_matrix> inverse_{};
+    std::string key_text_; // for error messages
+};
+
+struct hill_recovery
+{
+    modular_matrix key;
+    std::size_t offset; // of the crib, in letters of the ciphertext
+};
+
+/**
+ * @brief Recover a Hill key from ciphertext and a crib, known plaintext at an unknown position
+ *
+ * Every letter offset is tried in parallel. At each, n whole blocks of the crib whose matrix P is invertible give the
+ * key K = C P^-1 from the ciphertext blocks C opposite them, and the crib's other blocks must then encrypt correctly.
+ * The crib should span at least n + 1 whole blocks, so that a key is never accepted without being checked
+ *
+ * @return the match at the lowest offset, if any
+ */
+[[nodiscard]] inline oresult<hill_recovery> recover_hill_key(const std::string_view ciphertext,
+                                                             const std::string_view crib,
+                                                             const std::size_t order) noexcept
+{
+    if (order < 2 || order > modular_matrix::max_order)
+    {
+        return std::nullopt;
+    }
+    const auto cipher_letters{extract_letters(ciphertext)};
+    const auto crib_letters{extract_letters(crib)};
+    if (crib_letters.size() > cipher_letters.size())
+    {
+        return std::nullopt;
+    }
+
+    const auto try_offset{[&](const std::size_t offset) -> std::optional<modular_matrix> {
+        const std::size_t skip{(order - offset % order) % order}; // crib letters before the first whole block
+        if (crib_letters.size() < skip || (crib_letters.size() - skip) / order < order + 1)
+        {
+            return std::nullopt;
+        }
+        const std::size_t blocks{(crib_letters.size() - skip) / order};
+        const auto block_matrix{[&](const std::vector<std::uint8_t> &letters, const std::size_t first,
+                                    const std::size_t start) {
+            modular_matrix matrix{order}; // block `start + c` of `letters` from `first` is column c
+            for (std::size_t column{}; column < order; ++column)
+            {
+                for (std::size_t row{}; row < order; ++row)
+                {
+                    matrix.at(row, column) = letters[first + (start + column) * order + row];
+                }
+            }
+            return matrix;
+        }};
+
+        for (std::size_t start{}; start + order <= blocks; ++start)
+        {
+            const auto plain_inverse{block_matrix(crib_letters, skip, start).inverse()};
+            if (!plain_inverse)
+            {
+                continue;
+            }
+            const auto key{block_matrix(cipher_letters, offset + skip, start) * *plain_inverse};
+            if (!key.inverse())
+            {
+                return std::nullopt; // every consistent key is singular, so no Hill key fits here
+            }
+            for (std::size_t block{}; block < blocks; ++block)
+            {
+                const std::uint8_t *plain{crib_letters.data() + skip + block * order};
+                const std::uint8_t *cipher{cipher_letters.data() + offset + skip + block * order};
+                for (std::size_t row{}; row < order; ++row)
+                {
+                    unsigned sum{};
+                    for (std::size_t k{}; k < order; ++k)
+                    {
+                        sum += key.at(row, k) * plain[k];
+                    }
+                    if (sum % 26 != cipher[row])
+                    {
+                        return std::nullopt;
+                    }
+                }
+            }
+            return key;
+        }
+        return std::nullopt; // the crib's blocks never form an invertible matrix
+    }};
+
+    const std::size_t offsets{cipher_letters.size() - crib_letters.size() + 1};
+    // Only the earliest offset that fits is kept; the atomic copy lets later offsets give up without the lock
+    std::atomic<std::size_t> best_offset{std::numeric_limits<std::size_t>::max()};
+    std::mutex best_mutex;
+    std::optional<hill_recovery> best{};
+    parallel_for(offsets, [&](const std::size_t offset, std::size_t) {
+        if (offset > best_offset.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        if (auto key{try_offset(offset)})
+        {
+            std::lock_guard<std::mutex> guard{best_mutex};
+            if (offset < best_offset.load(std::memory_order_relaxed))
+            {
+                best = hill_recovery{std::move(*key), offset};
+                best_offset.store(offset, std::memory_order_relaxed);
+            }
+        }
+    });
+    return best;
+}
+} // namespace tprotect::cipher
@@ -0,0 +1,215 @@
+// histogram_index.hpp: Block-Sampled Prefix Counts for Range Letter And Bigram Statistics
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <tprotect/cipher/frequency_analyzer.hpp>
+#include <tprotect/cipher/letters.hpp>
+#include <tprotect/parallel.hpp>
+
+namespace tprotect::cipher
+{
+/**
+ * @brief Cumulative letter and bigram counts sampled every `block_size` bytes
+ *
+ * The histogram of any byte range is two table lookups plus a scan of at most `block_size` bytes on either edge,
+ * instead of a scan of the whole range. The index does not keep the text: queries take it again and it must be the
+ * text the index was built from. A bigram sample takes 26 x 26 counters, so blocks much smaller than the default
+ * cost more memory than the text itself
+ *
+ */
+class histogram_index
+{
+  public:
+    using counts_type = std::array<std::uint64_t, 52>;             // A-Z (0-25), a-z (26-51)
+    using bigram_counts_type = std::array<std::uint64_t, 26 * 26>; // case folded, row is the first letter
+
+    static constexpr std::size_t default_block_size{16 * 1024};
+
+    histogram_index() noexcept = default;
+
+    explicit histogram_index(const std::string_view text, const std::size_t block_size = default_block_size) noexcept
+    {
+        build(text, block_size);
+    }
+
+    /**
+     * @brief Index the given text
+     *
+     * Blocks are counted independently in parallel, then a single pass turns them into prefix sums. A bigram belongs
+     * to the block of its second letter, so each block is counted together with the byte before it
+     *
+     */
+    void build(const std::string_view text, const std::size_t block_size = default_block_size) noexcept
+    {
+        block_size_ = std::max<std::size_t>(1, block_size);
+        size_ = text.size();
+
+        const std::size_t block_count{size_ / block_size_}; // only whole blocks are sampled
+        prefix_.assign(block_count + 1, counts_type{});
+        bigram_prefix_.assign(block_count + 1, bigram_counts_type{});
+        parallel_for(block_count, [&](const std::size_t block, std::size_t) {
+            const std::size_t start{block * block_size_}, before{start > 0 ? std::size_t{1} : 0};
+            prefix_[block + 1] = count(text.substr(start, block_size_));
+            bigram_prefix_[block + 1] = count_bigrams(text.substr(start - before, block_size_ + before));
+        });
+        for (std::size_t block{1}; block <= block_count; ++block)
+        {
+            for (std::size_t i{}; i < 52; ++i)
+            {
+                prefix_[block][i] += prefix_[block - 1][i];
+            }
+            for (std::size_t i{}; i < bigram_prefix_[block].size(); ++i)
+            {
+                bigram_prefix_[block][i] += bigram_prefix_[block - 1][i];
+            }
+        }
+    }
+
+    /**
+     * @brief Get the letter counts of `text[begin, end)`
+     *
+     * @param[in] text must be the text the index was built from
+     */
+    [[nodiscard]] counts_type counts(const std::string_view text, std::size_t begin, std::size_t end) const noexcept
+    {
+        end = std::min(end, text.size());
+        begin = std::min(begin, end);
+        if (text.size() != size_ || prefix_.empty())
+        {
+            return count(text.substr(begin, end - begin)); // stale index, stay correct
+        }
+
+        // Everything before `end`, minus everything before `begin`
+        auto result{prefix_before(text, end)};
+        const auto before{prefix_before(text, begin)};
+        for (std::size_t i{}; i < 52; ++i)
+        {
+            result[i] -= before[i];
+        }
+        return result;
+    }
+
+    /**
+     * @brief Get the case-folded counts of the letter pairs adjacent in `text[begin, end)`
+     *
+     * @param[in] text must be the text the index was built from
+     */
+    [[nodiscard]] bigram_counts_type bigrams(const std::string_view text, std::size_t begin,
+                                             std::size_t end) const noexcept
+    {
+        end = std::min(end, text.size());
+        begin = std::min(begin, end);
+        if (end - begin < 2)
+        {
+            return {};
+        }
+        if (text.size() != size_ || bigram_prefix_.empty())
+        {
+            return count_bigrams(text.substr(begin, end - begin)); // stale index, stay correct
+        }
+
+        // Pairs ending before `end`, minus those ending at or before `begin`
+        auto result{bigram_prefix_before(text, end)};
+        const auto before{bigram_prefix_before(text, begin + 1)};
+        for (std::size_t i{}; i < result.size(); ++i)
+        {
+            result[i] -= before[i];
+        }
+        return result;
+    }
+
+    /**
+     * @brief Get the frequency table of `text[begin, end)`, as `frequency_analyzer::analyze` would produce it
+     */
+    [[nodiscard]] std::vector<letter_frequency> analyze(const std::string_view text, const std::size_t begin,
+                                                        const std::size_t end,
+                                                        const bool case_sensitive = false) const noexcept
+    {
+        auto result{counts(text, begin, end)};
+        if (!case_sensitive)
+        {
+            for (std::size_t i{}; i < 26; ++i)
+            {
+                result[i] += std::exchange(result[26 + i], 0);
+            }
+        }
+        return frequency_analyzer::summarize(result, case_sensitive);
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+  private:
+    [[nodiscard]] static counts_type count(const std::string_view text) noexcept
+    {
+        // The slot past the letters swallows everything else, so the loop is branch-free
+        std::array<std::uint64_t, 53> tally{};
+        for (const char ch : text)
+        {
+            tally[letter_symbol(ch)]++;
+        }
+
+        counts_type result{};
+        std::copy_n(tally.begin(), 52, result.begin());
+        return result;
+    }
+
+    [[nodiscard]] static bigram_counts_type count_bigrams(const std::string_view text) noexcept
+    {
+        bigram_counts_type result{};
+        int previous{-1};
+        for (const char ch : text)
+        {
+            const int letter{letter_index(ch)};
+            if (letter >= 0 && previous >= 0)
+            {
+                result[static_cast<std::size_t>(previous * 26 + letter)]++;
+            }
+            previous = letter;
+        }
+        return result;
+    }
+
+    [[nodiscard]] counts_type prefix_before(const std::string_view text, const std::size_t position) const noexcept
+    {
+        const std::size_t block{std::min(position / block_size_, prefix_.size() - 1)};
+        auto result{prefix_[block]};
+        const auto tail{count(text.substr(block * block_size_, position - block * block_size_))};
+        for (std::size_t i{}; i < 52; ++i)
+        {
+            result[i] += tail[i];
+        }
+        return result;
+    }
+
+    // The pairs whose second letter is before `position`
+    [[nodiscard]] bigram_counts_type bigram_prefix_before(const std::string_view text,
+                                                          const std::size_t position) const noexcept
+    {
+        const std::size_t block{std::min(position / block_size_, bigram_prefix_.size() - 1)};
+        const std::size_t start{block * block_size_}, before{start > 0 ? std::size_t{1} : 0};
+        auto result{bigram_prefix_[block]};
+        const auto tail{count_bigrams(text.substr(start - before, position - start + before))};
+        for (std::size_t i{}; i < result.size(); ++i)
+        {
+            result[i] += tail[i];
+        }
+        return result;
+    }
+
+    std::size_t block_size_{default_block_size};
+    std::size_t size_{};
+    std::vector<counts_type> prefix_;               // prefix_[b] counts [0, b * block_size_)
+    std::vector<bigram_counts_type> bigram_prefix_; // bigram_prefix_[b] counts the pairs ending in [1, b * block_size_)
+};
+} // namespace tprotect::cipher
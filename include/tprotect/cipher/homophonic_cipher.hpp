@@ -0,0 +1,445 @@
+// homophonic_cipher.hpp: The Homophonic Substitution Cipher And Its Solver
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <tprotect/checkpoint.hpp>
+#include <tprotect/cipher/frequency_analyzer.hpp>
+#include <tprotect/cipher/ngram_model.hpp>
+#include <tprotect/global.hpp>
+#include <tprotect/parallel.hpp>
+#include <tprotect/random.hpp>
+
+namespace tprotect::cipher
+{
+/**
+ * @brief Substitution where each letter has several ciphertext symbols, so common letters do not stand out
+ *
+ * The symbols are the 52 letters "A-Za-z". The key is 52 uppercase letters: key[i] is the plaintext letter of
+ * symbol i, and a letter's share of the symbols should follow its frequency (see `generate_key()`). Plaintext case
+ * is not preserved and non-letters pass through unchanged.
+ *
+ * Which homophone encrypts a letter is drawn from a counter-based generator keyed by the seed and the position, so
+ * the output is deterministic and chunks can be encrypted independently
+ *
+ */
+class homophonic_cipher
+{
+  public:
+    static constexpr std::string_view symbols{"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"};
+
+    explicit homophonic_cipher(const std::string_view key, const std::uint64_t seed = 0) noexcept
+    {
+        set_key(key, seed);
+    }
+
+    // An invalid key (wrong length, a non-letter, or a letter without symbols) makes encryption fail
+    void set_key(const std::string_view key, const std::uint64_t seed = 0) noexcept
+    {
+        key_ = key;
+        seed_ = seed;
+        valid_ = false;
+        decryption_.fill(0);
+        if (key.size() != symbols.size())
+        {
+            return;
+        }
+
+        std::array<std::uint8_t, 26> counts{};
+        for (std::size_t i{}; i < symbols.size(); ++i)
+        {
+            const int letter{letter_index(key[i])};
+            if (letter < 0)
+            {
+                return;
+            }
+            counts[letter]++;
+            decryption_[static_cast<unsigned char>(symbols[i])] = static_cast<char>('A' + letter);
+        }
+
+        // Flat tables: the homophones of a letter are homophones_[offsets_[letter], offsets_[letter] + counts_[letter])
+        std::uint8_t offset{};
+        for (std::size_t letter{}; letter < 26; ++letter)
+        {
+            if (counts[letter] == 0)
+            {
+                return; // the letter could not be encrypted
+            }
+            offsets_[letter] = offset;
+            counts_[letter] = 0;
+            offset = static_cast<std::uint8_t>(offset + counts[letter]);
+        }
+        for (std::size_t i{}; i < symbols.size(); ++i)
+        {
+            const int letter{letter_index(key[i])};
+            homophones_[offsets_[letter] + counts_[letter]++] = symbols[i];
+        }
+        valid_ = true;
+    }
+
+    /**
+     * @brief Make a key whose homophone counts follow English letter frequencies
+     *
+     * Every letter gets at least one symbol; the rest are shared by largest remainder, then shuffled
+     *
+     */
+    [[nodiscard]] static std::string generate_key(const std::uint64_t seed) noexcept
+    {
+        constexpr auto english{frequency_analyzer::get_english_frequencies()};
+        const std::size_t spare{symbols.size() - 26};
+        std::array<std::size_t, 26> counts{};
+        std::array<double, 26> remainders{};
+        std::size_t assigned{};
+        for (std::size_t i{}; i < 26; ++i)
+        {
+            const double share{english[i] / 100. * static_cast<double>(spare)};
+            counts[i] = 1 + static_cast<std::size_t>(share);
+            remainders[i] = share - std::floor(share);
+            assigned += counts[i];
+        }
+        while (assigned < symbols.size())
+        {
+            const auto largest{std::ranges::max_element(remainders) - remainders.begin()};
+            counts[largest]++;
+            remainders[largest] = -1.;
+            assigned++;
+        }
+
+        std::string key;
+        for (std::size_t i{}; i < 26; ++i)
+        {
+            key.append(counts[i], static_cast<char>('A' + i));
+        }
+        splitmix64 random{seed};
+        for (std::size_t i{key.size() - 1}; i > 0; --i) // Fisher-Yates
+        {
+            std::swap(key[i], key[random.below(static_cast<std::uint32_t>(i + 1))]);
+        }
+        return key;
+    }
+
+    [[nodiscard]] cresult<std::string> encrypt(const std::string_view input) const noexcept
+    {
+        if (!valid_)
+        {
+            return std::unexpected{compact_error{errc::invalid_key, key_}};
+        }
+        return parallel_transform_positions(input, [this](const char ch, const std::size_t position) {
+            const int letter{letter_index(ch)};
+            if (letter < 0)
+            {
+                return ch;
+            }
+            // Multiply-shift picks among the letter's homophones without a division
+            const auto pick{((mix64(seed_, position) >> 32) * counts_[letter]) >> 32};
+            return homophones_[offsets_[letter] + pick];
+        });
+    }
+
+    [[nodiscard]] cresult<std::string> decrypt(const std::string_view input) const noexcept
+    {
+        if (!valid_)
+        {
+            return std::unexpected{compact_error{errc::invalid_key, key_}};
+        }
+        return parallel_transform(input, [this](const std::string_view chunk) -> cresult<std::string> {
+            std::string result(chunk.size(), '\0');
+            std::ranges::transform(chunk, result.begin(), [this](const char ch) {
+                const char plain{decryption_[static_cast<unsigned char>(ch)]};
+                return plain != 0 ? plain : ch;
+            });
+            return result;
+        });
+    }
+
+  private:
+    // Like `parallel_transform`, but the transform also gets each byte's position in the whole input
+    template <typename F>
+    [[nodiscard]] static cresult<std::string> parallel_transform_positions(const std::string_view input,
+                                                                           const F &transform) noexcept
+    {
+        constexpr std::size_t chunk_size{1 << 20};
+        const std::size_t size{input.size()};
+        return fill_string(size, [&](char *const data) {
+            parallel_for((size + chunk_size - 1) / chunk_size, [&](const std::size_t chunk, std::size_t) {
+                const std::size_t begin{chunk * chunk_size}, end{std::min(size, begin + chunk_size)};
+                for (std::size_t i{begin}; i < end; ++i) // branch-light, so it vectorizes where the target allows
+                {
+                    data[i] = transform(input[i], i);
+                }
+            });
+        });
+    }
+
+    std::string key_;
+    std::uint64_t seed_{};
+    bool valid_{};
+    std::array<std::uint8_t, 26> offsets_{};
+    std::array<std::uint8_t, 26> counts_{};
+    std::array<char, 52> homophones_{};
+    std::array<char, 256> decryption_{}; // symbol -> uppercase letter, 0 for non-symbols
+};
+
+struct homophonic_solution
+{
+    std::string key; // in `homophonic_cipher` key format
+    double score;    // `ngram_model` score of the decryption
+};
+
+/**
+ * @brief Recover a homophonic key from ciphertext alone, by simulated annealing on trigram scores
+ *
+ * Independent restarts run in parallel from different seeds and the best is kept. A move reassigns one symbol to
+ * another letter, and only the trigrams that touch that symbol's occurrences are rescored, so each move costs time
+ * proportional to the symbol's frequency rather than to the text length
+ *
+ * With a `checkpoint`, each restart publishes its whole state every few thousand moves, and all of them are saved
+ * when due. A resumed search continues every restart exactly where it was saved, so it finds the same key as an
+ * uninterrupted one
+ *
+ */
+class homophonic_solver
+{
+  public:
+    struct options
+    {
+        std::size_t restarts{16};
+        std::size_t iterations{200'000}; // moves per restart
+        double initial_temperature{2.5}; // per average symbol occurrence, so it suits any text length
+        std::uint64_t seed{1};
+    };
+
+    [[nodiscard]] static homophonic_solution solve(const std::string_view ciphertext, const ngram_model &model,
+                                                   const options &settings,
+                                                   checkpointer *const checkpoint = nullptr) noexcept
+    {
+        // Reduce the ciphertext to symbol indices, and list where each symbol occurs
+        std::vector<std::uint8_t> text;
+        std::array<std::vector<std::uint32_t>, 52> occurrences{};
+        for (const char ch : ciphertext)
+        {
+            if (const auto symbol{homophonic_cipher::symbols.find(ch)}; symbol != std::string_view::npos)
+            {
+                occurrences[symbol].push_back(static_cast<std::uint32_t>(text.size()));
+                text.push_back(static_cast<std::uint8_t>(symbol));
+            }
+        }
+
+        std::vector<restart_state> states(std::max<std::size_t>(1, settings.restarts));
+        for (std::size_t restart{}; restart < states.size(); ++restart)
+        {
+            states[restart] = initial_state(text, model, mix64(settings.seed, restart));
+        }
+        if (const auto saved{checkpoint ? checkpoint->load() : std::nullopt})
+        {
+            binary_reader reader{*saved};
+            auto resumed{states};
+            if (std::ranges::all_of(resumed, [&](restart_state &state) { return state.read(reader); }))
+            {
+                states = std::move(resumed);
+            }
+        }
+
+        // Restarts publish into `states`, which is only ever saved whole
+        std::mutex states_mutex;
+        const auto publish{[&](const std::size_t restart, const restart_state &state) {
+            std::lock_guard<std::mutex> guard{states_mutex};
+            states[restart] = state;
+            if (checkpoint->due())
+            {
+                binary_writer writer{};
+                for (const auto &saved : states)
+                {
+                    saved.write(writer);
+                }
+                [[maybe_unused]] const auto result{checkpoint->save(writer.bytes())}; // a failed save costs redoing
+            }
+        }};
+
+        std::vector<homophonic_solution> results(states.size());
+        parallel_for(results.size(), [&](const std::size_t restart, std::size_t) {
+            auto state{states[restart]}; // only this restart writes its slot, so it can be read unlocked
+            anneal(state, text, occurrences, model, settings, [&](const restart_state &progress) {
+                if (checkpoint)
+                {
+                    publish(restart, progress);
+                }
+            });
+            results[restart] = {std::string(52, 'A'), state.best_score};
+            for (std::size_t i{}; i < state.best.size(); ++i)
+            {
+                results[restart].key[i] = static_cast<char>('A' + state.best[i]);
+            }
+        });
+        if (checkpoint)
+        {
+            checkpoint->remove();
+        }
+        return *std::ranges::max_element(results, {}, &homophonic_solution::score);
+    }
+
+  private:
+    // Everything a restart needs to continue: a resumed one makes exactly the moves it would have made
+    struct restart_state
+    {
+        std::array<std::uint8_t, 52> key;
+        std::array<std::uint8_t, 52> best;
+        double score;
+        double best_score;
+        std::uint64_t seed;
+        std::uint64_t counter; // of the restart's `splitmix64`
+        std::uint64_t iteration;
+
+        void write(binary_writer &writer) const noexcept
+        {
+            writer.put(key).put(best).put(score).put(best_score).put(seed).put(counter).put(iteration);
+        }
+
+        [[nodiscard]] bool read(binary_reader &reader) noexcept
+        {
+            const auto saved_key{reader.get<decltype(key)>()};
+            const auto saved_best{reader.get<decltype(best)>()};
+            const auto saved_score{reader.get<double>()};
+            const auto saved_best_score{reader.get<double>()};
+            const auto saved_seed{reader.get<std::uint64_t>()};
+            const auto saved_counter{reader.get<std::uint64_t>()};
+            const auto saved_iteration{reader.get<std::uint64_t>()};
+            if (!saved_iteration || *saved_seed != seed ||
+                std::ranges::any_of(*saved_key, [](const std::uint8_t letter) { return letter >= 26; }) ||
+                std::ranges::any_of(*saved_best, [](const std::uint8_t letter) { return letter >= 26; }))
+            {
+                return false;
+            }
+            *this = {*saved_key, *saved_best, *saved_score, *saved_best_score, seed, *saved_counter, *saved_iteration};
+            return true;
+        }
+    };
+
+    [[nodiscard]] static restart_state initial_state(const std::vector<std::uint8_t> &text, const ngram_model &model,
+                                                     const std::uint64_t seed) noexcept
+    {
+        const std::string initial{homophonic_cipher::generate_key(seed)};
+        restart_state state{};
+        for (std::size_t i{}; i < state.key.size(); ++i)
+        {
+            state.key[i] = static_cast<std::uint8_t>(initial[i] - 'A');
+        }
+        std::vector<std::uint8_t> plain(text.size());
+        for (std::size_t i{}; i < text.size(); ++i)
+        {
+            plain[i] = state.key[text[i]];
+        }
+        state.best = state.key;
+        state.score = state.best_score = model.score(plain);
+        state.seed = seed;
+        return state;
+    }
+
+    template <typename Publish>
+    static void anneal(restart_state &state, const std::vector<std::uint8_t> &text,
+                       const std::array<std::vector<std::uint32_t>, 52> &occurrences, const ngram_model &model,
+                       const options &settings, Publish &&publish) noexcept
+    {
+        constexpr std::uint64_t publish_interval{4096}; // moves; a copy of the state costs about as much as one
+        splitmix64 random{state.seed, state.counter};
+        auto &key{state.key};
+        auto &best{state.best};
+        auto &score{state.score};
+        auto &best_score{state.best_score};
+        std::array<std::uint8_t, 26> symbol_counts{}; // kept above zero so the result is a valid key
+        for (const auto letter : key)
+        {
+            symbol_counts[letter]++;
+        }
+
+        std::vector<std::uint8_t> plain(text.size());
+        for (std::size_t i{}; i < text.size(); ++i)
+        {
+            plain[i] = key[text[i]];
+        }
+
+        // A move's score change grows with how often the symbol occurs, so the temperature must too
+        const double initial_temperature{settings.initial_temperature * static_cast<double>(text.size()) / 52.};
+
+        // Rescore only the trigrams starting within two places of an occurrence, each once
+        std::vector<std::uint32_t> stamp(text.size(), 0);
+        std::uint32_t generation{};
+        const auto local_score{[&](const std::size_t symbol) {
+            generation++;
+            double total{};
+            for (const auto position : occurrences[symbol])
+            {
+                for (std::size_t start{position >= 2 ? position - 2 : 0}; start <= position; ++start)
+                {
+                    if (start + 2 < plain.size() && stamp[start] != generation)
+                    {
+                        stamp[start] = generation;
+                        total += model.score(plain[start], plain[start + 1], plain[start + 2]);
+                    }
+                }
+            }
+            return total;
+        }};
+
+        for (std::uint64_t iteration{state.iteration}; iteration < settings.iterations; ++iteration)
+        {
+            if (iteration % publish_interval == 0 && iteration != state.iteration)
+            {
+                state.iteration = iteration;
+                state.counter = random.counter();
+                publish(std::as_const(state));
+            }
+            const std::size_t symbol{random.below(52)};
+            const auto previous{key[symbol]};
+            if (symbol_counts[previous] == 1)
+            {
+                continue;
+            }
+            const auto candidate{static_cast<std::uint8_t>((previous + 1 + random.below(25)) % 26)};
+
+            const double before{local_score(symbol)};
+            for (const auto position : occurrences[symbol])
+            {
+                plain[position] = candidate;
+            }
+            const double delta{local_score(symbol) - before};
+
+            const double temperature{
+                initial_temperature * (1. - static_cast<double>(iteration) / static_cast<double>(settings.iterations))};
+            if (delta >= 0. || (temperature > 0. && random.unit() < std::exp(delta / temperature)))
+            {
+                key[symbol] = candidate;
+                symbol_counts[previous]--;
+                symbol_counts[candidate]++;
+                score += delta;
+                if (score > best_score)
+                {
+                    best_score = score;
+                    best = key;
+                }
+            }
+            else
+            {
+                for (const auto position : occurrences[symbol])
+                {
+                    plain[position] = previous;
+                }
+            }
+        }
+
+        state.iteration = std::max<std::uint64_t>(state.iteration, settings.iterations);
+        state.counter = random.counter();
+        publish(std::as_const(state));
+    }
+};
+} // namespace tprotect::cipher
@@ -0,0 +1,88 @@
+// letters.hpp: Letter Classification And Letter Streams
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <tprotect/parallel.hpp>
+
+namespace tprotect::cipher
+{
+// The case-folded letter of a byte in [0, 26), or 26 or more for anything else; arithmetic rather than a lookup, so
+// loops over it vectorize
+[[nodiscard]] constexpr std::uint8_t fold_letter(const char byte) noexcept
+{
+    return static_cast<std::uint8_t>((static_cast<std::uint8_t>(byte) | 0x20) - 'a');
+}
+
+// The case-folded letter of a byte in [0, 26), or -1 for anything else
+[[nodiscard]] constexpr int letter_index(const char byte) noexcept
+{
+    const auto letter{fold_letter(byte)};
+    return letter < 26 ? letter : -1;
+}
+
+// The symbol of every byte: 'A' to 'Z' are 0 to 25, 'a' to 'z' are 26 to 51, and anything else is `no_letter`, so
+// counting loops can index a 53-slot tally without branching
+inline constexpr std::uint8_t no_letter{52};
+inline constexpr auto letter_symbols{[] {
+    std::array<std::uint8_t, 256> symbols{};
+    for (std::size_t i{}; i < symbols.size(); ++i)
+    {
+        const auto letter{fold_letter(static_cast<char>(i))};
+        symbols[i] = letter >= 26 ? no_letter : static_cast<std::uint8_t>((i & 0x20) != 0 ? 26 + letter : letter);
+    }
+    return symbols;
+}()};
+
+[[nodiscard]] constexpr std::uint8_t letter_symbol(const char byte) noexcept
+{
+    return letter_symbols[static_cast<std::uint8_t>(byte)];
+}
+
+// The letters of `input` as indices in [0, 26), case folded and everything else dropped
+[[nodiscard]] inline std::vector<std::uint8_t> extract_letters(const std::string_view input) noexcept
+{
+    std::vector<std::uint8_t> letters;
+    letters.reserve(input.size());
+    for (const char ch : input)
+    {
+        if (const int letter{letter_index(ch)}; letter >= 0)
+        {
+            letters.push_back(static_cast<std::uint8_t>(letter));
+        }
+    }
+    return letters;
+}
+
+/**
+ * @brief Run `transform(in, out, count)` over `blocks` blocks of `block_size` letters in parallel, then spell the
+ * result as uppercase letters
+ *
+ * Chunks hold whole blocks, so block ciphers get the same chunked parallelism as `parallel_transform`
+ *
+ */
+template <typename F>
+[[nodiscard]] std::string transform_blocks(const std::vector<std::uint8_t> &letters, const std::size_t block_size,
+                                           const F &transform, const std::size_t chunk_blocks = 1 << 16) noexcept
+{
+    const std::size_t blocks{letters.size() / block_size}, size{blocks * block_size};
+    return fill_string(size, [&](char *const data) {
+        parallel_for((blocks + chunk_blocks - 1) / chunk_blocks, [&](const std::size_t chunk, std::size_t) {
+            const std::size_t first{chunk * chunk_blocks}, count{std::min(chunk_blocks, blocks - first)};
+            auto *const out{reinterpret_cast<std::uint8_t *>(data) + first * block_size};
+            transform(letters.data() + first * block_size, out, count);
+            for (std::size_t i{}; i < count * block_size; ++i)
+            {
+                out[i] = static_cast<std::uint8_t>(out[i] + 'A');
+            }
+        });
+    });
+}
+} // namespace tprotect::cipher
@@ -0,0 +1,92 @@
+// ngram_model.hpp: Letter Trigram Language Model
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include <tprotect/cipher/letters.hpp>
+
+namespace tprotect::cipher
+{
+/**
+ * @brief Log-probabilities of letter trigrams, learnt from a reference text in the target language
+ *
+ * Case and non-letters are ignored, so "The cat" contributes THE, HEC, ECA and CAT. Unseen trigrams get a floor well
+ * below any seen one. Scores are in natural-log units per trigram, higher meaning more plausible
+ *
+ */
+class ngram_model
+{
+  public:
+    static constexpr std::size_t order{3};
+    static constexpr std::size_t size{26 * 26 * 26};
+
+    [[nodiscard]] static ngram_model from_text(const std::string_view reference) noexcept
+    {
+        ngram_model model{};
+        std::vector<std::uint64_t> counts(size);
+        std::uint64_t total{};
+        int a{-1}, b{-1};
+        for (const char ch : reference)
+        {
+            const int letter{letter_index(ch)};
+            if (letter < 0)
+            {
+                continue;
+            }
+            if (a >= 0)
+            {
+                counts[index(a, b, letter)]++;
+                total++;
+            }
+            a = b;
+            b = letter;
+        }
+
+        const double denominator{static_cast<double>(total) + 1.};
+        const float floor{static_cast<float>(std::log(0.01 / denominator))};
+        for (std::size_t i{}; i < size; ++i)
+        {
+            model.log_probabilities_[i] =
+                counts[i] == 0 ? floor : static_cast<float>(std::log(static_cast<double>(counts[i]) / denominator));
+        }
+        model.trained_ = total > 0;
+        return model;
+    }
+
+    // Whether the reference held at least one trigram
+    [[nodiscard]] bool trained() const noexcept
+    {
+        return trained_;
+    }
+
+    [[nodiscard]] static constexpr std::size_t index(const int a, const int b, const int c) noexcept
+    {
+        return static_cast<std::size_t>((a * 26 + b) * 26 + c);
+    }
+
+    [[nodiscard]] float score(const int a, const int b, const int c) const noexcept
+    {
+        return log_probabilities_[index(a, b, c)];
+    }
+
+    // Sum over every trigram of a sequence of letter indices
+    [[nodiscard]] double score(const std::vector<std::uint8_t> &letters) const noexcept
+    {
+        double total{};
+        for (std::size_t i{}; i + order <= letters.size(); ++i)
+        {
+            total += score(letters[i], letters[i + 1], letters[i + 2]);
+        }
+        return total;
+    }
+
+  private:
+    std::vector<float> log_probabilities_ = std::vector<float>(size);
+    bool trained_{};
+};
+} // namespace tprotect::cipher
@@ -0,0 +1,148 @@
+// playfair_cipher.hpp: The Playfair Cipher Implementation
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <tprotect/cipher/letters.hpp>
+#include <tprotect/global.hpp>
+
+namespace tprotect::cipher
+{
+/**
+ * @brief Digraph substitution on a 5x5 square built from a keyword, with I and J sharing a cell
+ *
+ * Only letters are enciphered and the output is uppercase letters without spacing. A doubled letter within a pair is
+ * split by an X (or a Q for XX), and an odd letter out is padded the same way; decryption leaves the padding in, as is
+ * usual for Playfair. Every pair's image is precomputed into 26x26 tables, so the bulk work is one lookup per pair
+ *
+ */
+class playfair_cipher
+{
+  public:
+    explicit playfair_cipher(const std::string_view keyword) noexcept
+    {
+        set_key(keyword);
+    }
+
+    [[nodiscard]] cresult<std::string> encrypt(const std::string_view input) const noexcept
+    {
+        // Splitting doubled letters shifts every later pair, so this pass is serial; the lookups are not
+        std::vector<std::uint8_t> letters;
+        letters.reserve(input.size() + input.size() / 8);
+        for (const std::uint8_t letter : extract_letters(input))
+        {
+            const std::uint8_t merged{letter == j ? i : letter};
+            if (letters.size() % 2 == 1 && letters.back() == merged)
+            {
+                letters.push_back(filler(merged));
+            }
+            letters.push_back(merged);
+        }
+        if (letters.size() % 2 == 1)
+        {
+            letters.push_back(filler(letters.back()));
+        }
+        return transform_blocks(letters, 2, [this](const std::uint8_t *in, std::uint8_t *out, std::size_t count) {
+            lookup(encryption_, in, out, count);
+        });
+    }
+
+    [[nodiscard]] cresult<std::string> decrypt(const std::string_view input) const noexcept
+    {
+        auto letters{extract_letters(input)};
+        if (letters.size() % 2 == 1)
+        {
+            return std::unexpected{compact_error{errc::corrupt_data}}; // Playfair ciphertext is always whole pairs
+        }
+        for (auto &letter : letters)
+        {
+            letter = letter == j ? i : letter;
+        }
+        return transform_blocks(letters, 2, [this](const std::uint8_t *in, std::uint8_t *out, std::size_t count) {
+            lookup(decryption_, in, out, count);
+        });
+    }
+
+    void set_key(const std::string_view keyword) noexcept
+    {
+        // The square: the keyword's distinct letters, then the rest of the alphabet, J folded into I
+        std::array<std::uint8_t, 25> square{};
+        std::array<int, 26> cell{};
+        cell.fill(-1);
+        std::size_t filled{};
+        const auto place{[&](std::uint8_t letter) {
+            letter = letter == j ? i : letter;
+            if (cell[letter] < 0)
+            {
+                cell[letter] = static_cast<int>(filled);
+                square[filled++] = letter;
+            }
+        }};
+        for (const std::uint8_t letter : extract_letters(keyword))
+        {
+            place(letter);
+        }
+        for (std::uint8_t letter{}; letter < 26; ++letter)
+        {
+            place(letter);
+        }
+        cell[j] = cell[i];
+
+        for (std::uint8_t a{}; a < 26; ++a)
+        {
+            for (std::uint8_t b{}; b < 26; ++b)
+            {
+                const int row_a{cell[a] / 5}, column_a{cell[a] % 5}, row_b{cell[b] / 5}, column_b{cell[b] % 5};
+                const auto at{[&](const int row, const int column) { return square[row * 5 + column]; }};
+                pair encrypted{}, decrypted{};
+                if (row_a == row_b)
+                {
+                    encrypted = {at(row_a, (column_a + 1) % 5), at(row_b, (column_b + 1) % 5)};
+                    decrypted = {at(row_a, (column_a + 4) % 5), at(row_b, (column_b + 4) % 5)};
+                }
+                else if (column_a == column_b)
+                {
+                    encrypted = {at((row_a + 1) % 5, column_a), at((row_b + 1) % 5, column_b)};
+                    decrypted = {at((row_a + 4) % 5, column_a), at((row_b + 4) % 5, column_b)};
+                }
+                else
+                {
+                    encrypted = decrypted = {at(row_a, column_b), at(row_b, column_a)};
+                }
+                encryption_[a * 26 + b] = encrypted;
+                decryption_[a * 26 + b] = decrypted;
+            }
+        }
+    }
+
+  private:
+    using pair = std::array<std::uint8_t, 2>;
+
+    static constexpr std::uint8_t i{'I' - 'A'}, j{'J' - 'A'}, x{'X' - 'A'}, q{'Q' - 'A'};
+
+    static constexpr std::uint8_t filler(const std::uint8_t letter) noexcept
+    {
+        return letter == x ? q : x;
+    }
+
+    static void lookup(const std::array<pair, 26 * 26> &table, const std::uint8_t *in, std::uint8_t *out,
+                       const std::size_t count) noexcept
+    {
+        for (std::size_t k{}; k < count; ++k, in += 2, out += 2)
+        {
+            const pair &image{table[in[0] * 26 + in[1]]};
+            out[0] = image[0];
+            out[1] = image[1];
+        }
+    }
+
+    std::array<pair, 26 * 26> encryption_{};
+    std::array<pair, 26 * 26> decryption_{};
+};
+} // namespace tprotect::cipher
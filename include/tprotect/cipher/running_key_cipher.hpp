@@ -0,0 +1,235 @@
+// running_key_cipher.hpp: The Running-Key Cipher Over A Memory-Mapped Key Text
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <tprotect/cipher/letters.hpp>
+#include <tprotect/global.hpp>
+#include <tprotect/mapped_file.hpp>
+#include <tprotect/parallel.hpp>
+
+namespace tprotect::cipher
+{
+namespace running_key_detail
+{
+[[nodiscard]] inline std::uint64_t count_letters(const std::string_view text) noexcept
+{
+    std::uint64_t count{};
+    for (const char byte : text)
+    {
+        count += fold_letter(byte) < 26;
+    }
+    return count;
+}
+
+/**
+ * @brief Write the letter indices of `text` to `out`, stopping after `limit` letters
+ *
+ * Branch-free: every byte is stored and the cursor only advances past letters, so `out` needs one spare element.
+ * Each byte holds at most one letter, so runs as long as the letters still missing are taken without checking the
+ * limit per byte
+ *
+ * @return the number of letters written, and how many bytes of `text` were consumed
+ */
+inline std::pair<std::size_t, std::size_t> compact_letters(const std::string_view text, std::uint8_t *const out,
+                                                           const std::size_t limit) noexcept
+{
+    std::size_t count{}, i{};
+    while (count < limit && i < text.size())
+    {
+        const std::size_t end{i + std::min(limit - count, text.size() - i)};
+        for (; i < end; ++i)
+        {
+            const auto letter{fold_letter(text[i])};
+            out[count] = letter;
+            count += letter < 26;
+        }
+    }
+    return {count, i};
+}
+
+// The inverse of compacting: spread consecutive key letters over the letters of `text`, one per byte
+inline void expand_letters(const std::string_view text, const std::uint8_t *const key, std::uint8_t *const out) noexcept
+{
+    std::size_t next{};
+    for (std::size_t i{}; i < text.size(); ++i)
+    {
+        out[i] = key[next];
+        next += fold_letter(text[i]) < 26;
+    }
+}
+
+// The kernel, written for the vectorizer: letters become (letter +/- key) mod 26 in their own case, the rest stay
+template <bool Decrypt>
+void add_streams(const std::string_view text, const std::uint8_t *const key, char *const out) noexcept
+{
+    for (std::size_t i{}; i < text.size(); ++i)
+    {
+        const auto byte{static_cast<std::uint8_t>(text[i])};
+        const auto letter{fold_letter(text[i])};
+        auto sum{static_cast<std::uint8_t>(Decrypt ? letter + 26 - key[i] : letter + key[i])};
+        sum = static_cast<std::uint8_t>(sum >= 26 ? sum - 26 : sum);
+        // Lowercase differs from uppercase only in the 0x20 bit
+        const auto image{static_cast<std::uint8_t>(('A' + sum) | (byte & 0x20))};
+        out[i] = static_cast<char>(letter < 26 ? image : byte);
+    }
+}
+} // namespace running_key_detail
+
+/**
+ * @brief The letters of a key text, such as a book, addressable by letter position
+ *
+ * The text is memory-mapped and never filtered as a whole. Instead, the number of letters before each block of it is
+ * counted once, in parallel, so reading can start at any letter position after skipping less than a block
+ *
+ */
+class running_key
+{
+  public:
+    static constexpr std::size_t block_size{64 * 1024};
+
+    [[nodiscard]] static cresult<std::shared_ptr<const running_key>> open(const std::string &file_name) noexcept
+    {
+        return mapped_file::open(file_name).transform([](mapped_file file) {
+            auto key{std::make_shared<running_key>()};
+            key->file_ = std::move(file);
+            key->text_ = key->file_.view();
+            key->index();
+            return std::shared_ptr<const running_key>{std::move(key)};
+        });
+    }
+
+    [[nodiscard]] static std::shared_ptr<const running_key> from_text(std::string text) noexcept
+    {
+        auto key{std::make_shared<running_key>()};
+        key->owned_ = std::move(text);
+        key->text_ = key->owned_;
+        key->index();
+        return key;
+    }
+
+    [[nodiscard]] std::uint64_t letters() const noexcept
+    {
+        return letters_before_.back();
+    }
+
+    /**
+     * @brief The key text from its letter number `first` on, found by skipping less than a block
+     *
+     * Read it with `compact_letters()`, which reports how far it got, to extract consecutive runs of key letters
+     *
+     */
+    [[nodiscard]] std::string_view from(const std::uint64_t first) const noexcept
+    {
+        const auto block{static_cast<std::size_t>(std::ranges::upper_bound(letters_before_, first) -
+                                                  letters_before_.begin() - 1)};
+        auto rest{text_.substr(std::min(text_.size(), block * block_size))};
+        for (auto skip{first - letters_before_[block]}; skip > 0 && !rest.empty(); rest.remove_prefix(1))
+        {
+            skip -= fold_letter(rest.front()) < 26;
+        }
+        return rest;
+    }
+
+  private:
+    void index() noexcept
+    {
+        const std::size_t blocks{(text_.size() + block_size - 1) / block_size};
+        letters_before_.assign(blocks + 1, 0);
+        parallel_for(blocks, [&](const std::size_t b, std::size_t) {
+            letters_before_[b + 1] = running_key_detail::count_letters(text_.substr(b * block_size, block_size));
+        });
+        for (std::size_t b{1}; b < letters_before_.size(); ++b)
+        {
+            letters_before_[b] += letters_before_[b - 1];
+        }
+    }
+
+    mapped_file file_;
+    std::string owned_;
+    std::string_view text_;
+    std::vector<std::uint64_t> letters_before_; // per block, plus the total at the end
+};
+
+/**
+ * @brief A shift cipher whose shift changes with every letter, taken from a running key rather than one number
+ *
+ * The i-th letter of the text is shifted by the (offset + i)-th letter of the key, A = 0; non-letters pass through
+ * and case is kept. The key must have at least as many letters as the text.
+ *
+ * Chunks are processed in parallel: letters are counted per chunk first, so each chunk knows where in the key it
+ * starts. Within a chunk, tiles small enough to stay in cache go through branch-free loops: the tile's letters are
+ * counted, as many key letters extracted and spread over the tile's letter positions, and the two streams added mod
+ * 26 by a loop the compiler vectorizes. The key is only ever held a tile at a time
+ *
+ */
+class running_key_cipher
+{
+  public:
+    explicit running_key_cipher(std::shared_ptr<const running_key> key, const std::uint64_t offset = 0) noexcept
+        : key_{std::move(key)}, offset_{offset}
+    {
+    }
+
+    [[nodiscard]] cresult<std::string> encrypt(const std::string_view input) const noexcept
+    {
+        return transform<false>(input);
+    }
+
+    [[nodiscard]] cresult<std::string> decrypt(const std::string_view input) const noexcept
+    {
+        return transform<true>(input);
+    }
+
+  private:
+    static constexpr std::size_t chunk_size{1 << 20};
+    static constexpr std::size_t tile_size{16 * 1024};
+
+    template <bool Decrypt>
+    [[nodiscard]] cresult<std::string> transform(const std::string_view input) const noexcept
+    {
+        // Where in the key every chunk starts
+        const std::size_t size{input.size()}, chunks{(size + chunk_size - 1) / chunk_size};
+        std::vector<std::uint64_t> first_letter(chunks + 1, offset_);
+        parallel_for(chunks, [&](const std::size_t c, std::size_t) {
+            first_letter[c + 1] = running_key_detail::count_letters(input.substr(c * chunk_size, chunk_size));
+        });
+        for (std::size_t c{1}; c < first_letter.size(); ++c)
+        {
+            first_letter[c] += first_letter[c - 1];
+        }
+        if (!key_ || first_letter.back() > key_->letters())
+        {
+            return std::unexpected{compact_error{errc::invalid_key, "the running key is shorter than the text"}};
+        }
+
+        return fill_string(size, [&](char *const data) {
+            parallel_for(chunks, [&](const std::size_t c, std::size_t) {
+                std::array<std::uint8_t, tile_size + 1> key{}, spread{};
+                auto key_text{key_->from(first_letter[c])};
+                const std::size_t chunk_end{std::min(size, (c + 1) * chunk_size)};
+                for (std::size_t begin{c * chunk_size}; begin < chunk_end; begin += tile_size)
+                {
+                    const auto tile{input.substr(begin, std::min(tile_size, chunk_end - begin))};
+                    const auto letters{static_cast<std::size_t>(running_key_detail::count_letters(tile))};
+                    key_text.remove_prefix(running_key_detail::compact_letters(key_text, key.data(), letters).second);
+                    running_key_detail::expand_letters(tile, key.data(), spread.data());
+                    running_key_detail::add_streams<Decrypt>(tile, spread.data(), data + begin);
+                }
+            });
+        });
+    }
+
+    std::shared_ptr<const running_key> key_;
+    std::uint64_t offset_;
+};
+} // namespace tprotect::cipher
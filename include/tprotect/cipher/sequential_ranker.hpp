@@ -0,0 +1,160 @@
+// sequential_ranker.hpp: Early-Terminating Ranking Of Candidate Decryptions
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <tprotect/cipher/byte_map.hpp>
+#include <tprotect/cipher/letters.hpp>
+#include <tprotect/cipher/ngram_model.hpp>
+#include <tprotect/parallel.hpp>
+
+namespace tprotect::cipher
+{
+struct ranked_candidate
+{
+    std::size_t index;    // position in the candidates ranked
+    double score;         // mean `ngram_model` score per trigram of the prefix it was scored on
+    std::size_t trigrams; // how many trigrams that prefix held, fewer for a candidate dropped early
+    bool rejected;        // dropped because it could no longer beat the leader
+};
+
+struct candidate_ranking
+{
+    std::vector<ranked_candidate> candidates; // the survivors best first, then the rejected best first
+    std::size_t scored;                       // bytes of the ciphertext read before the ranking settled
+};
+
+/**
+ * @brief Rank decryption tables by how plausible they make a ciphertext, reading only as much of it as it takes
+ *
+ * Candidates are scored on a growing prefix, which doubles every round, and each keeps the mean and variance of its
+ * per-trigram scores so far. After a round, in the manner of a sequential probability ratio test, every candidate
+ * whose upper confidence bound falls below the best lower bound is dropped: the rest of the text cannot plausibly
+ * lift it past the leader. Ranking stops once few enough candidates remain, or at the end of the text.
+ *
+ * The wrong shifts of a shift cipher, or wrong keys of any other, read as noise and fall a whole nat or more per
+ * trigram behind the right one, so they go after the first round or two, whatever the length of the text. Trigram
+ * scores overlap and so are not independent, which the default of four standard errors allows for
+ *
+ */
+class sequential_ranker
+{
+  public:
+    struct options
+    {
+        double confidence{4.};         // standard errors each side of a mean
+        std::size_t first_prefix{256}; // bytes scored in the first round
+        std::size_t keep{1};           // stop once no more than this many candidates remain
+    };
+
+    [[nodiscard]] static candidate_ranking rank(const std::string_view ciphertext,
+                                                const std::span<const byte_map> candidates, const ngram_model &model,
+                                                const options &settings) noexcept
+    {
+        // Too few trigrams give a variance that may be near zero by chance, so such bounds are not trusted yet
+        constexpr std::size_t minimum_trigrams{32};
+
+        std::vector<state> states(candidates.size());
+        std::vector<std::size_t> alive(candidates.size());
+        for (std::size_t i{}; i < alive.size(); ++i)
+        {
+            alive[i] = i;
+        }
+
+        std::size_t scored{};
+        for (std::size_t prefix{std::min(ciphertext.size(), std::max<std::size_t>(settings.first_prefix, 1))};;
+             prefix = std::min(ciphertext.size(), prefix * 2))
+        {
+            // Each candidate carries its last two letters over, so no trigram is lost at the edge of a round
+            const auto window{ciphertext.substr(scored, prefix - scored)};
+            parallel_for(alive.size(), [&](const std::size_t i, std::size_t) {
+                auto &candidate{states[alive[i]]};
+                const auto &table{candidates[alive[i]]};
+                for (const char ch : window)
+                {
+                    const int letter{letter_index(table[ch])};
+                    if (letter < 0)
+                    {
+                        continue;
+                    }
+                    if (candidate.a >= 0)
+                    {
+                        const double value{model.score(candidate.a, candidate.b, letter)};
+                        candidate.sum += value;
+                        candidate.squares += value * value;
+                        candidate.count++;
+                    }
+                    candidate.a = candidate.b;
+                    candidate.b = letter;
+                }
+            });
+            scored = prefix;
+
+            double best_lower{-HUGE_VAL};
+            for (const auto index : alive)
+            {
+                best_lower = std::max(best_lower, states[index].lower(settings.confidence, minimum_trigrams));
+            }
+            std::erase_if(alive, [&](const std::size_t index) {
+                auto &candidate{states[index]};
+                candidate.rejected = candidate.upper(settings.confidence, minimum_trigrams) < best_lower;
+                return candidate.rejected;
+            });
+
+            if (alive.size() <= settings.keep || scored == ciphertext.size())
+            {
+                break;
+            }
+        }
+
+        candidate_ranking ranking{{}, scored};
+        ranking.candidates.reserve(states.size());
+        for (std::size_t i{}; i < states.size(); ++i)
+        {
+            ranking.candidates.push_back({i, states[i].mean(), states[i].count, states[i].rejected});
+        }
+        std::ranges::sort(ranking.candidates, [](const ranked_candidate &x, const ranked_candidate &y) {
+            return x.rejected != y.rejected ? y.rejected : x.score > y.score;
+        });
+        return ranking;
+    }
+
+  private:
+    struct state
+    {
+        double sum{};
+        double squares{};
+        std::size_t count{};
+        int a{-1}, b{-1}; // the last two letters of the prefix
+        bool rejected{};
+
+        [[nodiscard]] double mean() const noexcept
+        {
+            return count > 0 ? sum / static_cast<double>(count) : 0.;
+        }
+
+        [[nodiscard]] double margin(const double confidence) const noexcept
+        {
+            const auto n{static_cast<double>(count)};
+            const double variance{std::max(0., (squares - sum * sum / n) / (n - 1.))};
+            return confidence * std::sqrt(variance / n);
+        }
+
+        [[nodiscard]] double lower(const double confidence, const std::size_t minimum) const noexcept
+        {
+            return count < minimum ? -HUGE_VAL : mean() - margin(confidence);
+        }
+
+        [[nodiscard]] double upper(const double confidence, const std::size_t minimum) const noexcept
+        {
+            return count < minimum ? HUGE_VAL : mean() + margin(confidence);
+        }
+    };
+};
+} // namespace tprotect::cipher
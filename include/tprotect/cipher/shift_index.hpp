@@ -0,0 +1,727 @@
+// shift_index.hpp: Persistent Shift-Invariant N-Gram Index Over Ciphertext Archives
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <queue>
+#include <span>
+#include <system_error>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <tprotect/cipher/letters.hpp>
+#include <tprotect/global.hpp>
+#include <tprotect/mapped_file.hpp>
+#include <tprotect/parallel.hpp>
+
+namespace tprotect::cipher
+{
+/**
+ * @brief A match of a search term under some shift
+ *
+ */
+struct shift_hit
+{
+    std::string file_name;
+    std::size_t offset; // byte offset of the first letter of the match
+    int shift;          // the `transposition_cipher` key the file appears to be under
+};
+
+/**
+ * @brief An on-disk index answering "where does this word occur under any shift"
+ *
+ * Shifting every letter by the same key leaves the differences between neighbouring letters unchanged, so the index
+ * is keyed on grams of three consecutive letter differences (four letters, 26^3 keys) and one index serves all 26
+ * keys. Non-letters are skipped, so a term also matches across spaces and punctuation.
+ *
+ * Postings are lists of fixed-size blocks rather than positions, delta- and varint-encoded, and the whole index is
+ * memory-mapped when queried. A query intersects the postings of every gram in the term, then verifies only the
+ * surviving blocks against the original files.
+ *
+ * Layout (native byte order): header, file table, `key_count + 1` posting offsets, posting bytes
+ *
+ */
+class shift_index
+{
+  public:
+    static constexpr std::size_t default_block_size{16 * 1024};
+    static constexpr std::size_t key_count{26 * 26 * 26};
+    static constexpr std::size_t default_run_entries{1 << 20}; // 8 MiB of postings per worker
+    static constexpr std::size_t max_open_runs{64};
+
+    /**
+     * @brief Index the given files into `index_name`
+     *
+     * Files are scanned in parallel. Each worker buffers at most `run_entries` postings, then sorts them and writes
+     * them out as a run beside the index; the runs are merged key by key, `max_open_runs` at a time, into a
+     * temporary file that replaces `index_name` once complete. Memory stays bounded however large the archive
+     *
+     */
+    [[nodiscard]] static eresult<void> build(const std::string &index_name, const std::vector<std::string> &file_names,
+                                             const std::size_t block_size = default_block_size,
+                                             const std::size_t run_entries = default_run_entries) noexcept
+    {
+        // Global block ids are assigned in file order, so they are known before any file is scanned
+        std::vector<std::uint64_t> sizes(file_names.size()), first_blocks(file_names.size());
+        std::uint64_t total_blocks{};
+        for (std::size_t i{}; i < file_names.size(); ++i)
+        {
+            std::error_code ignored;
+            sizes[i] = std::filesystem::file_size(file_names[i], ignored); // a missing file fails when mapped
+            sizes[i] = ignored ? 0 : sizes[i];
+            first_blocks[i] = total_blocks;
+            total_blocks += (sizes[i] + block_size - 1) / block_size;
+        }
+        if (total_blocks > block_mask)
+        {
+            return std::unexpected{"Too many blocks to index; use a larger block size"};
+        }
+
+        run_files runs{index_name};
+        std::mutex error_mutex;
+        std::string error{};
+        const auto fail{[&](std::string message) {
+            std::lock_guard<std::mutex> guard{error_mutex};
+            if (error.empty())
+            {
+                error = std::move(message);
+            }
+        }};
+        const auto spill{[&](std::vector<std::uint64_t> &entries) {
+            if (auto written{runs.write(entries)}; !written)
+            {
+                fail(std::move(written.error()));
+            }
+            entries.clear();
+        }};
+
+        std::vector<std::vector<std::uint64_t>> pending(worker_count()); // one buffer per worker slot
+        parallel_for(file_names.size(), [&](const std::size_t i, const std::size_t slot) {
+            const auto file{mapped_file::open(file_names[i])};
+            if (!file)
+            {
+                fail(file.error().message());
+                return;
+            }
+            const auto text{file->view()};
+            if (text.size() != sizes[i])
+            {
+                fail(std::format("{} changed while it was being indexed", file_names[i]));
+                return;
+            }
+
+            auto &entries{pending[slot]};
+            std::vector<bool> seen(key_count);
+            std::vector<std::uint32_t> block_keys;
+            std::size_t block{};
+            std::array<int, 4> window{};
+            int filled{};
+            for (std::size_t position{}; position < text.size(); ++position)
+            {
+                const int letter{letter_index(text[position])};
+                if (letter < 0)
+                {
+                    continue;
+                }
+                window = {window[1], window[2], window[3], letter};
+                if (++filled < 4)
+                {
+                    continue;
+                }
+
+                if (const std::size_t current{position / block_size}; current != block)
+                {
+                    flush(entries, block_keys, seen, first_blocks[i] + block);
+                    block = current;
+                    if (entries.size() >= run_entries)
+                    {
+                        spill(entries);
+                    }
+                }
+                // The gram is attributed to the block holding its last letter
+                if (const auto key{gram_key(window)}; !seen[key])
+                {
+                    seen[key] = true;
+                    block_keys.push_back(key);
+                }
+            }
+            flush(entries, block_keys, seen, first_blocks[i] + block);
+        });
+        parallel_for(pending.size(), [&](const std::size_t slot, std::size_t) {
+            if (!pending[slot].empty())
+            {
+                spill(pending[slot]);
+            }
+        });
+        if (!error.empty())
+        {
+            return std::unexpected{std::move(error)};
+        }
+
+        const auto temporary{std::filesystem::path{index_name} += ".tmp"};
+        {
+            std::ofstream ofs{temporary, std::ios::binary};
+            if (!ofs)
+            {
+                return std::unexpected{"Failed to open index file"};
+            }
+            const header head{.block_size = block_size, .file_count = file_names.size()};
+            ofs.write(reinterpret_cast<const char *>(&head), sizeof head);
+            for (std::size_t i{}; i < file_names.size(); ++i)
+            {
+                const std::array<std::uint64_t, 3> entry{file_names[i].size(), sizes[i], first_blocks[i]};
+                ofs.write(reinterpret_cast<const char *>(entry.data()), sizeof entry);
+                ofs.write(file_names[i].data(), static_cast<std::streamsize>(file_names[i].size()));
+            }
+            if (auto merged{runs.merge(ofs)}; !merged || !ofs.flush())
+            {
+                std::error_code ignored;
+                std::filesystem::remove(temporary, ignored);
+                return std::unexpected{merged ? "Failed to write index file" : std::move(merged.error())};
+            }
+        }
+
+        std::error_code renamed;
+        std::filesystem::rename(temporary, index_name, renamed);
+        if (renamed)
+        {
+            std::error_code ignored;
+            std::filesystem::remove(temporary, ignored);
+            return std::unexpected{std::format("{}: {}", index_name, renamed.message())};
+        }
+        return {};
+    }
+
+    /**
+     * @brief Map an index built by `build()`
+     */
+    [[nodiscard]] static eresult<shift_index> open(const std::string &index_name) noexcept
+    {
+        return mapped_file::open(index_name)
+            .transform_error(&compact_error::message)
+            .and_then([](mapped_file file) -> eresult<shift_index> {
+                shift_index index{};
+                const auto data{file.view()};
+                if (data.size() < sizeof(header))
+                {
+                    return std::unexpected{"Index file is truncated"};
+                }
+                header head{};
+                std::memcpy(&head, data.data(), sizeof head);
+                if (std::memcmp(head.magic, header{}.magic, sizeof head.magic) != 0)
+                {
+                    return std::unexpected{"Not an index file"};
+                }
+
+                std::size_t position{sizeof head};
+                for (std::uint64_t i{}; i < head.file_count; ++i)
+                {
+                    std::array<std::uint64_t, 3> entry{};
+                    if (data.size() < position + sizeof entry)
+                    {
+                        return std::unexpected{"Index file is truncated"};
+                    }
+                    std::memcpy(entry.data(), data.data() + position, sizeof entry);
+                    position += sizeof entry;
+                    if (data.size() < position + entry[0])
+                    {
+                        return std::unexpected{"Index file is truncated"};
+                    }
+                    index.files_.push_back({std::string{data.substr(position, entry[0])}, entry[1], entry[2]});
+                    position += entry[0];
+                }
+
+                if (data.size() < position + (key_count + 1) * sizeof(std::uint64_t))
+                {
+                    return std::unexpected{"Index file is truncated"};
+                }
+                index.offsets_.resize(key_count + 1);
+                std::memcpy(index.offsets_.data(), data.data() + position,
+                            index.offsets_.size() * sizeof(std::uint64_t));
+                position += index.offsets_.size() * sizeof(std::uint64_t);
+                index.postings_ = data.substr(position);
+                if (index.postings_.size() != index.offsets_.back())
+                {
+                    return std::unexpected{"Index file is truncated"};
+                }
+
+                index.block_size_ = head.block_size;
+                index.file_ = std::move(file);
+                return {std::move(index)};
+            });
+    }
+
+    /**
+     * @brief Find occurrences of `term` under any shift
+     *
+     * @param term at least four letters; case and non-letters are ignored
+     * @param max_hits stop collecting after this many verified hits
+     * @return eresult<std::vector<shift_hit>> hits in file and offset order
+     */
+    [[nodiscard]] eresult<std::vector<shift_hit>> search(const std::string_view term,
+                                                         const std::size_t max_hits = 1000) const noexcept
+    {
+        std::vector<int> letters;
+        for (const char ch : term)
+        {
+            if (const int letter{letter_index(ch)}; letter >= 0)
+            {
+                letters.push_back(letter);
+            }
+        }
+        if (letters.size() < 4)
+        {
+            return std::unexpected{"Search terms need at least four letters"};
+        }
+
+        // A block can hold the start of a match while later grams spill into the next block, so each gram
+        // vouches for its own block and the one before it
+        std::vector<std::uint64_t> candidates;
+        bool first{true};
+        for (std::size_t i{}; i + 4 <= letters.size(); ++i)
+        {
+            auto blocks{decode(gram_key({letters[i], letters[i + 1], letters[i + 2], letters[i + 3]}))};
+            std::vector<std::uint64_t> widened;
+            widened.reserve(blocks.size() * 2);
+            for (const auto block : blocks)
+            {
+                if (block > 0 && (widened.empty() || widened.back() < block - 1))
+                {
+                    widened.push_back(block - 1);
+                }
+                if (widened.empty() || widened.back() < block)
+                {
+                    widened.push_back(block);
+                }
+            }
+
+            if (first)
+            {
+                candidates = std::move(widened);
+                first = false;
+            }
+            else
+            {
+                std::vector<std::uint64_t> intersection;
+                std::ranges::set_intersection(candidates, widened, std::back_inserter(intersection));
+                candidates = std::move(intersection);
+            }
+            if (candidates.empty())
+            {
+                return std::vector<shift_hit>{};
+            }
+        }
+
+        // Verify the surviving blocks in parallel, mapping each source file once
+        std::vector<std::vector<shift_hit>> hits(candidates.size());
+        std::vector<std::size_t> owners(candidates.size());
+        for (std::size_t i{}; i < candidates.size(); ++i)
+        {
+            owners[i] = static_cast<std::size_t>(
+                std::ranges::upper_bound(files_, candidates[i], {}, &file_entry::first_block) - files_.begin() - 1);
+        }
+        std::vector<cresult<mapped_file>> sources(files_.size());
+        std::vector<std::once_flag> opened(files_.size());
+        parallel_for(candidates.size(), [&](const std::size_t i, std::size_t) {
+            const auto &entry{files_[owners[i]]};
+            std::call_once(opened[owners[i]], [&] { sources[owners[i]] = mapped_file::open(entry.name); });
+            if (!sources[owners[i]] || sources[owners[i]]->size() != entry.size)
+            {
+                return; // the file is gone or changed since indexing
+            }
+            const auto text{sources[owners[i]]->view()};
+            const std::size_t begin{(candidates[i] - entry.first_block) * block_size_};
+            const std::size_t end{std::min(text.size(), begin + block_size_)};
+            verify(text, begin, end, letters, [&](const std::size_t offset, const int shift) {
+                hits[i].push_back({entry.name, offset, shift});
+            });
+        });
+
+        std::vector<shift_hit> result;
+        for (auto &block_hits : hits)
+        {
+            for (auto &hit : block_hits)
+            {
+                if (result.size() == max_hits)
+                {
+                    return result;
+                }
+                result.push_back(std::move(hit));
+            }
+        }
+        return result;
+    }
+
+  private:
+    struct header
+    {
+        char magic[8]{'T', 'P', 'S', 'I', 'D', 'X', '0', '1'};
+        std::uint64_t block_size;
+        std::uint64_t file_count;
+    };
+
+    struct file_entry
+    {
+        std::string name;
+        std::uint64_t size;
+        std::uint64_t first_block;
+    };
+
+    // A posting as one sortable integer: the key above the global block id
+    static constexpr int block_bits{40};
+    static constexpr std::uint64_t block_mask{(std::uint64_t{1} << block_bits) - 1};
+
+    /**
+     * @brief Streams postings key by key behind a reserved table of `key_count + 1` offsets, filled in by `finish()`
+     *
+     * Runs and the tail of the index share this layout, so runs merge straight into the index
+     *
+     */
+    class posting_writer
+    {
+      public:
+        explicit posting_writer(std::ofstream &out) noexcept : out_{out}, table_{out.tellp()}
+        {
+            out_.write(reinterpret_cast<const char *>(offsets_.data()),
+                       static_cast<std::streamsize>(offsets_.size() * sizeof(std::uint64_t)));
+        }
+
+        // Keys come in ascending order, and blocks in ascending order within a key
+        void add(const std::uint32_t key, const std::uint64_t block) noexcept
+        {
+            for (; next_key_ <= key; ++next_key_)
+            {
+                offsets_[next_key_] = written_ + buffer_.size();
+                previous_ = 0;
+            }
+            write_varint(buffer_, block - previous_);
+            previous_ = block;
+            if (buffer_.size() >= 64 * 1024)
+            {
+                drain();
+            }
+        }
+
+        [[nodiscard]] bool finish() noexcept
+        {
+            drain();
+            for (; next_key_ <= key_count; ++next_key_)
+            {
+                offsets_[next_key_] = written_;
+            }
+            const auto end{out_.tellp()};
+            out_.seekp(table_);
+            out_.write(reinterpret_cast<const char *>(offsets_.data()),
+                       static_cast<std::streamsize>(offsets_.size() * sizeof(std::uint64_t)));
+            out_.seekp(end);
+            return static_cast<bool>(out_);
+        }
+
+      private:
+        void drain() noexcept
+        {
+            out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+            written_ += buffer_.size();
+            buffer_.clear();
+        }
+
+        std::ofstream &out_;
+        std::streampos table_;
+        std::vector<std::uint64_t> offsets_ = std::vector<std::uint64_t>(key_count + 1);
+        std::string buffer_;
+        std::uint64_t written_{};
+        std::uint64_t previous_{};
+        std::uint32_t next_key_{};
+    };
+
+    /**
+     * @brief Reads a run back one key at a time, in ascending key order
+     *
+     */
+    class run_reader
+    {
+      public:
+        [[nodiscard]] static eresult<run_reader> open(const std::filesystem::path &path) noexcept
+        {
+            run_reader reader{};
+            reader.in_.open(path, std::ios::binary);
+            reader.in_.read(reinterpret_cast<char *>(reader.offsets_.data()),
+                            static_cast<std::streamsize>(reader.offsets_.size() * sizeof(std::uint64_t)));
+            if (!reader.in_)
+            {
+                return std::unexpected{std::format("Failed to read {}", path.string())};
+            }
+            return {std::move(reader)};
+        }
+
+        // Start on the postings of `key`, which must follow the previous one
+        void start(const std::uint32_t key) noexcept
+        {
+            remaining_ = offsets_[key + 1] - offsets_[key];
+            previous_ = 0;
+        }
+
+        [[nodiscard]] bool next(std::uint64_t &block) noexcept
+        {
+            std::uint64_t value{};
+            for (int shift{}; remaining_ > 0; shift += 7)
+            {
+                const auto byte{static_cast<std::uint8_t>(in_.get())};
+                remaining_--;
+                value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0)
+                {
+                    previous_ += value;
+                    block = previous_;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+      private:
+        run_reader() noexcept = default;
+
+        std::ifstream in_;
+        std::vector<std::uint64_t> offsets_ = std::vector<std::uint64_t>(key_count + 1);
+        std::uint64_t remaining_{};
+        std::uint64_t previous_{};
+    };
+
+    /**
+     * @brief The sorted runs of one build, removed with it
+     *
+     */
+    class run_files
+    {
+      public:
+        explicit run_files(std::string index_name) noexcept : index_name_{std::move(index_name)}
+        {
+        }
+
+        run_files(const run_files &) noexcept = delete;
+        run_files &operator=(const run_files &) noexcept = delete;
+
+        ~run_files()
+        {
+            for (const auto &path : paths_)
+            {
+                std::error_code ignored;
+                std::filesystem::remove(path, ignored);
+            }
+        }
+
+        // Sort `entries` and write them out as a new run; safe to call from several workers
+        [[nodiscard]] eresult<void> write(std::vector<std::uint64_t> &entries) noexcept
+        {
+            std::ranges::sort(entries);
+            const auto path{next_path()};
+            std::ofstream out{path, std::ios::binary};
+            posting_writer writer{out};
+            for (const auto entry : entries)
+            {
+                writer.add(static_cast<std::uint32_t>(entry >> block_bits), entry & block_mask);
+            }
+            if (!writer.finish() || !out.flush())
+            {
+                return std::unexpected{std::format("Failed to write {}", path.string())};
+            }
+            return {};
+        }
+
+        // Merge every run into `out`, first folding them into fewer runs while there are too many to open at once
+        [[nodiscard]] eresult<void> merge(std::ofstream &out) noexcept
+        {
+            std::lock_guard<std::mutex> guard{mutex_};
+            std::size_t merged{};
+            while (paths_.size() - merged > max_open_runs)
+            {
+                const auto first{paths_.begin() + static_cast<std::ptrdiff_t>(merged)};
+                const std::vector<std::filesystem::path> group(first, first + max_open_runs);
+                paths_.push_back(std::filesystem::path{index_name_} += std::format(".run{}", created_++));
+                std::ofstream run{paths_.back(), std::ios::binary};
+                if (auto result{merge(group, run)}; !result)
+                {
+                    return result;
+                }
+                if (!run.flush())
+                {
+                    return std::unexpected{std::format("Failed to write {}", paths_.back().string())};
+                }
+                for (const auto &done : group)
+                {
+                    std::error_code ignored;
+                    std::filesystem::remove(done, ignored);
+                }
+                merged += max_open_runs;
+            }
+            return merge(std::span{paths_}.subspan(merged), out);
+        }
+
+      private:
+        [[nodiscard]] std::filesystem::path next_path() noexcept
+        {
+            std::lock_guard<std::mutex> guard{mutex_};
+            paths_.push_back(std::filesystem::path{index_name_} += std::format(".run{}", created_++));
+            return paths_.back();
+        }
+
+        [[nodiscard]] static eresult<void> merge(const std::span<const std::filesystem::path> paths,
+                                                 std::ofstream &out) noexcept
+        {
+            std::vector<run_reader> readers;
+            for (const auto &path : paths)
+            {
+                auto reader{run_reader::open(path)};
+                if (!reader)
+                {
+                    return std::unexpected{std::move(reader.error())};
+                }
+                readers.push_back(std::move(*reader));
+            }
+
+            // Runs hold disjoint blocks, so a key's postings are the k-way merge of its postings in every run
+            posting_writer writer{out};
+            using head = std::pair<std::uint64_t, std::size_t>; // (block, run)
+            std::priority_queue<head, std::vector<head>, std::greater<>> heads;
+            for (std::uint32_t key{}; key < key_count; ++key)
+            {
+                for (std::size_t i{}; i < readers.size(); ++i)
+                {
+                    readers[i].start(key);
+                    if (std::uint64_t block{}; readers[i].next(block))
+                    {
+                        heads.emplace(block, i);
+                    }
+                }
+                while (!heads.empty())
+                {
+                    const auto [block, i]{heads.top()};
+                    heads.pop();
+                    writer.add(key, block);
+                    if (std::uint64_t following{}; readers[i].next(following))
+                    {
+                        heads.emplace(following, i);
+                    }
+                }
+            }
+            if (!writer.finish())
+            {
+                return std::unexpected{"Failed to write index file"};
+            }
+            return {};
+        }
+
+        std::string index_name_;
+        std::mutex mutex_;
+        std::vector<std::filesystem::path> paths_;
+        std::size_t created_{};
+    };
+
+    shift_index() noexcept = default;
+
+    [[nodiscard]] static constexpr std::uint32_t gram_key(const std::array<int, 4> &letters) noexcept
+    {
+        std::uint32_t key{};
+        for (std::size_t i{1}; i < letters.size(); ++i)
+        {
+            key = key * 26 + static_cast<std::uint32_t>((letters[i] - letters[i - 1] + 26) % 26);
+        }
+        return key;
+    }
+
+    static void flush(std::vector<std::uint64_t> &entries, std::vector<std::uint32_t> &block_keys,
+                      std::vector<bool> &seen, const std::uint64_t block) noexcept
+    {
+        for (const auto key : block_keys)
+        {
+            entries.push_back(std::uint64_t{key} << block_bits | block);
+            seen[key] = false;
+        }
+        block_keys.clear();
+    }
+
+    static void write_varint(std::string &out, std::uint64_t value) noexcept
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    [[nodiscard]] std::vector<std::uint64_t> decode(const std::uint32_t key) const noexcept
+    {
+        std::vector<std::uint64_t> blocks;
+        const auto bytes{postings_.substr(offsets_[key], offsets_[key + 1] - offsets_[key])};
+        std::uint64_t previous{}, value{};
+        int shift{};
+        for (const char ch : bytes)
+        {
+            const auto byte{static_cast<std::uint8_t>(ch)};
+            value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            shift += 7;
+            if ((byte & 0x80) == 0)
+            {
+                previous += value;
+                blocks.push_back(previous);
+                value = 0;
+                shift = 0;
+            }
+        }
+        return blocks;
+    }
+
+    // Report every match whose first letter lies in `text[begin, end)`; the match itself may run past `end`
+    template <typename F>
+    static void verify(const std::string_view text, const std::size_t begin, const std::size_t end,
+                       const std::vector<int> &letters, F &&report) noexcept
+    {
+        for (std::size_t start{begin}; start < end; ++start)
+        {
+            const int first{letter_index(text[start])};
+            if (first < 0)
+            {
+                continue;
+            }
+            const int shift{(first - letters[0] + 26) % 26};
+            std::size_t matched{1};
+            for (std::size_t position{start + 1}; position < text.size() && matched < letters.size(); ++position)
+            {
+                const int letter{letter_index(text[position])};
+                if (letter < 0)
+                {
+                    continue;
+                }
+                if (letter != (letters[matched] + shift) % 26)
+                {
+                    break;
+                }
+                ++matched;
+            }
+            if (matched == letters.size())
+            {
+                report(start, shift);
+            }
+        }
+    }
+
+    mapped_file file_;
+    std::size_t block_size_{default_block_size};
+    std::vector<file_entry> files_;
+    std::vector<std::uint64_t> offsets_;
+    std::string_view postings_; // into `file_`
+};
+} // namespace tprotect::cipher
@@ -3,11 +3,13 @@
 #pragma once
 
 #include <cstring>
-#include <expected>
 #include <map>
 #include <string>
 #include <string_view>
 
+#include <tprotect/cipher/byte_map.hpp>
+#include <tprotect/global.hpp>
+
 namespace tprotect::cipher
 {
 class substitution_cipher
@@ -18,7 +20,7 @@ class substitution_cipher
         set_key(mapping);
     }
 
-    [[nodiscard]] std::expected<std::string, std::string> encrypt(const std::string_view input) const noexcept
+    [[nodiscard]] cresult<std::string> encrypt(const std::string_view input) const noexcept
     {
         std::string result;
         result.reserve(input.size());
@@ -37,7 +39,7 @@ class substitution_cipher
         return result;
     }
 
-    [[nodiscard]] std::expected<std::string, std::string> decrypt(const std::string_view input) const noexcept
+    [[nodiscard]] cresult<std::string> decrypt(const std::string_view input) const noexcept
     {
         std::string result;
         result.reserve(input.size());
@@ -67,7 +69,28 @@ class substitution_cipher
         }
     }
 
+    // Either direction as a byte table, to fuse with other per-byte stages such as `text_normalizer`
+    [[nodiscard]] byte_map encryption_table() const noexcept
+    {
+        return table_of(encryption_map_);
+    }
+
+    [[nodiscard]] byte_map decryption_table() const noexcept
+    {
+        return table_of(decryption_map_);
+    }
+
   private:
+    [[nodiscard]] static byte_map table_of(const std::map<char, char> &map) noexcept
+    {
+        byte_map table{};
+        for (const auto &[from, to] : map)
+        {
+            table.set(from, to);
+        }
+        return table;
+    }
+
     std::map<char, char> encryption_map_;
     std::map<char, char> decryption_map_;
 };
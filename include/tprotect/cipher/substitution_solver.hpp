@@ -0,0 +1,303 @@
+// substitution_solver.hpp: Ciphertext-Only Key Search For The Substitution Cipher
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <tprotect/cipher/frequency_analyzer.hpp>
+#include <tprotect/cipher/letters.hpp>
+#include <tprotect/cipher/ngram_model.hpp>
+#include <tprotect/random.hpp>
+
+namespace tprotect::cipher
+{
+struct substitution_solution
+{
+    std::string mapping; // in `substitution_cipher` mapping format
+    double score;        // mean `ngram_model` score per trigram of the decryption
+    std::uint64_t shard; // the shard that found it
+};
+
+/**
+ * @brief Counts of the symbol trigrams and single symbols of a ciphertext, the statistics `substitution_solver` reads
+ *
+ * Symbols run lowercase first, as `substitution_cipher` mappings do, and non-letters are skipped as the model skips
+ * them. Trigrams never span two added texts, so the counts of many short messages under one key can be pooled
+ *
+ */
+struct symbol_trigrams
+{
+    static constexpr std::size_t symbol_count{52};
+
+    std::vector<std::uint64_t> counts = std::vector<std::uint64_t>(symbol_count * symbol_count * symbol_count);
+    std::array<std::uint64_t, symbol_count> symbols{};
+
+    [[nodiscard]] static constexpr int symbol_of(const char ch) noexcept
+    {
+        const int symbol{letter_symbol(ch)};
+        return symbol == no_letter ? -1 : (symbol + 26) % 52;
+    }
+
+    [[nodiscard]] static symbol_trigrams of(const std::string_view text) noexcept
+    {
+        symbol_trigrams result{};
+        result.add(text);
+        return result;
+    }
+
+    void add(const std::string_view text) noexcept
+    {
+        int a{-1}, b{-1};
+        for (const char ch : text)
+        {
+            const int symbol{symbol_of(ch)};
+            if (symbol < 0)
+            {
+                continue;
+            }
+            symbols[static_cast<std::size_t>(symbol)]++;
+            if (a >= 0)
+            {
+                counts[(static_cast<std::size_t>(a) * symbol_count + b) * symbol_count + symbol]++;
+            }
+            a = b;
+            b = symbol;
+        }
+    }
+
+    void merge(const symbol_trigrams &other) noexcept
+    {
+        for (std::size_t i{}; i < counts.size(); ++i)
+        {
+            counts[i] += other.counts[i];
+        }
+        for (std::size_t i{}; i < symbol_count; ++i)
+        {
+            symbols[i] += other.symbols[i];
+        }
+    }
+};
+
+/**
+ * @brief Recover a `substitution_cipher` mapping from ciphertext alone, one independent shard of the search at a time
+ *
+ * The cipher maps the 52 cased letters to 52 symbols, so each symbol decrypts to one case-folded letter and every
+ * letter has exactly two symbols. A key assigns letters to symbols under that constraint, and a move swaps the
+ * letters of two symbols, which keeps it. The ciphertext is reduced once to its distinct symbol trigrams with their
+ * counts, so scoring does not depend on the text length, and a move only rescores the trigrams touching its symbols.
+ *
+ * A shard is a restart: it starts from the frequency-rank guess of `frequency_analyzer`, scrambled by a number of
+ * swaps drawn from the shard's seed (shard 0 keeps it as is), and hill-climbs from there. Shards share nothing, so
+ * they can run on any thread or process, in any order, and a shard always finds the same key
+ *
+ */
+class substitution_solver
+{
+  public:
+    static constexpr std::size_t symbol_count{symbol_trigrams::symbol_count};
+    static constexpr std::string_view symbols{"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"};
+
+    substitution_solver(const std::string_view ciphertext, const ngram_model &model) noexcept
+        : substitution_solver{symbol_trigrams::of(ciphertext), model}
+    {
+    }
+
+    substitution_solver(const symbol_trigrams &counts, const ngram_model &model) noexcept
+        : model_{&model}, symbol_counts_{counts.symbols}
+    {
+        // Only the distinct trigrams are kept and scored
+        for (std::size_t i{}; i < counts.counts.size(); ++i)
+        {
+            if (counts.counts[i] > 0)
+            {
+                const auto index{static_cast<std::uint32_t>(trigrams_.size())};
+                trigrams_.push_back({{static_cast<std::uint8_t>(i / (symbol_count * symbol_count)),
+                                      static_cast<std::uint8_t>(i / symbol_count % symbol_count),
+                                      static_cast<std::uint8_t>(i % symbol_count)},
+                                     static_cast<std::uint32_t>(counts.counts[i])});
+                total_ += counts.counts[i];
+                const auto &symbols_of{trigrams_.back().symbols};
+                for (std::size_t j{}; j < 3; ++j)
+                {
+                    if (std::find(symbols_of.begin(), symbols_of.begin() + j, symbols_of[j]) == symbols_of.begin() + j)
+                    {
+                        touching_[symbols_of[j]].push_back(index);
+                    }
+                }
+            }
+        }
+
+        // The frequency-rank guess: the n-th most common symbol decrypts to the (n mod 26)-th most common letter, so
+        // the 26 most common symbols, normally the lowercase ones, cover the alphabet once and the rest again
+        const auto english{frequency_analyzer::get_english_frequencies()};
+        std::array<std::uint8_t, 26> letter_order{};
+        std::iota(letter_order.begin(), letter_order.end(), std::uint8_t{});
+        std::ranges::stable_sort(letter_order, std::greater<>{}, [&](const std::uint8_t letter) {
+            return english[letter];
+        });
+        std::array<std::uint64_t, 52> letter_counts{}; // A-Z, a-z, as `frequency_analyzer` counts them
+        for (std::size_t symbol{}; symbol < symbol_count; ++symbol)
+        {
+            letter_counts[(symbol + 26) % 52] = symbol_counts_[symbol];
+        }
+        std::string order{};
+        for (const auto &frequency : frequency_analyzer::summarize(letter_counts, true))
+        {
+            order += frequency.letter;
+        }
+        for (const char symbol : symbols)
+        {
+            if (order.find(symbol) == std::string::npos)
+            {
+                order += symbol;
+            }
+        }
+        for (std::size_t rank{}; rank < symbol_count; ++rank)
+        {
+            initial_[static_cast<std::size_t>(symbol_of(order[rank]))] = letter_order[rank % 26];
+        }
+    }
+
+    // Trigrams in the ciphertext; a solution's score is per trigram
+    [[nodiscard]] std::uint64_t trigrams() const noexcept
+    {
+        return total_;
+    }
+
+    /**
+     * @brief Run one shard for up to `iterations` moves
+     *
+     * @param stop polled every few hundred moves; returning true ends the shard early with its best key so far
+     * @param report receives the best solution whenever it improves, at most every few thousand moves
+     */
+    template <typename Stop, typename Report>
+    [[nodiscard]] substitution_solution solve_shard(const std::uint64_t shard, const std::size_t iterations,
+                                                    Stop &&stop, Report &&report) const noexcept
+    {
+        constexpr std::size_t stop_interval{256}, report_interval{4096};
+        splitmix64 random{mix64(shard, symbol_count)};
+        auto key{initial_};
+        for (std::size_t swaps{shard == 0 ? 0 : 4 + shard % 24}; swaps > 0; --swaps)
+        {
+            std::swap(key[random.below(symbol_count)], key[random.below(symbol_count)]);
+        }
+
+        double score{};
+        for (const auto &trigram : trigrams_)
+        {
+            score += trigram_score(key, trigram);
+        }
+        double reported{score};
+        report(solution_of(key, score, shard));
+
+        // Rescore only the trigrams touching either symbol, each once
+        std::vector<std::uint32_t> stamp(trigrams_.size(), 0);
+        std::uint32_t generation{};
+        const auto local_score{[&](const std::size_t x, const std::size_t y) {
+            generation++;
+            double total{};
+            for (const auto symbol : {x, y})
+            {
+                for (const auto index : touching_[symbol])
+                {
+                    if (std::exchange(stamp[index], generation) != generation)
+                    {
+                        total += trigram_score(key, trigrams_[index]);
+                    }
+                }
+            }
+            return total;
+        }};
+
+        for (std::size_t iteration{}; iteration < iterations; ++iteration)
+        {
+            if (iteration % stop_interval == 0 && stop())
+            {
+                break;
+            }
+            if (iteration % report_interval == 0 && score > reported)
+            {
+                reported = score;
+                report(solution_of(key, score, shard));
+            }
+            const std::size_t x{random.below(symbol_count)}, y{random.below(symbol_count)};
+            if (key[x] == key[y])
+            {
+                continue;
+            }
+            const double before{local_score(x, y)};
+            std::swap(key[x], key[y]);
+            const double delta{local_score(x, y) - before};
+            if (delta > 0.)
+            {
+                score += delta;
+            }
+            else
+            {
+                std::swap(key[x], key[y]);
+            }
+        }
+        return solution_of(key, score, shard);
+    }
+
+  private:
+    struct trigram
+    {
+        std::array<std::uint8_t, 3> symbols;
+        std::uint32_t count;
+    };
+
+    using key_type = std::array<std::uint8_t, symbol_count>; // symbol -> case-folded letter
+
+    [[nodiscard]] static constexpr int symbol_of(const char ch) noexcept
+    {
+        return symbol_trigrams::symbol_of(ch);
+    }
+
+    [[nodiscard]] double trigram_score(const key_type &key, const trigram &t) const noexcept
+    {
+        return t.count * static_cast<double>(model_->score(key[t.symbols[0]], key[t.symbols[1]], key[t.symbols[2]]));
+    }
+
+    // Of a letter's two symbols, the more common one stands for the lowercase letter, as in running text
+    [[nodiscard]] substitution_solution solution_of(const key_type &key, const double score,
+                                                    const std::uint64_t shard) const noexcept
+    {
+        std::string mapping(symbol_count, '?');
+        for (std::size_t symbol{}; symbol < symbol_count; ++symbol)
+        {
+            const std::size_t letter{key[symbol]};
+            auto &lower{mapping[letter]};
+            auto &upper{mapping[26 + letter]};
+            if (lower == '?')
+            {
+                lower = symbols[symbol];
+            }
+            else if (symbol_counts_[symbol] > symbol_counts_[static_cast<std::size_t>(symbol_of(lower))])
+            {
+                upper = std::exchange(lower, symbols[symbol]);
+            }
+            else
+            {
+                upper = symbols[symbol];
+            }
+        }
+        return {std::move(mapping), total_ > 0 ? score / static_cast<double>(total_) : 0., shard};
+    }
+
+    const ngram_model *model_;
+    std::vector<trigram> trigrams_;
+    std::array<std::vector<std::uint32_t>, symbol_count> touching_{};
+    std::array<std::uint64_t, symbol_count> symbol_counts_{};
+    key_type initial_{};
+    std::uint64_t total_{};
+};
+} // namespace tprotect::cipher
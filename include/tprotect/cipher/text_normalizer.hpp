@@ -0,0 +1,270 @@
+// text_normalizer.hpp: Classic Text Normalization And Letter-Group Formatting
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <tprotect/cipher/byte_map.hpp>
+#include <tprotect/cipher/letters.hpp>
+#include <tprotect/parallel.hpp>
+
+namespace tprotect::cipher
+{
+struct normalize_options
+{
+    bool uppercase{true};
+    bool letters_only{true};   // drop spaces, digits, punctuation and anything else not a letter
+    bool transliterate{};      // accented Latin letters in UTF-8 become their base letters, e.g. "É" to "E"
+    std::size_t group_size{};  // split the output into groups of this many characters, classically 5; 0 for none
+    std::size_t line_groups{}; // end a line after this many groups; 0 for one line
+
+    [[nodiscard]] bool changes_length() const noexcept
+    {
+        return letters_only || transliterate || group_size > 0;
+    }
+
+    [[nodiscard]] bool changes_text() const noexcept
+    {
+        return uppercase || changes_length();
+    }
+};
+
+/**
+ * @brief Normalization before a monoalphabetic cipher and letter-group formatting after it, fused into one stage
+ *
+ * Case folding and the cipher's own `byte_map` compose into one table, beside another of the bytes to keep, so the
+ * common ASCII path costs two lookups and a branch-free compacting store per byte: every byte is written and the
+ * cursor only advances past the kept ones. Only blocks holding UTF-8 sequences take a slower path when transliterating.
+ *
+ * Chunks are normalized in parallel into scratch space, then copied to their place in the output, which grouping
+ * finds from the number of characters before each chunk
+ *
+ */
+class text_normalizer
+{
+  public:
+    explicit text_normalizer(const normalize_options &options, const byte_map &cipher = {}) noexcept
+        : options_{options}
+    {
+        for (std::size_t i{}; i < 256; ++i)
+        {
+            auto byte{static_cast<char>(i)};
+            const auto symbol{letter_symbol(byte)};
+            if (options_.uppercase && symbol >= 26 && symbol != no_letter)
+            {
+                byte = static_cast<char>('A' + symbol - 26);
+            }
+            map_.set(static_cast<char>(i), cipher[byte]);
+            keep_[i] = symbol != no_letter || !options_.letters_only;
+        }
+    }
+
+    [[nodiscard]] const normalize_options &options() const noexcept
+    {
+        return options_;
+    }
+
+    [[nodiscard]] std::string apply(const std::string_view input, const std::size_t chunk_size = 1 << 20) const noexcept
+    {
+        if (!options_.changes_length())
+        {
+            return map_.apply(input, chunk_size);
+        }
+
+        // Chunks start on a character boundary, so no UTF-8 sequence is split between two of them
+        const std::size_t size{input.size()}, chunks{(size + chunk_size - 1) / chunk_size};
+        std::vector<std::size_t> starts(chunks + 1, size);
+        for (std::size_t c{}; c < chunks; ++c)
+        {
+            starts[c] = std::max(c > 0 ? starts[c - 1] : 0, c * chunk_size);
+            while (starts[c] < size && is_continuation(input[starts[c]]))
+            {
+                starts[c]++;
+            }
+        }
+
+        // Normalizing never lengthens a chunk, so each gets the scratch space its input occupies
+        const auto buffer{std::make_unique_for_overwrite<char[]>(size)};
+        std::vector<std::size_t> lengths(chunks + 1);
+        parallel_for(chunks, [&](const std::size_t c, std::size_t) {
+            lengths[c + 1] = normalize(input.substr(starts[c], starts[c + 1] - starts[c]), buffer.get() + starts[c]);
+        });
+        for (std::size_t c{1}; c < lengths.size(); ++c)
+        {
+            lengths[c] += lengths[c - 1];
+        }
+
+        const std::size_t total{lengths.back()}, group{options_.group_size};
+        const std::size_t formatted{group > 0 && total > 0 ? total + (total - 1) / group : total};
+        return fill_string(formatted, [&](char *const data) {
+            parallel_for(chunks, [&](const std::size_t c, std::size_t) {
+                const std::string_view normalized{buffer.get() + starts[c], lengths[c + 1] - lengths[c]};
+                if (group == 0)
+                {
+                    std::ranges::copy(normalized, data + lengths[c]);
+                    return;
+                }
+                format_groups(normalized, lengths[c], data + lengths[c] + separators(lengths[c]));
+            });
+        });
+    }
+
+    /**
+     * @brief Split a piece of already normalized text into groups, as `apply` does, given how many characters of the
+     * whole text come before it
+     *
+     * Pieces grouped this way and joined in order are the whole text grouped at once, so a text held in chunks can be
+     * grouped chunk by chunk
+     *
+     */
+    [[nodiscard]] std::string group(const std::string_view normalized, const std::size_t first) const noexcept
+    {
+        if (options_.group_size == 0)
+        {
+            return std::string{normalized};
+        }
+        const std::size_t end{first + normalized.size()};
+        return fill_string(normalized.size() + separators(end) - separators(first),
+                           [&](char *const data) { format_groups(normalized, first, data); });
+    }
+
+  private:
+    static constexpr std::size_t block_size{64};
+
+    [[nodiscard]] static constexpr bool is_continuation(const char byte) noexcept
+    {
+        return (static_cast<std::uint8_t>(byte) & 0xc0) == 0x80;
+    }
+
+    /**
+     * @brief The base letters of U+00C0 to U+017F, from Latin-1 Supplement and Latin Extended-A
+     *
+     * '.' marks a symbol and '*' a ligature spelt with two letters by `ligature()`
+     *
+     */
+    static constexpr std::string_view latin_letters{"AAAAAA*CEEEEIIIIDNOOOOO.OUUUUY**"
+                                                    "aaaaaa*ceeeeiiiidnooooo.ouuuuy*y"
+                                                    "AaAaAaCcCcCcCcDdDdEeEeEeEeEeGgGgGgGgHhHhIiIiIiIiIi**JjKkkLlLlLlL"
+                                                    "lLlNnNnNnnNnOoOoOo**RrRrRrSsSsSsSsTtTtTtUuUuUuUuUuUuWwYyYZzZzZzs"};
+
+    [[nodiscard]] static constexpr std::string_view ligature(const unsigned code_point) noexcept
+    {
+        switch (code_point)
+        {
+        case 0xc6:
+            return "AE";
+        case 0xde:
+            return "TH";
+        case 0xdf:
+            return "ss";
+        case 0xe6:
+            return "ae";
+        case 0xfe:
+            return "th";
+        case 0x132:
+            return "IJ";
+        case 0x133:
+            return "ij";
+        case 0x152:
+            return "OE";
+        case 0x153:
+            return "oe";
+        default:
+            return {};
+        }
+    }
+
+    // The separators between the first `n` characters of the grouped text
+    [[nodiscard]] std::size_t separators(const std::size_t n) const noexcept
+    {
+        return n > 0 ? (n - 1) / options_.group_size : 0;
+    }
+
+    // Write `normalized`, starting at character `first` of the whole text, to `out` with the separators it holds
+    void format_groups(const std::string_view normalized, const std::size_t first, char *out) const noexcept
+    {
+        // A full group before the first character means the separator after it is this piece's to write
+        const std::size_t group{options_.group_size};
+        std::size_t filled{first > 0 && first % group == 0 ? group : first % group};
+        std::size_t groups{separators(first)};
+        for (std::size_t i{}; i < normalized.size();)
+        {
+            if (filled == group)
+            {
+                groups++;
+                *out++ = options_.line_groups > 0 && groups % options_.line_groups == 0 ? '\n' : ' ';
+                filled = 0;
+            }
+            const std::size_t run{std::min(group - filled, normalized.size() - i)};
+            out = std::copy_n(normalized.data() + i, run, out);
+            i += run;
+            filled += run;
+        }
+    }
+
+    // Normalize `input` into `out`, which must hold `input.size()` characters, and return how many it holds now
+    std::size_t normalize(const std::string_view input, char *const out) const noexcept
+    {
+        const auto *const in{reinterpret_cast<const std::uint8_t *>(input.data())};
+        std::size_t count{}, begin{};
+        while (begin < input.size())
+        {
+            const std::size_t end{std::min(input.size(), begin + block_size)};
+            std::uint8_t high{};
+            for (std::size_t i{begin}; i < end; ++i)
+            {
+                high |= in[i];
+            }
+            if (!options_.transliterate || high < 0x80)
+            {
+                for (std::size_t i{begin}; i < end; ++i)
+                {
+                    out[count] = map_[input[i]];
+                    count += keep_[in[i]];
+                }
+                begin = end;
+                continue;
+            }
+
+            // A sequence may run past the block, which then ends where the sequence does
+            while (begin < end)
+            {
+                if (in[begin] >= 0xc3 && in[begin] <= 0xc5 && begin + 1 < input.size() &&
+                    is_continuation(input[begin + 1]))
+                {
+                    const unsigned code_point{(in[begin] & 0x1fu) << 6 | (in[begin + 1] & 0x3fu)};
+                    const auto letters{latin_letters[code_point - 0xc0] == '*'
+                                           ? ligature(code_point)
+                                           : latin_letters.substr(code_point - 0xc0, 1)};
+                    if (letters != ".")
+                    {
+                        for (const char letter : letters)
+                        {
+                            out[count++] = map_[letter];
+                        }
+                        begin += 2;
+                        continue;
+                    }
+                }
+                out[count] = map_[input[begin]];
+                count += keep_[in[begin]];
+                begin++;
+            }
+        }
+        return count;
+    }
+
+    static_assert(latin_letters.size() == 0x180 - 0xc0);
+
+    normalize_options options_;
+    byte_map map_{};
+    std::array<std::uint8_t, 256> keep_{};
+};
+} // namespace tprotect::cipher
@@ -2,11 +2,14 @@
 
 #pragma once
 
+#include <array>
 #include <cmath>
-#include <expected>
 #include <string>
 #include <vector>
 
+#include <tprotect/cipher/byte_map.hpp>
+#include <tprotect/global.hpp>
+
 namespace tprotect::cipher
 {
 class transposition_cipher
@@ -17,7 +20,7 @@ class transposition_cipher
         set_key(key);
     }
 
-    [[nodiscard]] std::expected<std::string, std::string> encrypt(const std::string_view input) const noexcept
+    [[nodiscard]] cresult<std::string> encrypt(const std::string_view input) const noexcept
     {
         std::string result{};
 
@@ -37,7 +40,7 @@ class transposition_cipher
         return result;
     }
 
-    [[nodiscard]] std::expected<std::string, std::string> decrypt(const std::string_view input) const noexcept
+    [[nodiscard]] cresult<std::string> decrypt(const std::string_view input) const noexcept
     {
         std::string result{};
 
@@ -67,6 +70,17 @@ class transposition_cipher
         key_ = std::abs(key) % 26;
     }
 
+    // Either direction as a byte table, to fuse with other per-byte stages such as `text_normalizer`
+    [[nodiscard]] byte_map encryption_table() const noexcept
+    {
+        return table_of(key_);
+    }
+
+    [[nodiscard]] byte_map decryption_table() const noexcept
+    {
+        return table_of(26 - key_);
+    }
+
     // Attempt to use all the keys
     [[nodiscard]] static std::vector<std::string> decrypt_all_shifts(const std::string_view input) noexcept
     {
@@ -84,6 +98,17 @@ class transposition_cipher
     }
 
   private:
+    [[nodiscard]] static byte_map table_of(const int shift) noexcept
+    {
+        std::array<char, 52> images{};
+        for (int letter{}; letter < 26; ++letter)
+        {
+            images[letter] = static_cast<char>('A' + (letter + shift) % 26);
+            images[26 + letter] = static_cast<char>('a' + (letter + shift) % 26);
+        }
+        return byte_map::letters(images);
+    }
+
     int key_;
 };
 } // namespace tprotect::cipher
@@ -0,0 +1,169 @@
+// cipher_factory.hpp: Ciphers Chosen By Name And Key Text
+
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include <tprotect/cipher/affine_cipher.hpp>
+#include <tprotect/cipher/byte_map.hpp>
+#include <tprotect/cipher/hill_cipher.hpp>
+#include <tprotect/cipher/homophonic_cipher.hpp>
+#include <tprotect/cipher/playfair_cipher.hpp>
+#include <tprotect/cipher/running_key_cipher.hpp>
+#include <tprotect/cipher/substitution_cipher.hpp>
+#include <tprotect/cipher/transposition_cipher.hpp>
+#include <tprotect/global.hpp>
+
+namespace tprotect
+{
+using text_transform = std::function<cresult<std::string>(std::string_view)>;
+
+/**
+ * @brief A cipher chosen by name, ready to apply in one direction
+ *
+ */
+struct cipher_choice
+{
+    std::string configuration; // identifies the cipher, key and direction, e.g. for manifests and caches
+    text_transform transform;
+    std::optional<cipher::byte_map> table{}; // when the cipher maps bytes one to one, to fuse with normalization
+    bool keystream{}; // the key is used up along the text, so two calls must not both start at its beginning
+    bool resizes{};   // pads or drops characters, so the output length differs from the input's
+};
+
+/**
+ * @brief The cipher `name`, as the command line and job manifests name it, under a key given as text
+ *
+ * Keys are a mapping for substitution, a number for transposition, the multiplier and offset "A B" for affine, a path
+ * optionally followed by an offset in letters for running-key, a mapping optionally followed by a seed for homophonic,
+ * and a keyword for Playfair and Hill.
+ *
+ * The configuration also covers what the key only names: the running-key file is mapped, not read, so it can be as
+ * large as the text, and its size and time stand for its content
+ *
+ */
+[[nodiscard]] inline eresult<cipher_choice> make_cipher(const std::string_view name, const std::string_view key,
+                                                        const bool decrypt) noexcept
+{
+    const auto direction{decrypt ? "decrypt" : "encrypt"};
+    const auto parse_number{[](const std::string_view digits, auto &value) {
+        const auto [end, error]{std::from_chars(digits.data(), digits.data() + digits.size(), value)};
+        return error == std::errc{} && end == digits.data() + digits.size();
+    }};
+    if (key.empty())
+    {
+        return std::unexpected{std::format("The {} key must not be empty", name)};
+    }
+
+    if (name == "substitution")
+    {
+        // The byte table runs in parallel chunks with no per-byte lookup in the cipher's maps
+        const cipher::substitution_cipher cipher{key};
+        const auto table{decrypt ? cipher.decryption_table() : cipher.encryption_table()};
+        return cipher_choice{std::format("substitution {} {}", direction, key),
+                             [table](const std::string_view input) -> cresult<std::string> {
+                                 return table.apply(input);
+                             },
+                             table};
+    }
+    if (name == "transposition")
+    {
+        int shift{};
+        if (!parse_number(key, shift))
+        {
+            return std::unexpected{std::format("Invalid transposition key: {}", key)};
+        }
+        const cipher::transposition_cipher cipher{shift};
+        const auto table{decrypt ? cipher.decryption_table() : cipher.encryption_table()};
+        return cipher_choice{std::format("transposition {} {}", direction, shift),
+                             [table](const std::string_view input) -> cresult<std::string> {
+                                 return table.apply(input);
+                             },
+                             table};
+    }
+    if (name == "affine")
+    {
+        int a{}, b{};
+        const auto space{key.find(' ')};
+        if (space == std::string_view::npos || !parse_number(key.substr(0, space), a) ||
+            !parse_number(key.substr(space + 1), b))
+        {
+            return std::unexpected{std::format("Invalid affine key, expected \"A B\": {}", key)};
+        }
+        const cipher::affine_cipher cipher{a, b};
+        // An invalid key has no table, so its error surfaces whether or not normalization is fused
+        return cipher_choice{std::format("affine {} {} {}", direction, a, b),
+                             [cipher, decrypt](const std::string_view input) {
+                                 return decrypt ? cipher.decrypt(input) : cipher.encrypt(input);
+                             },
+                             cipher.valid() ? std::optional{decrypt ? cipher.decryption_table()
+                                                                    : cipher.encryption_table()}
+                                            : std::nullopt};
+    }
+    if (name == "running-key")
+    {
+        std::string_view path{key};
+        std::uint64_t offset{};
+        const auto space{key.rfind(' ')};
+        if (space != std::string_view::npos && parse_number(key.substr(space + 1), offset))
+        {
+            path = key.substr(0, space);
+        }
+        return cipher::running_key::open(std::string{path})
+            .transform([&](std::shared_ptr<const cipher::running_key> running_key) {
+                std::error_code error;
+                const auto size{std::filesystem::file_size(path, error)};
+                const auto time{std::filesystem::last_write_time(path, error).time_since_epoch().count()};
+                return cipher_choice{std::format("running-key {} {} {} {} {}", direction, path, size, time, offset),
+                                     [cipher = cipher::running_key_cipher{std::move(running_key), offset},
+                                      decrypt](const std::string_view input) {
+                                         return decrypt ? cipher.decrypt(input) : cipher.encrypt(input);
+                                     },
+                                     std::nullopt, true};
+            })
+            .transform_error(&compact_error::message);
+    }
+    if (name == "homophonic")
+    {
+        const auto space{key.find(' ')};
+        std::uint64_t seed{};
+        if (space != std::string_view::npos && !parse_number(key.substr(space + 1), seed))
+        {
+            return std::unexpected{std::format("Invalid homophonic seed: {}", key.substr(space + 1))};
+        }
+        const auto mapping{key.substr(0, space)};
+        return cipher_choice{std::format("homophonic {} {} {}", direction, mapping, seed),
+                             [cipher = cipher::homophonic_cipher{mapping, seed}, decrypt](
+                                 const std::string_view input) {
+                                 return decrypt ? cipher.decrypt(input) : cipher.encrypt(input);
+                             }};
+    }
+    // Both encipher letters only, so they are not position-independent transforms and chunk their own blocks
+    if (name == "playfair")
+    {
+        return cipher_choice{std::format("playfair {} {}", direction, key),
+                             [cipher = cipher::playfair_cipher{key}, decrypt](const std::string_view input) {
+                                 return decrypt ? cipher.decrypt(input) : cipher.encrypt(input);
+                             },
+                             std::nullopt, false, true};
+    }
+    if (name == "hill")
+    {
+        return cipher_choice{std::format("hill {} {}", direction, key),
+                             [cipher = cipher::hill_cipher{key}, decrypt](const std::string_view input) {
+                                 return decrypt ? cipher.decrypt(input) : cipher.encrypt(input);
+                             },
+                             std::nullopt, false, true};
+    }
+    return std::unexpected{std::format("Unknown cipher: {}", name)};
+}
+} // namespace tprotect
@@ -0,0 +1,20 @@
+// cli.hpp: Headless Command Line Interface
+
+#pragma once
+
+#include <span>
+#include <string_view>
+
+#include <tprotect/global.hpp>
+
+namespace tprotect::cli
+{
+/**
+ * @brief Run a headless command
+ *
+ * @param[in] args the arguments after the program name, the first of which names the command
+ *
+ * @return eresult<void> the result
+ */
+[[nodiscard]] eresult<void> run(std::span<const std::string_view> args) noexcept;
+} // namespace tprotect::cli
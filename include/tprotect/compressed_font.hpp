@@ -0,0 +1,146 @@
+// compressed_font.hpp: Thread-Safe Decoding Of Embedded Compressed Fonts
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include <tprotect/global.hpp>
+
+namespace tprotect
+{
+/**
+ * @brief Decompress data produced by Dear ImGui's `binary_to_compressed_c` (the stb_compress format)
+ *
+ * Dear ImGui's own decoder keeps its state in globals, so it can only run on the GUI thread. This one keeps it local
+ * and checks every bound, so fonts can be decoded on workers while the window comes up, then handed to
+ * `AddFontFromMemoryTTF`
+ *
+ */
+[[nodiscard]] inline cresult<std::vector<unsigned char>> decompress_font(
+    const std::span<const unsigned char> input) noexcept
+{
+    const auto in32{[&](const std::size_t at) {
+        return static_cast<std::uint32_t>(input[at]) << 24 | static_cast<std::uint32_t>(input[at + 1]) << 16 |
+               static_cast<std::uint32_t>(input[at + 2]) << 8 | static_cast<std::uint32_t>(input[at + 3]);
+    }};
+    if (input.size() < 16 || in32(0) != 0x57bC0000 || in32(4) != 0)
+    {
+        return std::unexpected{compact_error{errc::corrupt_data}};
+    }
+
+    std::vector<unsigned char> output(in32(8));
+    std::size_t in{16}, out{};
+    const auto in_bytes{[&](const std::size_t offset, const std::size_t count) {
+        std::uint32_t value{};
+        for (std::size_t k{}; k < count; ++k)
+        {
+            value = value << 8 | input[in + offset + k];
+        }
+        return value;
+    }};
+    const auto match{[&](const std::size_t distance, const std::size_t length) {
+        if (distance > out || length > output.size() - out)
+        {
+            return false;
+        }
+        for (std::size_t k{}; k < length; ++k, ++out) // may overlap itself, so byte by byte
+        {
+            output[out] = output[out - distance];
+        }
+        return true;
+    }};
+    const auto literal{[&](const std::size_t offset, const std::size_t length) {
+        if (in + offset + length > input.size() || length > output.size() - out)
+        {
+            return false;
+        }
+        std::memcpy(output.data() + out, input.data() + in + offset, length);
+        out += length;
+        in += offset + length;
+        return true;
+    }};
+
+    while (true)
+    {
+        if (in + 6 > input.size())
+        {
+            return std::unexpected{compact_error{errc::corrupt_data}};
+        }
+        const unsigned char token{input[in]};
+        bool ok{};
+        if (token >= 0x80)
+        {
+            ok = match(input[in + 1] + 1u, token - 0x80u + 1u);
+            in += 2;
+        }
+        else if (token >= 0x40)
+        {
+            ok = match(in_bytes(0, 2) - 0x4000u + 1u, input[in + 2] + 1u);
+            in += 3;
+        }
+        else if (token >= 0x20)
+        {
+            ok = literal(1, token - 0x20u + 1u);
+        }
+        else if (token >= 0x18)
+        {
+            ok = match(in_bytes(0, 3) - 0x180000u + 1u, input[in + 3] + 1u);
+            in += 4;
+        }
+        else if (token >= 0x10)
+        {
+            ok = match(in_bytes(0, 3) - 0x100000u + 1u, in_bytes(3, 2) + 1u);
+            in += 5;
+        }
+        else if (token >= 0x08)
+        {
+            ok = literal(2, in_bytes(0, 2) - 0x0800u + 1u);
+        }
+        else if (token == 0x07)
+        {
+            ok = literal(3, in_bytes(1, 2) + 1u);
+        }
+        else if (token == 0x06)
+        {
+            ok = match(in_bytes(1, 3) + 1u, input[in + 4] + 1u);
+            in += 5;
+        }
+        else if (token == 0x04)
+        {
+            ok = match(in_bytes(1, 3) + 1u, in_bytes(4, 2) + 1u);
+            in += 6;
+        }
+        else if (token == 0x05 && input[in + 1] == 0xfa)
+        {
+            break; // end of stream, followed by the checksum
+        }
+        if (!ok)
+        {
+            return std::unexpected{compact_error{errc::corrupt_data}};
+        }
+    }
+
+    // Adler-32 of the output, which follows the end marker
+    std::uint32_t s1{1}, s2{};
+    for (std::size_t at{}; at < output.size();)
+    {
+        for (const std::size_t block_end{std::min(output.size(), at + 5552)}; at < block_end; ++at)
+        {
+            s1 += output[at];
+            s2 += s1;
+        }
+        s1 %= 65521;
+        s2 %= 65521;
+    }
+    if (out != output.size() || (s2 << 16 | s1) != in32(in + 2))
+    {
+        return std::unexpected{compact_error{errc::corrupt_data}};
+    }
+    return output;
+}
+} // namespace tprotect
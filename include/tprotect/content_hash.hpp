@@ -0,0 +1,98 @@
+// content_hash.hpp: Fast Non-Cryptographic Content Hashing
+
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace tprotect
+{
+/**
+ * @brief Hash bytes with XXH64
+ *
+ * Used to tell whether file contents changed, not to resist tampering. Runs at several GB/s, so hashing is cheaper
+ * than re-encrypting a file
+ *
+ */
+[[nodiscard]] inline std::uint64_t content_hash(const std::string_view data, const std::uint64_t seed = 0) noexcept
+{
+    constexpr std::uint64_t prime1{0x9E3779B185EBCA87ull};
+    constexpr std::uint64_t prime2{0xC2B2AE3D27D4EB4Full};
+    constexpr std::uint64_t prime3{0x165667B19E3779F9ull};
+    constexpr std::uint64_t prime4{0x85EBCA77C2B2AE63ull};
+    constexpr std::uint64_t prime5{0x27D4EB2F165667C5ull};
+
+    const auto read64{[](const char *const p) {
+        std::uint64_t value;
+        std::memcpy(&value, p, sizeof value);
+        return value; // little-endian hosts only, which is every target we build for
+    }};
+    const auto read32{[](const char *const p) {
+        std::uint32_t value;
+        std::memcpy(&value, p, sizeof value);
+        return value;
+    }};
+    const auto round{[](std::uint64_t acc, const std::uint64_t input) {
+        acc += input * prime2;
+        acc = std::rotl(acc, 31);
+        return acc * prime1;
+    }};
+    const auto merge{[&](std::uint64_t acc, const std::uint64_t value) {
+        acc ^= round(0, value);
+        return acc * prime1 + prime4;
+    }};
+
+    const char *p{data.data()};
+    const char *const end{p + data.size()};
+    std::uint64_t hash;
+
+    if (data.size() >= 32)
+    {
+        std::uint64_t v1{seed + prime1 + prime2}, v2{seed + prime2}, v3{seed}, v4{seed - prime1};
+        for (const char *const limit{end - 32}; p <= limit; p += 32)
+        {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+        }
+        hash = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+        hash = merge(hash, v1);
+        hash = merge(hash, v2);
+        hash = merge(hash, v3);
+        hash = merge(hash, v4);
+    }
+    else
+    {
+        hash = seed + prime5;
+    }
+
+    hash += static_cast<std::uint64_t>(data.size());
+    for (; p + 8 <= end; p += 8)
+    {
+        hash ^= round(0, read64(p));
+        hash = std::rotl(hash, 27) * prime1 + prime4;
+    }
+    if (p + 4 <= end)
+    {
+        hash ^= static_cast<std::uint64_t>(read32(p)) * prime1;
+        hash = std::rotl(hash, 23) * prime2 + prime3;
+        p += 4;
+    }
+    for (; p < end; ++p)
+    {
+        hash ^= static_cast<std::uint64_t>(static_cast<unsigned char>(*p)) * prime5;
+        hash = std::rotl(hash, 11) * prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+} // namespace tprotect
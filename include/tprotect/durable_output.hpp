@@ -0,0 +1,241 @@
+// durable_output.hpp: Group-Committed Durable File Replacement
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <format>
+#include <mutex>
+#include <set>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <tprotect/global.hpp>
+
+namespace tprotect
+{
+struct durability_options
+{
+    bool enabled{};                       // otherwise outputs are renamed into place as soon as they are written
+    std::chrono::milliseconds window{50}; // age of the oldest pending output at which the next commit() flushes
+    std::size_t max_group{256};           // outputs that commit a group early
+    std::size_t syncfs_threshold{16};     // groups at least this large sync the whole filesystem at once
+};
+
+/**
+ * @brief Moves finished temporary files over their targets, so that with durability on they survive a crash
+ *
+ * A durable commit must sync a file's data before renaming it and sync the directory after, which costs a journal
+ * commit each; doing that per file makes thousands of small outputs crawl. Here commits are grouped instead: the
+ * thread that finds the oldest pending output older than the window, or the group full, flushes the whole group with
+ * one `syncfs` (or an `fdatasync` per file for small groups, or groups spanning filesystems), renames every file, then
+ * syncs each directory once. There is no timer: a group only commits from the next `commit()` or `flush()`, so a
+ * pending output waits for one of those however long the window. `flush()` commits whatever is left and reports the
+ * first failure. A group whose data fails to sync replaces no
+ * target, and a failed commit removes its temporaries. Without durability, or off Linux, commits rename immediately
+ *
+ */
+class group_commit
+{
+  public:
+    explicit group_commit(const durability_options &options = {}) noexcept : options_{options}
+    {
+    }
+
+    // Disable copying and moving, as workers share it by reference
+    group_commit(const group_commit &) noexcept = delete;
+    group_commit &operator=(const group_commit &) noexcept = delete;
+    group_commit(group_commit &&) noexcept = delete;
+    group_commit &operator=(group_commit &&) noexcept = delete;
+
+    ~group_commit()
+    {
+        [[maybe_unused]] const auto result{flush()};
+    }
+
+    /**
+     * @brief Replace `target` with the closed file `temporary`, now or with the next group
+     *
+     * @return the failure of a group this call flushed, which may include other threads' outputs
+     */
+    [[nodiscard]] eresult<void> commit(std::filesystem::path temporary, std::filesystem::path target) noexcept
+    {
+        if (!durable())
+        {
+            std::error_code error;
+            std::filesystem::rename(temporary, target, error);
+            if (error)
+            {
+                auto message{std::format("{}: {}", target.string(), error.message())};
+                std::filesystem::remove(temporary, error);
+                return std::unexpected{std::move(message)};
+            }
+            return {};
+        }
+
+        std::vector<pending> group;
+        {
+            std::lock_guard<std::mutex> guard{mutex_};
+            if (pending_.empty())
+            {
+                oldest_ = clock::now();
+            }
+            pending_.push_back({std::move(temporary), std::move(target)});
+            if (pending_.size() < options_.max_group && clock::now() - oldest_ < options_.window)
+            {
+                return {};
+            }
+            group.swap(pending_);
+        }
+        return commit_group(group);
+    }
+
+    // Commit every pending output; the first failure of any group, or success
+    [[nodiscard]] eresult<void> flush() noexcept
+    {
+        std::vector<pending> group;
+        {
+            std::lock_guard<std::mutex> guard{mutex_};
+            group.swap(pending_);
+        }
+        if (!group.empty())
+        {
+            [[maybe_unused]] const auto result{commit_group(group)};
+        }
+        std::lock_guard<std::mutex> guard{mutex_};
+        if (!first_error_.empty())
+        {
+            return std::unexpected{first_error_};
+        }
+        return {};
+    }
+
+    [[nodiscard]] bool durable() const noexcept
+    {
+#ifdef __linux__
+        return options_.enabled;
+#else
+        return false;
+#endif
+    }
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    struct pending
+    {
+        std::filesystem::path temporary;
+        std::filesystem::path target;
+    };
+
+    [[nodiscard]] eresult<void> commit_group(const std::vector<pending> &group) noexcept
+    {
+        std::string error{};
+#ifdef __linux__
+        const auto sync_file{[&](const std::filesystem::path &path, const bool whole_filesystem) {
+            const int fd{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+            if ((fd < 0 || (whole_filesystem ? ::syncfs(fd) : ::fdatasync(fd)) != 0) && error.empty())
+            {
+                error = std::format("{}: {}", path.string(), std::generic_category().message(errno));
+            }
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }};
+
+        // `syncfs` only covers the filesystem of the file it is given, so a group spanning several syncs file by file
+        const auto one_filesystem{[&] {
+            struct stat front{};
+            if (::stat(group.front().temporary.c_str(), &front) != 0)
+            {
+                return false;
+            }
+            return std::ranges::all_of(group, [&](const pending &output) {
+                struct stat status{};
+                return ::stat(output.temporary.c_str(), &status) == 0 && status.st_dev == front.st_dev;
+            });
+        }};
+
+        // Data first, so no rename can expose a file whose contents are not yet on disk
+        if (group.size() >= options_.syncfs_threshold && one_filesystem())
+        {
+            sync_file(group.front().temporary, true); // each output shares its filesystem with its temporary
+        }
+        else
+        {
+            for (const auto &output : group)
+            {
+                sync_file(output.temporary, false);
+            }
+        }
+        if (error.empty())
+        {
+            std::set<std::filesystem::path> directories;
+            for (const auto &output : group)
+            {
+                std::error_code rename_error;
+                std::filesystem::rename(output.temporary, output.target, rename_error);
+                if (rename_error)
+                {
+                    if (error.empty())
+                    {
+                        error = std::format("{}: {}", output.target.string(), rename_error.message());
+                    }
+                    std::filesystem::remove(output.temporary, rename_error);
+                    continue;
+                }
+                directories.insert(output.target.parent_path());
+            }
+            for (const auto &directory : directories) // makes the renames themselves durable
+            {
+                const int fd{::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+                if ((fd < 0 || ::fsync(fd) != 0) && error.empty())
+                {
+                    error = std::format("{}: {}", directory.string(), std::generic_category().message(errno));
+                }
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                }
+            }
+        }
+        else
+        {
+            // None of the group is known to be on disk, so no target is replaced and no temporary is left behind
+            for (const auto &output : group)
+            {
+                std::error_code ignored;
+                std::filesystem::remove(output.temporary, ignored);
+            }
+        }
+#endif
+        if (error.empty())
+        {
+            return {};
+        }
+        std::lock_guard<std::mutex> guard{mutex_};
+        if (first_error_.empty())
+        {
+            first_error_ = error;
+        }
+        return std::unexpected{std::move(error)};
+    }
+
+    const durability_options options_;
+    std::mutex mutex_;
+    std::vector<pending> pending_;
+    clock::time_point oldest_{};
+    std::string first_error_;
+};
+} // namespace tprotect
@@ -0,0 +1,203 @@
+// entropy_strip.hpp: Zoomable Custom-Draw Strip Of A File's Entropy Map
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <format>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <imgui.h>
+
+#include <tprotect/cipher/entropy_map.hpp>
+
+namespace tprotect
+{
+/**
+ * @brief A horizontal strip of an entropy map, one column per pixel, zoomed with the mouse wheel and panned by dragging
+ *
+ * The top band shades each column by entropy, from the frame background at 0 bits to the histogram colour at 8, and
+ * the bottom band marks text-like columns. Like `frequency_chart`, the strip is one run of vertices in strip-local
+ * coordinates, rebuilt only when the map, the view or the size changes, so a map of millions of blocks costs one
+ * resample per zoom step rather than per frame
+ *
+ */
+class entropy_strip
+{
+  public:
+    // Show `map` whole
+    void set_map(std::shared_ptr<const cipher::entropy_map> map) noexcept
+    {
+        map_ = std::move(map);
+        first_ = 0.;
+        span_ = map_ ? static_cast<double>(map_->blocks().size()) : 0.;
+        dirty_ = true;
+    }
+
+    [[nodiscard]] const std::shared_ptr<const cipher::entropy_map> &map() const noexcept
+    {
+        return map_;
+    }
+
+    // Scroll blocks [first, end) into the middle of the view, zooming in if they would not fit
+    void show(const std::size_t first, const std::size_t end) noexcept
+    {
+        if (!map_)
+        {
+            return;
+        }
+        span_ = std::max(span_, static_cast<double>(end - first) * 2.);
+        first_ = (static_cast<double>(first + end) - span_) / 2.;
+        clamp_view();
+        dirty_ = true;
+    }
+
+    /**
+     * @brief Reserve `size` in the current window and draw the strip there
+     *
+     * @return the block clicked this frame, if any
+     */
+    std::optional<std::size_t> draw(const char *const id, ImVec2 size) noexcept
+    {
+        const auto available{ImGui::GetContentRegionAvail()};
+        size.x = size.x > 0.f ? size.x : std::max(1.f, available.x);
+        size.y = size.y > 0.f ? size.y : std::max(1.f, available.y);
+
+        const auto origin{ImGui::GetCursorScreenPos()};
+        ImGui::InvisibleButton(id, size);
+        if (!map_ || map_->blocks().empty())
+        {
+            return std::nullopt;
+        }
+
+        // Zoom around the block under the cursor, and pan by the dragged distance
+        const auto &io{ImGui::GetIO()};
+        const auto column_at{[&](const float x) {
+            return first_ + static_cast<double>(x - origin.x) / size.x * span_;
+        }};
+        if (ImGui::IsItemHovered() && io.MouseWheel != 0.f)
+        {
+            const double anchor{column_at(io.MousePos.x)};
+            span_ = std::max(1., span_ * std::pow(.8, static_cast<double>(io.MouseWheel)));
+            first_ = anchor - static_cast<double>(io.MousePos.x - origin.x) / size.x * span_;
+            clamp_view();
+            dirty_ = true;
+        }
+        if (ImGui::IsItemActive() && io.MouseDelta.x != 0.f)
+        {
+            first_ -= static_cast<double>(io.MouseDelta.x) / size.x * span_;
+            clamp_view();
+            dirty_ = true;
+            dragged_ = true;
+        }
+
+        if (dirty_ || size.x != size_.x || size.y != size_.y)
+        {
+            rebuild(size);
+        }
+
+        // Replay the cached geometry as a single primitive run
+        auto *const draw_list{ImGui::GetWindowDrawList()};
+        const auto white_pixel{ImGui::GetFontTexUvWhitePixel()};
+        draw_list->PrimReserve(static_cast<int>(indices_.size()), static_cast<int>(vertices_.size()));
+        const auto base{draw_list->_VtxCurrentIdx};
+        for (const auto &vertex : vertices_)
+        {
+            *draw_list->_VtxWritePtr++ = {{origin.x + vertex.pos.x, origin.y + vertex.pos.y}, white_pixel, vertex.col};
+        }
+        for (const auto index : indices_)
+        {
+            *draw_list->_IdxWritePtr++ = static_cast<ImDrawIdx>(base + index);
+        }
+        draw_list->_VtxCurrentIdx += static_cast<unsigned int>(vertices_.size());
+
+        const auto block_count{map_->blocks().size()};
+        const auto block{static_cast<std::size_t>(
+            std::clamp(column_at(io.MousePos.x), 0., static_cast<double>(block_count - 1)))};
+        if (ImGui::IsItemHovered())
+        {
+            const auto &statistics{map_->blocks()[block]};
+            ImGui::SetTooltip("%s", std::format("Bytes {}-{}\nEntropy {:.2f} bits, {:.0f}% printable\nIndex of "
+                                                "coincidence {:.4f}{}",
+                                                block * map_->block_size(),
+                                                std::min(map_->size(), (block + 1) * map_->block_size()),
+                                                statistics.entropy, statistics.printable * 100.f,
+                                                statistics.coincidence, statistics.text_like() ? "\nText-like" : "")
+                                        .c_str());
+        }
+
+        // A click loads the block, a drag only pans
+        if (ImGui::IsItemDeactivated())
+        {
+            return std::exchange(dragged_, false) ? std::nullopt : std::optional{block};
+        }
+        return std::nullopt;
+    }
+
+  private:
+    void clamp_view() noexcept
+    {
+        const auto count{static_cast<double>(map_->blocks().size())};
+        span_ = std::clamp(span_, 1., std::max(1., count));
+        first_ = std::clamp(first_, 0., std::max(0., count - span_));
+    }
+
+    void add_rect(const ImVec2 min, const ImVec2 max, const ImU32 color) noexcept
+    {
+        const auto first{static_cast<ImDrawIdx>(vertices_.size())};
+        vertices_.push_back({min, {}, color});
+        vertices_.push_back({{max.x, min.y}, {}, color});
+        vertices_.push_back({max, {}, color});
+        vertices_.push_back({{min.x, max.y}, {}, color});
+        for (const int corner : {0, 1, 2, 0, 2, 3})
+        {
+            indices_.push_back(static_cast<ImDrawIdx>(first + corner));
+        }
+    }
+
+    void rebuild(const ImVec2 size) noexcept
+    {
+        size_ = size;
+        dirty_ = false;
+        vertices_.clear();
+        indices_.clear();
+
+        // One column per pixel, so the vertex count stays within 16-bit indices on any screen
+        const auto columns{static_cast<std::size_t>(std::max(1.f, std::floor(size.x)))};
+        const auto first{static_cast<std::size_t>(first_)};
+        const auto last{static_cast<std::size_t>(std::ceil(first_ + span_))};
+        const auto statistics{map_->resample(first, last, columns)};
+
+        const auto &style{ImGui::GetStyle()};
+        const auto low{style.Colors[ImGuiCol_FrameBg]};
+        const auto high{style.Colors[ImGuiCol_PlotHistogram]};
+        const auto text_color{ImGui::GetColorU32(ImGuiCol_PlotLines)};
+        const float band{size.y * .75f}, column_width{size.x / static_cast<float>(columns)};
+        for (std::size_t i{}; i < columns; ++i)
+        {
+            const float left{static_cast<float>(i) * column_width}, right{left + column_width};
+            const float t{std::clamp(statistics[i].entropy / 8.f, 0.f, 1.f)};
+            const ImVec4 color{low.x + (high.x - low.x) * t, low.y + (high.y - low.y) * t,
+                               low.z + (high.z - low.z) * t, 1.f};
+            add_rect({left, 0.f}, {right, band}, ImGui::GetColorU32(color));
+            if (statistics[i].text_like())
+            {
+                add_rect({left, band}, {right, size.y}, text_color);
+            }
+        }
+    }
+
+    std::shared_ptr<const cipher::entropy_map> map_;
+    double first_{};   // the first block in view, fractional while zooming
+    double span_{};    // how many blocks the view covers
+    bool dirty_{true};
+    bool dragged_{};   // whether the current press moved the view, so releasing it is not a click
+    ImVec2 size_{};
+    std::vector<ImDrawVert> vertices_; // strip-local positions; the UV is filled in when replayed
+    std::vector<ImDrawIdx> indices_;
+};
+} // namespace tprotect
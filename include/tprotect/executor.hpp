@@ -0,0 +1,429 @@
+// executor.hpp: Priority-Aware Work-Stealing Thread Pool
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <tprotect/topology.hpp>
+
+namespace tprotect
+{
+/**
+ * @brief Scheduling classes, most urgent first
+ *
+ * Workers always drain every queue of a more urgent class before touching a less urgent one, so a frame's worth of
+ * interactive work is never stuck behind a batch job
+ *
+ */
+enum class priority
+{
+    interactive, // the user is waiting on it, e.g. GUI analysis
+    background,  // long-running analysis started from the GUI
+    batch,       // headless bulk work
+};
+
+/**
+ * @brief A flag that long-running work polls to stop early
+ *
+ * Default-constructed tokens can never be cancelled
+ *
+ */
+class cancellation_token
+{
+  public:
+    cancellation_token() noexcept = default;
+
+    [[nodiscard]] bool cancelled() const noexcept
+    {
+        return flag_ && flag_->load(std::memory_order_relaxed);
+    }
+
+  private:
+    friend class cancellation_source;
+    explicit cancellation_token(std::shared_ptr<std::atomic<bool>> flag) noexcept : flag_{std::move(flag)}
+    {
+    }
+
+    std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+class cancellation_source
+{
+  public:
+    [[nodiscard]] cancellation_token token() const noexcept
+    {
+        return cancellation_token{flag_};
+    }
+
+    void cancel() noexcept
+    {
+        flag_->store(true, std::memory_order_relaxed);
+    }
+
+  private:
+    std::shared_ptr<std::atomic<bool>> flag_{std::make_shared<std::atomic<bool>>()};
+};
+
+/**
+ * @brief The process-wide thread pool
+ *
+ * The singleton should be acquired by `executor::instance()`. Each worker owns one deque per priority: it pushes and
+ * pops its own work at the back and steals from the front of other workers' deques. Work submitted from outside the
+ * pool goes to a shared injection queue per priority.
+ *
+ * Tasks inherit the priority of whoever submits them: on a worker that is the priority of the running task, elsewhere
+ * it is the thread's default set by `set_thread_priority()`
+ *
+ * With a multi-node topology, workers are assigned to nodes (and optionally pinned to their CPU), and fork-join calls
+ * split their index range into one contiguous share per node. Threads drain their own node's share before helping
+ * elsewhere, so passes over the same range keep each chunk on one node: the pages first touched by a node are later
+ * read by that node
+ *
+ */
+class executor final
+{
+  public:
+    using task = std::function<void()>;
+
+    /**
+     * @brief Acquire the singleton
+     *
+     * One worker per hardware thread, less the thread that usually submits and joins the work
+     *
+     * @return executor& the singleton
+     */
+    static executor &instance() noexcept
+    {
+        static executor instance{std::max<std::size_t>(1, std::thread::hardware_concurrency()) - 1,
+                                 std::move(default_topology().topology), default_topology().pin};
+        return instance;
+    }
+
+    /**
+     * @brief Make the singleton topology-aware; only effective before its first use
+     *
+     * @param pin also pin each worker to one CPU
+     */
+    static void use_topology(cpu_topology topology, const bool pin) noexcept
+    {
+        default_topology() = {std::move(topology), pin};
+    }
+
+    explicit executor(const std::size_t worker_count, cpu_topology topology = {}, const bool pin = false) noexcept
+        : workers_(worker_count), topology_{std::move(topology)}
+    {
+        const auto cpus{topology_.assign(worker_count)};
+        worker_nodes_.reserve(worker_count);
+        for (const int cpu : cpus)
+        {
+            worker_nodes_.push_back(topology_.node_of(cpu));
+        }
+        threads_.reserve(worker_count);
+        for (std::size_t i{}; i < worker_count; ++i)
+        {
+            threads_.emplace_back([this, i, cpu = pin ? cpus[i] : -1] {
+                if (cpu >= 0)
+                {
+                    cpu_topology::pin_current_thread(cpu);
+                }
+                run_worker(i);
+            });
+        }
+    }
+
+    ~executor()
+    {
+        {
+            std::lock_guard<std::mutex> guard{sleep_mutex_};
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        threads_.clear(); // join
+    }
+
+    // Disable copying and moving
+    executor(const executor &) noexcept = delete;
+    executor &operator=(const executor &) noexcept = delete;
+    executor(executor &&) noexcept = delete;
+    executor &operator=(executor &&) noexcept = delete;
+
+    [[nodiscard]] std::size_t worker_count() const noexcept
+    {
+        return workers_.size();
+    }
+
+    [[nodiscard]] const cpu_topology &topology() const noexcept
+    {
+        return topology_;
+    }
+
+    /**
+     * @brief Get a slot index unique among the threads that can run one fork-join call at the same time
+     *
+     * @return std::size_t the worker index on pool threads, `worker_count()` elsewhere
+     */
+    [[nodiscard]] std::size_t current_slot() const noexcept
+    {
+        return current_owner() == this ? current_worker() : worker_count();
+    }
+
+    static void set_thread_priority(const priority value) noexcept
+    {
+        current_priority() = value;
+    }
+
+    [[nodiscard]] static priority thread_priority() noexcept
+    {
+        return current_priority();
+    }
+
+    // Run `work` on the pool, fire and forget
+    void submit(task work, const priority level = thread_priority()) noexcept
+    {
+        if (workers_.empty())
+        {
+            work(); // nobody else could run it
+            return;
+        }
+
+        const auto index{static_cast<std::size_t>(level)};
+        if (current_owner() == this)
+        {
+            auto &worker{workers_[current_worker()]};
+            std::lock_guard<std::mutex> guard{worker.mutex};
+            worker.queues[index].push_back(std::move(work));
+        }
+        else
+        {
+            std::lock_guard<std::mutex> guard{injection_mutex_};
+            injection_[index].push_back(std::move(work));
+        }
+        pending_.fetch_add(1, std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> guard{sleep_mutex_}; // a worker between its last look and its wait must see it
+        }
+        wake_.notify_one();
+    }
+
+    // Run `work` on the pool and get its result later
+    template <typename F> [[nodiscard]] auto async(F &&work, const priority level = thread_priority()) noexcept
+    {
+        using result_type = std::invoke_result_t<F>;
+        auto packaged{std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(work))};
+        auto future{packaged->get_future()};
+        submit([packaged] { (*packaged)(); }, level);
+        return future;
+    }
+
+    /**
+     * @brief Run `body(index, slot)` for every index in [0, count), and return when all have run
+     *
+     * The calling thread takes indices itself while helpers on the pool take the rest, so nesting fork-join calls
+     * inside pool tasks cannot deadlock: a helper that starts after the indices ran out returns immediately, and the
+     * caller only waits for helpers that actually started. `slot` is in [0, worker_count()] and unique among the
+     * threads running this call, so it can address per-thread accumulators without locking. With several nodes,
+     * index `i` is preferentially run on node `i * node_count / count`
+     *
+     */
+    template <typename F>
+    void for_each_index(const std::size_t count, F &&body, const cancellation_token &token = {},
+                        const priority level = thread_priority()) noexcept
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        struct shared_state
+        {
+            explicit shared_state(const std::size_t nodes) noexcept : next(nodes)
+            {
+            }
+
+            std::vector<std::atomic<std::size_t>> next; // per node, relative to the start of its share
+            std::atomic<std::size_t> active{};
+            std::atomic<bool> closed{};
+            std::mutex mutex;
+            std::condition_variable done;
+        };
+        const std::size_t nodes{std::min(topology_.node_count(), count)};
+        const auto state{std::make_shared<shared_state>(nodes)};
+        const auto drain{[this, state, count, nodes, &body, &token](const std::size_t slot) {
+            const std::size_t home{node_of_slot(slot) % nodes};
+            for (std::size_t n{}; n < nodes; ++n) // own share first, then help the others
+            {
+                const std::size_t node{(home + n) % nodes};
+                const std::size_t begin{count * node / nodes}, end{count * (node + 1) / nodes};
+                auto &next{state->next[node]};
+                for (std::size_t i{begin + next.fetch_add(1, std::memory_order_relaxed)}; i < end && !token.cancelled();
+                     i = begin + next.fetch_add(1, std::memory_order_relaxed))
+                {
+                    body(i, slot);
+                }
+            }
+        }};
+
+        const std::size_t helpers{std::min(worker_count(), count - 1)};
+        for (std::size_t i{}; i < helpers; ++i)
+        {
+            submit(
+                [this, state, drain] {
+                    {
+                        std::lock_guard<std::mutex> guard{state->mutex};
+                        if (state->closed.load(std::memory_order_relaxed))
+                        {
+                            return; // the caller already finished; `drain` may be dangling
+                        }
+                        state->active.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    drain(current_slot());
+                    {
+                        std::lock_guard<std::mutex> guard{state->mutex};
+                        state->active.fetch_sub(1, std::memory_order_relaxed);
+                    }
+                    state->done.notify_all();
+                },
+                level);
+        }
+
+        drain(current_slot());
+
+        std::unique_lock<std::mutex> lock{state->mutex};
+        state->closed.store(true, std::memory_order_relaxed);
+        state->done.wait(lock, [&] { return state->active.load(std::memory_order_relaxed) == 0; });
+    }
+
+  private:
+    struct worker
+    {
+        std::mutex mutex;
+        std::array<std::deque<task>, 3> queues; // indexed by `priority`
+    };
+
+    static executor *&current_owner() noexcept
+    {
+        thread_local executor *owner{};
+        return owner;
+    }
+
+    static std::size_t &current_worker() noexcept
+    {
+        thread_local std::size_t index{};
+        return index;
+    }
+
+    static priority &current_priority() noexcept
+    {
+        thread_local priority value{priority::background};
+        return value;
+    }
+
+    struct topology_options
+    {
+        cpu_topology topology;
+        bool pin;
+    };
+
+    static topology_options &default_topology() noexcept
+    {
+        static topology_options options{};
+        return options;
+    }
+
+    [[nodiscard]] std::size_t node_of_slot(const std::size_t slot) const noexcept
+    {
+        return slot < worker_nodes_.size() ? worker_nodes_[slot] : topology_.current_node();
+    }
+
+    // Find the most urgent task: own deque (newest first), then the injection queue, then steal (oldest first)
+    [[nodiscard]] bool take(const std::size_t self, task &work, priority &level) noexcept
+    {
+        for (std::size_t p{}; p < 3; ++p)
+        {
+            {
+                auto &own{workers_[self]};
+                std::lock_guard<std::mutex> guard{own.mutex};
+                if (!own.queues[p].empty())
+                {
+                    work = std::move(own.queues[p].back());
+                    own.queues[p].pop_back();
+                    level = static_cast<priority>(p);
+                    return true;
+                }
+            }
+            {
+                std::lock_guard<std::mutex> guard{injection_mutex_};
+                if (!injection_[p].empty())
+                {
+                    work = std::move(injection_[p].front());
+                    injection_[p].pop_front();
+                    level = static_cast<priority>(p);
+                    return true;
+                }
+            }
+            for (std::size_t offset{1}; offset < workers_.size(); ++offset)
+            {
+                auto &victim{workers_[(self + offset) % workers_.size()]};
+                std::lock_guard<std::mutex> guard{victim.mutex};
+                if (!victim.queues[p].empty())
+                {
+                    work = std::move(victim.queues[p].front());
+                    victim.queues[p].pop_front();
+                    level = static_cast<priority>(p);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void run_worker(const std::size_t self) noexcept
+    {
+        current_owner() = this;
+        current_worker() = self;
+
+        while (true)
+        {
+            task work;
+            priority level{};
+            if (take(self, work, level))
+            {
+                pending_.fetch_sub(1, std::memory_order_acquire);
+                current_priority() = level;
+                work();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock{sleep_mutex_};
+            wake_.wait(lock, [this] { return stopping_ || pending_.load(std::memory_order_acquire) > 0; });
+            if (stopping_)
+            {
+                return;
+            }
+        }
+    }
+
+    std::vector<worker> workers_;
+    cpu_topology topology_;
+    std::vector<std::size_t> worker_nodes_;
+    std::mutex injection_mutex_;
+    std::array<std::deque<task>, 3> injection_;
+    std::atomic<std::size_t> pending_{};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool stopping_{};
+    std::vector<std::jthread> threads_; // last, so workers are joined before the queues go away
+};
+} // namespace tprotect
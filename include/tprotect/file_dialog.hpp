@@ -2,46 +2,13 @@
 
 #pragma once
 
-#include <algorithm>
-#include <expected>
-#include <fstream>
-
 #include <ImGuiFileDialog.h>
 
+#include <tprotect/file_io.hpp>
 #include <tprotect/global.hpp>
 
 namespace tprotect
 {
-[[nodiscard]] inline eresult<std::string> read_file(const std::string &file_name) noexcept
-{
-    std::ifstream ifs{file_name};
-    if (!ifs)
-    {
-        return std::unexpected{"Failed to open file"};
-    }
-    std::string result{std::istreambuf_iterator{ifs}, {}}; // read file using iterators
-    if (!ifs)
-    {
-        return std::unexpected{"Failed to read file"};
-    }
-    return {result};
-}
-
-[[nodiscard]] inline eresult<void> write_file(const std::string &file_name, const std::string &content) noexcept
-{
-    std::ofstream ofs{file_name};
-    if (!ofs)
-    {
-        return std::unexpected{"Failed to open file"};
-    }
-    std::ranges::copy(content, std::ostreambuf_iterator{ofs}); // write file using iterators
-    if (!ofs)
-    {
-        return std::unexpected{"Failed to write file"};
-    }
-    return {};
-}
-
 [[nodiscard]] inline oresult<std::string> display_file_dialog(const std::string &key) noexcept
 {
     if (const auto instance{ImGuiFileDialog::Instance()};
@@ -56,22 +23,30 @@ namespace tprotect
     return std::nullopt;
 }
 
-[[nodiscard]] inline eresult<void> read_file_dialog(const std::string &key, std::string &content) noexcept
+// The result holds whether `content` was replaced; `format` receives the encoding and line endings it was stored in
+[[nodiscard]] inline eresult<bool> read_file_dialog(const std::string &key, std::string &content,
+                                                    text_format &format) noexcept
 {
     return display_file_dialog(key)
-        .and_then([&](const std::string &file_path) -> std::optional<eresult<void>> {
-            return read_file(file_path).transform([&](std::string file_content) {
-                content = std::move(file_content); // if succeeding, overwriting the content
-            });
+        .and_then([&](const std::string &file_path) -> std::optional<eresult<bool>> {
+            return read_text_file(file_path)
+                .transform([&](text_file file) {
+                    content = std::move(file.text); // if succeeding, overwriting the content
+                    format = file.format;
+                    return true;
+                })
+                .transform_error(&compact_error::message);
         })
-        .value_or({});
+        .value_or(false);
 }
 
-[[nodiscard]] inline eresult<void> write_file_dialog(const std::string &key, const std::string &content) noexcept
+// Save `content` stored as `format`, normally that of the file it was loaded from
+[[nodiscard]] inline eresult<void> write_file_dialog(const std::string &key, const std::string &content,
+                                                     const text_format &format = {}) noexcept
 {
     return display_file_dialog(key)
         .and_then([&](const std::string &file_path) -> std::optional<eresult<void>> {
-            return write_file(file_path, content);
+            return write_text_file(file_path, content, format).transform_error(&compact_error::message);
         })
         .value_or({});
 }
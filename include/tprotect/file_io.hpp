@@ -0,0 +1,77 @@
+// file_io.hpp: Whole-File Reading And Writing
+
+#pragma once
+
+#include <algorithm>
+#include <expected>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include <tprotect/global.hpp>
+#include <tprotect/mapped_file.hpp>
+#include <tprotect/text_encoding.hpp>
+
+namespace tprotect
+{
+[[nodiscard]] inline cresult<std::string> read_file(const std::string &file_name) noexcept
+{
+    std::ifstream ifs{file_name};
+    if (!ifs)
+    {
+        return std::unexpected{compact_error{errc::open_failed, file_name}};
+    }
+    std::string result{std::istreambuf_iterator{ifs}, {}}; // read file using iterators
+    if (!ifs)
+    {
+        return std::unexpected{compact_error{errc::read_failed, file_name}};
+    }
+    return {result};
+}
+
+[[nodiscard]] inline cresult<void> write_file(const std::string &file_name, const std::string &content) noexcept
+{
+    std::ofstream ofs{file_name};
+    if (!ofs)
+    {
+        return std::unexpected{compact_error{errc::open_failed, file_name}};
+    }
+    std::ranges::copy(content, std::ostreambuf_iterator{ofs}); // write file using iterators
+    if (!ofs)
+    {
+        return std::unexpected{compact_error{errc::write_failed, file_name}};
+    }
+    return {};
+}
+/**
+ * @brief A text file decoded to UTF-8 with LF line endings, and how it was stored
+ *
+ */
+struct text_file
+{
+    std::string text;
+    text_format format;
+};
+
+// Read a text file in whatever encoding and line endings it has, decoding straight from its mapping
+[[nodiscard]] inline cresult<text_file> read_text_file(const std::string &file_name) noexcept
+{
+    return mapped_file::open(file_name).transform([](const mapped_file &file) {
+        const auto format{detect_text_format(file.view())};
+        return text_file{decode_text(file.view(), format), format};
+    });
+}
+
+// Just the text of `read_text_file()`, for inputs that are analyzed rather than saved back
+[[nodiscard]] inline cresult<std::string> read_decoded_file(const std::string &file_name) noexcept
+{
+    return read_text_file(file_name).transform([](text_file file) { return std::move(file.text); });
+}
+
+// Write UTF-8 text with LF line endings back in the given encoding and line endings
+[[nodiscard]] inline cresult<void> write_text_file(const std::string &file_name, const std::string_view text,
+                                                   const text_format &format) noexcept
+{
+    return encode_text(text, format).and_then([&](const std::string &bytes) { return write_file(file_name, bytes); });
+}
+} // namespace tprotect
@@ -0,0 +1,304 @@
+// follow.hpp: Encrypting A Growing File As It Is Written
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <tprotect/executor.hpp>
+#include <tprotect/global.hpp>
+#include <tprotect/latency_histogram.hpp>
+
+namespace tprotect
+{
+struct follow_options
+{
+    bool from_start{};                     // otherwise only bytes appended after starting are followed
+    std::chrono::milliseconds idle_exit{}; // stop after this long without input; zero follows forever
+    std::size_t max_batch{1 << 20};        // appended bytes read before a batch is written
+};
+
+struct follow_report
+{
+    std::uint64_t lines;
+    std::uint64_t bytes;
+    std::uint64_t batches; // writes to the output, each holding every complete line read since the last
+    std::uint64_t truncations;
+    std::uint64_t rotations;
+    latency_histogram latency; // per line, from reading it to having written it
+};
+
+/**
+ * @brief Like `tail -f`: apply `transform` to complete lines as they are appended to `path` and write them to `output`
+ *
+ * inotify wakes the loop on `IN_MODIFY`, and only the bytes past the last read offset are read. All complete lines
+ * available at a wakeup are transformed together and written with one `write`, so a burst of short lines costs one
+ * system call rather than one each; a trailing partial line waits for its newline. A file that shrinks is read again
+ * from the start, and a file that is renamed or deleted and then recreated, as log rotation does, is drained and
+ * then followed under its name afresh. Runs until `token` is cancelled or the file stays idle for `idle_exit`
+ *
+ * @param output_path appended to, or standard output if empty
+ */
+[[nodiscard]] inline eresult<follow_report> follow_file(
+    const std::filesystem::path &path, const std::filesystem::path &output_path,
+    const std::function<cresult<std::string>(std::string_view)> &transform, const follow_options &options = {},
+    const cancellation_token &token = {}) noexcept
+{
+#ifdef __linux__
+    using clock = std::chrono::steady_clock;
+    const auto system_error{[](const std::string &what) -> eresult<follow_report> {
+        return std::unexpected{std::format("{}: {}", what, std::generic_category().message(errno))};
+    }};
+
+    const int output{output_path.empty()
+                         ? STDOUT_FILENO
+                         : ::open(output_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600)};
+    if (output < 0)
+    {
+        return system_error(output_path.string());
+    }
+    const auto close_output{[&] {
+        if (output != STDOUT_FILENO)
+        {
+            ::close(output);
+        }
+    }};
+    const int events{::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)};
+    if (events < 0)
+    {
+        close_output();
+        return system_error("inotify_init1");
+    }
+    const auto directory{path.has_parent_path() ? path.parent_path() : std::filesystem::path{"."}};
+    const auto name{path.filename().string()};
+    const int directory_watch{::inotify_add_watch(events, directory.c_str(), IN_CREATE | IN_MOVED_TO)};
+
+    follow_report report{};
+    int input{-1}, file_watch{-1};
+    std::uint64_t offset{};
+    std::string pending; // read but not yet written: at most a partial line between batches
+    std::string error{};
+
+    const auto close_input{[&] {
+        if (file_watch >= 0)
+        {
+            ::inotify_rm_watch(events, file_watch);
+            file_watch = -1;
+        }
+        if (input >= 0)
+        {
+            ::close(input);
+            input = -1;
+        }
+    }};
+    const auto open_input{[&](const bool at_end) {
+        input = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (input < 0)
+        {
+            return false;
+        }
+        file_watch = ::inotify_add_watch(events, path.c_str(), IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF);
+        struct stat status{};
+        offset = at_end && ::fstat(input, &status) == 0 ? static_cast<std::uint64_t>(status.st_size) : 0;
+        pending.clear();
+        return true;
+    }};
+    const auto write_all{[&](std::string_view bytes) {
+        while (!bytes.empty())
+        {
+            const auto written{::write(output, bytes.data(), bytes.size())};
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                return false;
+            }
+            bytes.remove_prefix(static_cast<std::size_t>(written));
+        }
+        return true;
+    }};
+
+    // Read what was appended, then transform and write its complete lines as one batch
+    std::array<char, 64 * 1024> buffer{};
+    const auto drain{[&] {
+        if (input < 0)
+        {
+            return true;
+        }
+        struct stat status{};
+        if (::fstat(input, &status) == 0 && static_cast<std::uint64_t>(status.st_size) < offset)
+        {
+            report.truncations++;
+            offset = 0;
+            pending.clear();
+        }
+        while (true)
+        {
+            const auto read_at{clock::now()};
+            bool exhausted{};
+            while (pending.size() < options.max_batch)
+            {
+                const auto count{::pread(input, buffer.data(), buffer.size(), static_cast<off_t>(offset))};
+                if (count <= 0)
+                {
+                    exhausted = true;
+                    break;
+                }
+                pending.append(buffer.data(), static_cast<std::size_t>(count));
+                offset += static_cast<std::uint64_t>(count);
+            }
+            auto end{pending.rfind('\n')};
+            if (end == std::string::npos)
+            {
+                if (pending.size() < options.max_batch)
+                {
+                    return true; // wait for the rest of the line
+                }
+                end = pending.size() - 1; // a line longer than a batch is passed on in pieces
+            }
+
+            const std::string_view lines{std::string_view{pending}.substr(0, end + 1)};
+            const auto line_count{static_cast<std::uint64_t>(std::ranges::count(lines, '\n'))};
+            const auto transformed{transform(lines)};
+            if (!transformed)
+            {
+                error = transformed.error().message();
+                return false;
+            }
+            if (!write_all(*transformed))
+            {
+                error = std::format("Failed to write output: {}", std::generic_category().message(errno));
+                return false;
+            }
+            report.latency.record(clock::now() - read_at, line_count);
+            report.lines += line_count;
+            report.bytes += lines.size();
+            report.batches++;
+            pending.erase(0, end + 1);
+            if (exhausted)
+            {
+                return true;
+            }
+        }
+    }};
+
+    if (!open_input(!options.from_start))
+    {
+        auto failure{system_error(path.string())};
+        ::close(events);
+        close_output();
+        return failure;
+    }
+
+    auto last_input{clock::now()};
+    alignas(inotify_event) std::array<char, 16 * (sizeof(inotify_event) + 256)> event_buffer{};
+    while (error.empty() && !token.cancelled())
+    {
+        if (!drain())
+        {
+            break;
+        }
+
+        pollfd watched{events, POLLIN, 0};
+        const int ready{::poll(&watched, 1, 100)}; // wakes periodically to notice cancellation
+        if (ready < 0 && errno != EINTR)
+        {
+            error = std::format("poll: {}", std::generic_category().message(errno));
+            break;
+        }
+        if (ready <= 0)
+        {
+            if (options.idle_exit.count() > 0 && clock::now() - last_input >= options.idle_exit)
+            {
+                break;
+            }
+            continue;
+        }
+        last_input = clock::now();
+
+        bool replaced{};
+        for (ssize_t length; (length = ::read(events, event_buffer.data(), event_buffer.size())) > 0;)
+        {
+            for (std::size_t at{}; at < static_cast<std::size_t>(length);)
+            {
+                const auto *const event{reinterpret_cast<const inotify_event *>(event_buffer.data() + at)};
+                if (event->wd == file_watch && (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF)) != 0)
+                {
+                    replaced = true;
+                }
+                if (event->wd == directory_watch && event->len > 0 && name == event->name)
+                {
+                    replaced = true; // created or moved into place under the followed name
+                }
+                at += sizeof(inotify_event) + event->len;
+            }
+        }
+        if (replaced)
+        {
+            // Finish the old file first; its last partial line is flushed as is, since no more can follow
+            if (!drain())
+            {
+                break;
+            }
+            if (!pending.empty())
+            {
+                const auto tail{transform(pending)};
+                if (!tail)
+                {
+                    error = tail.error().message();
+                    break;
+                }
+                if (!write_all(*tail))
+                {
+                    error = std::format("Failed to write output: {}", std::generic_category().message(errno));
+                    break;
+                }
+                report.bytes += pending.size();
+                report.batches++;
+                pending.clear();
+            }
+            close_input();
+            if (open_input(false))
+            {
+                report.rotations++;
+            }
+        }
+    }
+
+    drain();
+    close_input();
+    if (directory_watch >= 0)
+    {
+        ::inotify_rm_watch(events, directory_watch);
+    }
+    ::close(events);
+    close_output();
+    if (!error.empty())
+    {
+        return std::unexpected{std::move(error)};
+    }
+    return report;
+#else
+    return std::unexpected{"Following files needs inotify, which only Linux has"};
+#endif
+}
+} // namespace tprotect
@@ -0,0 +1,237 @@
+// frequency_chart.hpp: Batched Custom-Draw Charts For Letter Statistics
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <format>
+#include <span>
+#include <vector>
+
+#include <imgui.h>
+
+namespace tprotect
+{
+/**
+ * @brief A letter-indexed bar chart or heatmap drawn straight into the window draw list
+ *
+ * The whole chart is one run of vertices and indices, built in chart-local coordinates and kept until the data or
+ * the size changes. Each frame only offsets the cached vertices into the draw list, so the cost does not grow with
+ * widgets per bin; axis labels and the tooltip are the only per-frame text
+ *
+ */
+class frequency_chart
+{
+  public:
+    /**
+     * @brief Show one bar per letter, with optional reference markers (e.g. English frequencies)
+     *
+     * @param values percentages, one per letter
+     * @param reference percentages in the same order, or empty
+     */
+    void set_bars(const std::span<const float> values, const std::span<const float> reference = {}) noexcept
+    {
+        update(kind::bars, values, reference, 1);
+    }
+
+    /**
+     * @brief Show a `columns`-wide grid of cells, shaded by value (e.g. 26x26 bigram percentages)
+     */
+    void set_heatmap(const std::span<const float> values, const std::size_t columns) noexcept
+    {
+        update(kind::heatmap, values, {}, std::max<std::size_t>(1, columns));
+    }
+
+    /**
+     * @brief Reserve `size` in the current window and draw the chart there
+     *
+     * @param size as for `ImGui::InvisibleButton`, non-positive components stretch to the available region
+     */
+    void draw(const char *const id, ImVec2 size) noexcept
+    {
+        const auto available{ImGui::GetContentRegionAvail()};
+        size.x = size.x > 0.f ? size.x : std::max(1.f, available.x);
+        size.y = size.y > 0.f ? size.y : std::max(1.f, available.y);
+
+        const auto origin{ImGui::GetCursorScreenPos()};
+        ImGui::InvisibleButton(id, size);
+        if (values_.empty())
+        {
+            return;
+        }
+
+        const float label_height{ImGui::GetTextLineHeight()};
+        const ImVec2 plot{size.x - (kind_ == kind::heatmap ? label_height : 0.f), size.y - label_height};
+        if (dirty_ || plot.x != plot_.x || plot.y != plot_.y)
+        {
+            rebuild(plot);
+        }
+        const ImVec2 plot_origin{origin.x + (kind_ == kind::heatmap ? label_height : 0.f), origin.y};
+
+        // Replay the cached geometry as a single primitive run
+        auto *const draw_list{ImGui::GetWindowDrawList()};
+        const auto white_pixel{ImGui::GetFontTexUvWhitePixel()};
+        draw_list->PrimReserve(static_cast<int>(indices_.size()), static_cast<int>(vertices_.size()));
+        const auto base{draw_list->_VtxCurrentIdx};
+        for (const auto &vertex : vertices_)
+        {
+            *draw_list->_VtxWritePtr++ = {{plot_origin.x + vertex.pos.x, plot_origin.y + vertex.pos.y},
+                                          white_pixel,
+                                          vertex.col};
+        }
+        for (const auto index : indices_)
+        {
+            *draw_list->_IdxWritePtr++ = static_cast<ImDrawIdx>(base + index);
+        }
+        draw_list->_VtxCurrentIdx += static_cast<unsigned int>(vertices_.size());
+
+        // Axis labels
+        const auto text_color{ImGui::GetColorU32(ImGuiCol_Text)};
+        const std::size_t columns{kind_ == kind::heatmap ? columns_ : values_.size()};
+        const float cell_width{plot.x / static_cast<float>(columns)};
+        for (std::size_t i{}; i < columns; ++i)
+        {
+            const char label[2]{static_cast<char>('A' + i % 26), '\0'};
+            const float x{plot_origin.x + (static_cast<float>(i) + .5f) * cell_width -
+                          ImGui::CalcTextSize(label).x / 2};
+            draw_list->AddText({x, plot_origin.y + plot.y}, text_color, label);
+        }
+        if (kind_ == kind::heatmap)
+        {
+            const std::size_t rows{values_.size() / columns_};
+            const float cell_height{plot.y / static_cast<float>(rows)};
+            for (std::size_t i{}; i < rows; ++i)
+            {
+                const char label[2]{static_cast<char>('A' + i % 26), '\0'};
+                draw_list->AddText({origin.x, plot_origin.y + (static_cast<float>(i) + .5f) * cell_height -
+                                                  label_height / 2},
+                                   text_color, label);
+            }
+        }
+
+        // The hovered bin is found arithmetically instead of by per-bin items
+        if (ImGui::IsItemHovered())
+        {
+            const auto mouse{ImGui::GetMousePos()};
+            const auto column{static_cast<std::size_t>(std::clamp((mouse.x - plot_origin.x) / cell_width, 0.f,
+                                                                  static_cast<float>(columns - 1)))};
+            if (kind_ == kind::bars)
+            {
+                ImGui::SetTooltip("%s", reference_.empty()
+                                            ? std::format("{}: {:.2f}%", static_cast<char>('A' + column),
+                                                          values_[column])
+                                                  .c_str()
+                                            : std::format("{}: {:.2f}% (English {:.2f}%)",
+                                                          static_cast<char>('A' + column), values_[column],
+                                                          reference_[column])
+                                                  .c_str());
+            }
+            else
+            {
+                const std::size_t rows{values_.size() / columns_};
+                const auto row{static_cast<std::size_t>(
+                    std::clamp((mouse.y - plot_origin.y) / (plot.y / static_cast<float>(rows)), 0.f,
+                               static_cast<float>(rows - 1)))};
+                ImGui::SetTooltip("%s", std::format("{}{}: {:.2f}%", static_cast<char>('A' + row % 26),
+                                                    static_cast<char>('A' + column % 26),
+                                                    values_[row * columns_ + column])
+                                            .c_str());
+            }
+        }
+    }
+
+  private:
+    enum class kind
+    {
+        bars,
+        heatmap,
+    };
+
+    void update(const kind type, const std::span<const float> values, const std::span<const float> reference,
+                const std::size_t columns) noexcept
+    {
+        if (type == kind_ && columns == columns_ && std::ranges::equal(values, values_) &&
+            std::ranges::equal(reference, reference_))
+        {
+            return; // same data, keep the geometry
+        }
+        kind_ = type;
+        columns_ = columns;
+        values_.assign(values.begin(), values.end());
+        reference_.assign(reference.begin(), reference.end());
+        dirty_ = true;
+    }
+
+    void add_rect(const ImVec2 min, const ImVec2 max, const ImU32 color) noexcept
+    {
+        const auto first{static_cast<ImDrawIdx>(vertices_.size())};
+        vertices_.push_back({min, {}, color});
+        vertices_.push_back({{max.x, min.y}, {}, color});
+        vertices_.push_back({max, {}, color});
+        vertices_.push_back({{min.x, max.y}, {}, color});
+        for (const int corner : {0, 1, 2, 0, 2, 3})
+        {
+            indices_.push_back(static_cast<ImDrawIdx>(first + corner));
+        }
+    }
+
+    void rebuild(const ImVec2 plot) noexcept
+    {
+        plot_ = plot;
+        dirty_ = false;
+        vertices_.clear();
+        indices_.clear();
+
+        const auto &style{ImGui::GetStyle()};
+        const auto bar_color{ImGui::GetColorU32(ImGuiCol_PlotHistogram)};
+        const auto reference_color{ImGui::GetColorU32(ImGuiCol_PlotLines)};
+        const float peak{std::max({1e-6f, std::ranges::max(values_),
+                                   reference_.empty() ? 0.f : std::ranges::max(reference_)})};
+
+        if (kind_ == kind::bars)
+        {
+            const float cell_width{plot.x / static_cast<float>(values_.size())};
+            const float gap{std::min(cell_width * .2f, style.ItemInnerSpacing.x)};
+            for (std::size_t i{}; i < values_.size(); ++i)
+            {
+                const float left{static_cast<float>(i) * cell_width + gap / 2}, right{left + cell_width - gap};
+                add_rect({left, plot.y * (1.f - values_[i] / peak)}, {right, plot.y}, bar_color);
+                if (i < reference_.size())
+                {
+                    const float y{plot.y * (1.f - reference_[i] / peak)};
+                    add_rect({left, y - 1.f}, {right, y + 1.f}, reference_color);
+                }
+            }
+            return;
+        }
+
+        // Heatmap: blend from the frame background to the histogram colour
+        const auto low{style.Colors[ImGuiCol_FrameBg]};
+        const auto high{style.Colors[ImGuiCol_PlotHistogram]};
+        const std::size_t rows{values_.size() / columns_};
+        const float cell_width{plot.x / static_cast<float>(columns_)};
+        const float cell_height{plot.y / static_cast<float>(rows)};
+        for (std::size_t row{}; row < rows; ++row)
+        {
+            for (std::size_t column{}; column < columns_; ++column)
+            {
+                const float t{std::clamp(values_[row * columns_ + column] / peak, 0.f, 1.f)};
+                const ImVec4 color{low.x + (high.x - low.x) * t, low.y + (high.y - low.y) * t,
+                                   low.z + (high.z - low.z) * t, 1.f};
+                add_rect({static_cast<float>(column) * cell_width, static_cast<float>(row) * cell_height},
+                         {static_cast<float>(column + 1) * cell_width, static_cast<float>(row + 1) * cell_height},
+                         ImGui::GetColorU32(color));
+            }
+        }
+    }
+
+    kind kind_{kind::bars};
+    std::size_t columns_{1};
+    std::vector<float> values_;
+    std::vector<float> reference_;
+    bool dirty_{true};
+    ImVec2 plot_{};
+    std::vector<ImDrawVert> vertices_; // chart-local positions; the UV is filled in when replayed
+    std::vector<ImDrawIdx> indices_;
+};
+} // namespace tprotect
@@ -2,9 +2,15 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
 #include <expected>
+#include <format>
 #include <optional>
 #include <string>
+#include <string_view>
 
 namespace tprotect
 {
@@ -13,4 +19,116 @@ constexpr const int initial_key{42};
 
 template <typename T> using eresult = std::expected<T, std::string>; // the `std::string` holds error messages
 template <typename T> using oresult = std::optional<T>;
+
+// What went wrong, without the where
+enum class errc : std::uint8_t
+{
+    open_failed,
+    stat_failed,
+    map_failed,
+    read_failed,
+    write_failed,
+    invalid_key,
+    corrupt_data,
+};
+
+/**
+ * @brief An error that costs nothing to raise on hot paths
+ *
+ * Just a code plus an optional context (usually a path), copied into a per-thread ring buffer instead of the heap.
+ * The message is only formatted by `message()`, at whatever boundary shows it. The context is only readable on the
+ * raising thread and until the ring buffer wraps around; after that `message()` reports the code alone. Code that
+ * hands an error to another thread reads the context first, on the thread that raised it
+ *
+ */
+class compact_error
+{
+  public:
+    compact_error(const errc code) noexcept : code_{code}
+    {
+    }
+
+    compact_error(const errc code, const std::string_view context) noexcept : code_{code}
+    {
+        auto &ring{local_ring()};
+        const std::size_t length{std::min(context.size(), max_context)};
+        auto offset{static_cast<std::size_t>(ring.written % ring.buffer.size())};
+        if (offset + length > ring.buffer.size())
+        {
+            ring.written += ring.buffer.size() - offset; // never split a context across the end
+            offset = 0;
+        }
+        std::copy_n(context.data(), length, ring.buffer.data() + offset);
+        ring_ = ring.serial;
+        position_ = ring.written;
+        length_ = static_cast<std::uint16_t>(length);
+        ring.written += length;
+    }
+
+    [[nodiscard]] errc code() const noexcept
+    {
+        return code_;
+    }
+
+    // Empty when there was none, or it was raised on another thread or has been overwritten since
+    [[nodiscard]] std::string_view context() const noexcept
+    {
+        const auto &ring{local_ring()};
+        if (ring_ != ring.serial || length_ == 0 || ring.written - position_ > ring.buffer.size())
+        {
+            return {};
+        }
+        return {ring.buffer.data() + position_ % ring.buffer.size(), length_};
+    }
+
+    [[nodiscard]] std::string message() const noexcept
+    {
+        const auto description{[this]() -> std::string_view {
+            switch (code_)
+            {
+            case errc::open_failed:
+                return "Failed to open file";
+            case errc::stat_failed:
+                return "Failed to stat file";
+            case errc::map_failed:
+                return "Failed to map file";
+            case errc::read_failed:
+                return "Failed to read file";
+            case errc::write_failed:
+                return "Failed to write file";
+            case errc::invalid_key:
+                return "Invalid key";
+            case errc::corrupt_data:
+                return "Corrupt data";
+            }
+            return "Unknown error";
+        }()};
+        const auto where{context()};
+        return where.empty() ? std::string{description} : std::format("{}: {}", description, where);
+    }
+
+  private:
+    static constexpr std::size_t max_context{1024};
+
+    struct ring_buffer
+    {
+        std::array<char, 16 * 1024> buffer;
+        std::uint64_t written; // total bytes ever reserved, so stale positions can be detected
+        std::uint64_t serial;  // unique per thread, unlike the ring's address, which a later thread may reuse
+    };
+
+    static ring_buffer &local_ring() noexcept
+    {
+        static std::atomic<std::uint64_t> rings{};
+        thread_local ring_buffer ring{.buffer{}, .written{}, .serial{++rings}};
+        return ring;
+    }
+
+    std::uint64_t ring_{}; // the serial of the raising thread's ring, 0 for none
+    std::uint64_t position_{};
+    std::uint16_t length_{};
+    errc code_;
+};
+
+template <typename T> using cresult = std::expected<T, compact_error>; // for hot paths, see `compact_error`
 } // namespace tprotect
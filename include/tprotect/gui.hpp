@@ -3,17 +3,29 @@
 #pragma once
 
 #include <atomic>
+#include <future>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <tuple>
+#include <vector>
 
+#include <tprotect/cipher/entropy_map.hpp>
 #include <tprotect/cipher/frequency_analyzer.hpp>
+#include <tprotect/cipher/histogram_index.hpp>
 #include <tprotect/cipher/substitution_cipher.hpp>
+#include <tprotect/cipher/text_normalizer.hpp>
 #include <tprotect/cipher/transposition_cipher.hpp>
+#include <tprotect/entropy_strip.hpp>
+#include <tprotect/frequency_chart.hpp>
 #include <tprotect/global.hpp>
+#include <tprotect/text_encoding.hpp>
+#include <tprotect/text_snapshot.hpp>
 
 struct SDL_Window;
 struct SDL_Renderer;
 struct ImFont;
+struct ImGuiInputTextCallbackData;
 
 namespace tprotect
 {
@@ -73,12 +85,24 @@ class gui final
     void shutdown() noexcept;
     void render_window() noexcept;                       // render the gui
     [[nodiscard]] eresult<void> process_file() noexcept; // display dialogs
+    void render_frequency_analysis() noexcept;
+    void start_cipher_job(bool encrypting) noexcept; // encrypt or decrypt a snapshot of the source pane
+    void render_triage() noexcept;                                              // the entropy strip of a file
+    [[nodiscard]] eresult<void> load_triage_region(std::size_t block) noexcept; // into the encrypted pane
+    [[nodiscard]] tprotect::cipher::normalize_options format_options(bool encrypting) const noexcept; // the toggles
+    static int capture_selection(ImGuiInputTextCallbackData *data) noexcept; // track a pane's selection and edits
 
     std::mutex main_loop_mutex_;
     std::string title_; // save it to ensure its validity
     SDL_Window *window_{};
     SDL_Renderer *renderer_{};
 
+    // Decoded font files, borrowed by the font atlas
+    std::vector<unsigned char> futura_medium_ttf_;
+    std::vector<unsigned char> jetbrains_mono_regular_ttf_;
+    std::vector<unsigned char> noto_sans_cjk_regular_ttf_;
+    bool first_frame_presented_{};
+
     // UI state
     ImFont *futura_medium{};
     ImFont *jetbrains_mono_regular{};
@@ -89,11 +113,58 @@ class gui final
     };
     std::string encrypted_text_;
     std::string decrypted_text_;
+    text_format encrypted_format_{}; // how the pane's file was stored, to save it back the same way
+    text_format decrypted_format_{};
+    text_buffer encrypted_buffer_; // the panes' text as shared chunks, brought up to date when a job starts
+    text_buffer decrypted_buffer_;
+    struct cipher_result
+    {
+        text_snapshot chunks; // adopted by the target pane's buffer
+        std::string text;     // for the pane to edit
+    };
+    std::future<eresult<cipher_result>> cipher_job_;
+    bool cipher_job_encrypting_{}; // the encrypted pane is the target, and read-only until the job finishes
     cipher selected_cipher_{cipher::substitution};
     tprotect::cipher::substitution_cipher substitution_cipher{initial_mapping};
     tprotect::cipher::transposition_cipher transposition_cipher{initial_key};
     int transposition_key{initial_key};
+    bool normalize_text_{};     // uppercase letters only
+    bool transliterate_text_{}; // accented letters to their base letters
+    bool group_text_{};         // encrypted text in groups of five
     bool show_frequency_analysis_{false};
+
+    // Range statistics, so a selection in either pane is analyzed without rescanning the text
+    struct text_selection
+    {
+        text_buffer *buffer{}; // told by `capture_selection` which bytes an edit left alone
+        std::size_t begin{};
+        std::size_t end{};
+        bool touched{};       // set by `capture_selection` when the selection changes
+        int frame{-1};        // when `capture_selection` last ran; the selection it saw is stale after that frame
+        std::size_t first{};  // where that selection, or the cursor, started; the next edit starts no earlier
+        std::size_t last{};   // where it ended; the next edit leaves no more than what follows
+        std::size_t length{}; // of the text then
+        bool edit_seen{};     // set by `capture_selection` on an edit, so a change it did not see is caught
+    };
+    tprotect::cipher::histogram_index encrypted_index_;
+    tprotect::cipher::histogram_index decrypted_index_;
+    bool encrypted_index_dirty_{true};
+    bool decrypted_index_dirty_{true};
+    std::future<tprotect::cipher::histogram_index> encrypted_index_job_; // rebuilds the index from a snapshot
+    std::future<tprotect::cipher::histogram_index> decrypted_index_job_;
+    text_selection encrypted_selection_{.buffer = &encrypted_buffer_};
+    text_selection decrypted_selection_{.buffer = &decrypted_buffer_};
+    bool analyze_decrypted_selection_{}; // whichever pane was selected in last
+    frequency_chart letter_chart_;
+    frequency_chart bigram_chart_;
+    std::tuple<bool, std::size_t, std::size_t> bigram_source_{}; // pane and range the bigram chart was counted over
+
+    // File triage: the entropy map is built on the executor, then drawn as a strip to pick text-like regions from
+    std::string triage_path_;
+    std::future<eresult<tprotect::cipher::entropy_map>> triage_job_;
+    entropy_strip triage_strip_;
+    std::size_t triage_next_{}; // where "Next Text" resumes its search
+    std::string triage_message_;
     double fps_idle_{10.};
     bool is_idling_{};
     std::atomic<bool> is_initialized_; // `std::atomic<bool>` for thread safety
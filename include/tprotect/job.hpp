@@ -0,0 +1,656 @@
+// job.hpp: Declarative Cipher Workflows Run As A Dependency Graph
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <tprotect/cipher/affine_cipher.hpp>
+#include <tprotect/cipher/cipher_detector.hpp>
+#include <tprotect/cipher/frequency_analyzer.hpp>
+#include <tprotect/cipher/hill_cipher.hpp>
+#include <tprotect/cipher/homophonic_cipher.hpp>
+#include <tprotect/cipher/ngram_model.hpp>
+#include <tprotect/cipher_factory.hpp>
+#include <tprotect/content_hash.hpp>
+#include <tprotect/executor.hpp>
+#include <tprotect/file_io.hpp>
+#include <tprotect/global.hpp>
+#include <tprotect/parallel.hpp>
+
+namespace tprotect
+{
+/**
+ * @brief A node's result: an immutable buffer shared by every node that reads it, and the hash of its contents
+ *
+ */
+struct job_value
+{
+    std::shared_ptr<const std::string> data;
+    std::uint64_t hash;
+};
+
+/**
+ * @brief Node results by a hash of everything they were computed from, shared between nodes, inputs and runs
+ *
+ * Bounded by `max_bytes`, evicting the oldest results first. Keep one across runs of a job to skip the nodes whose
+ * inputs have not changed
+ *
+ */
+class job_cache
+{
+  public:
+    explicit job_cache(const std::size_t max_bytes = std::size_t{1} << 30) noexcept : max_bytes_{max_bytes}
+    {
+    }
+
+    [[nodiscard]] oresult<job_value> find(const std::uint64_t key) const noexcept
+    {
+        std::lock_guard<std::mutex> guard{mutex_};
+        if (const auto it{values_.find(key)}; it != values_.end())
+        {
+            return it->second;
+        }
+        return std::nullopt;
+    }
+
+    void insert(const std::uint64_t key, const job_value &value) noexcept
+    {
+        std::lock_guard<std::mutex> guard{mutex_};
+        if (value.data->size() > max_bytes_ || !values_.try_emplace(key, value).second)
+        {
+            return;
+        }
+        order_.push_back(key);
+        bytes_ += value.data->size();
+        while (bytes_ > max_bytes_)
+        {
+            const auto oldest{values_.find(order_.front())};
+            bytes_ -= oldest->second.data->size();
+            values_.erase(oldest);
+            order_.pop_front();
+        }
+    }
+
+  private:
+    const std::size_t max_bytes_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::uint64_t, job_value> values_;
+    std::deque<std::uint64_t> order_; // insertion order, for eviction
+    std::size_t bytes_{};
+};
+
+struct job_report
+{
+    std::size_t nodes;
+    std::size_t computed;
+    std::size_t cached;  // taken from the cache instead of being computed
+    std::size_t skipped; // not run, because a node they depend on failed
+    std::vector<std::string> errors;
+};
+
+/**
+ * @brief A workflow of cipher operations over many inputs, declared in a text manifest
+ *
+ * Each line defines a node as `name = operation arguments...`; `#` starts a comment. Operations:
+ *
+ *     load PATH                 the text of a file, decoded to UTF-8 with LF line endings
+ *     value TEXT...             the rest of the line, e.g. a cipher name or a key
+ *     detect TEXT               the name of the cipher that most likely produced TEXT
+ *     recover TEXT CIPHER [AID] a key for TEXT: transposition and affine need nothing, homophonic a reference
+ *                               text as AID and hill a crib as AID
+ *     decrypt TEXT CIPHER KEY   also `encrypt`
+ *     analyze TEXT              a report of letter frequencies, the index of coincidence and the detected cipher
+ *     write VALUE PATH          writes VALUE to PATH, replacing it atomically
+ *
+ * Upper-case arguments other than PATH are names of earlier nodes, so every job is acyclic. A line `inputs PATH...`
+ * names files and directories (searched recursively); every node whose line mentions `{path}`, `{name}` (the path
+ * below its `inputs` argument) or `{stem}` (that without its extension), or that depends on such a node, runs once per
+ * input file, and all others run once. For example:
+ *
+ *     inputs intercepts/
+ *     reference = load corpus/english.txt
+ *     text      = load {path}
+ *     cipher    = detect text
+ *     key       = recover text cipher reference
+ *     plain     = decrypt text cipher key
+ *     report    = analyze plain
+ *     target    = value substitution
+ *     new_key   = value QWERTYUIOPASDFGHJKLZXCVBNMqwertyuiopasdfghjklzxcvbnm
+ *     rekeyed   = encrypt plain target new_key
+ *     saved     = write rekeyed out/{name}
+ *     analyzed  = write report reports/{stem}.txt
+ *
+ */
+class job_manifest
+{
+  public:
+    [[nodiscard]] static eresult<job_manifest> load(const std::filesystem::path &path) noexcept
+    {
+        return read_file(path.string())
+            .transform_error(&compact_error::message)
+            .and_then([&](const std::string &text) {
+                return parse(text).transform_error([&](const std::string &error) {
+                    return std::format("{}: {}", path.string(), error);
+                });
+            });
+    }
+
+    [[nodiscard]] static eresult<job_manifest> parse(const std::string_view text) noexcept
+    {
+        job_manifest manifest{};
+        std::vector<std::filesystem::path> roots;
+        std::map<std::string, std::size_t, std::less<>> names; // to line
+        std::vector<char> per_input;                         // by line
+
+        std::size_t line_number{};
+        for (std::size_t begin{}; begin < text.size(); ++line_number)
+        {
+            const auto end{std::min(text.find('\n', begin), text.size())};
+            auto line{text.substr(begin, end - begin)};
+            begin = end + 1;
+            if (const auto comment{line.find('#')}; comment != std::string_view::npos)
+            {
+                line = line.substr(0, comment);
+            }
+            const auto words{split(line)};
+            if (words.empty())
+            {
+                continue;
+            }
+            const auto fail{[&](const std::string &what) -> eresult<job_manifest> {
+                return std::unexpected{std::format("line {}: {}", line_number + 1, what)};
+            }};
+
+            if (words[0] == "inputs")
+            {
+                if (!roots.empty() || words.size() < 2)
+                {
+                    return fail("Expected one `inputs` line naming at least one path");
+                }
+                roots.assign(words.begin() + 1, words.end());
+                continue;
+            }
+            if (words.size() < 3 || words[1] != "=")
+            {
+                return fail("Expected `name = operation arguments...`");
+            }
+            const auto *const kind{find_operation(words[2])};
+            if (!kind)
+            {
+                return fail(std::format("Unknown operation: {}", words[2]));
+            }
+
+            definition current{std::string{words[0]}, kind->op, {}, {}};
+            const std::size_t argument_count{words.size() - 3};
+            if (kind->op == operation::value)
+            {
+                const auto rest{line.substr(static_cast<std::size_t>(words[2].data() + words[2].size() - line.data()))};
+                current.literals.emplace_back(trim(rest));
+                if (current.literals.back().empty())
+                {
+                    return fail("`value` needs some text");
+                }
+            }
+            else if (argument_count < kind->minimum || argument_count > kind->signature.size())
+            {
+                return fail(kind->minimum == kind->signature.size()
+                                ? std::format("`{}` takes {} arguments", words[2], kind->minimum)
+                                : std::format("`{}` takes {} to {} arguments", words[2], kind->minimum,
+                                              kind->signature.size()));
+            }
+            bool varies{};
+            for (std::size_t a{}; a < argument_count && kind->op != operation::value; ++a)
+            {
+                const auto argument{words[3 + a]};
+                if (kind->signature[a] == 'p')
+                {
+                    varies = varies || argument.find("{path}") != std::string_view::npos ||
+                             argument.find("{name}") != std::string_view::npos ||
+                             argument.find("{stem}") != std::string_view::npos;
+                    current.literals.emplace_back(argument);
+                    continue;
+                }
+                const auto source{names.find(argument)};
+                if (source == names.end())
+                {
+                    return fail(std::format("`{}` is not defined above", argument));
+                }
+                varies = varies || per_input[source->second];
+                current.inputs.push_back(source->second);
+            }
+            if (!names.try_emplace(current.name, manifest.lines_.size()).second)
+            {
+                return fail(std::format("`{}` is defined twice", current.name));
+            }
+            per_input.push_back(varies);
+            manifest.lines_.push_back(std::move(current));
+        }
+
+        // Expand the inputs, then every line into one node, or one per input
+        std::vector<std::pair<std::filesystem::path, std::string>> files; // path, name below its root
+        for (const auto &root : roots)
+        {
+            std::error_code error;
+            if (std::filesystem::is_regular_file(root, error))
+            {
+                files.emplace_back(root, root.filename().generic_string());
+                continue;
+            }
+            for (std::filesystem::recursive_directory_iterator it{root, error}, end{}; !error && it != end;
+                 it.increment(error))
+            {
+                if (it->is_regular_file(error))
+                {
+                    files.emplace_back(it->path(), std::filesystem::relative(it->path(), root, error).generic_string());
+                }
+            }
+            if (error)
+            {
+                return std::unexpected{std::format("Failed to list {}: {}", root.string(), error.message())};
+            }
+        }
+        std::ranges::sort(files);
+        if (roots.empty() && std::ranges::find(per_input, true) != per_input.end())
+        {
+            return std::unexpected{"Placeholders like {path} need an `inputs` line"};
+        }
+
+        std::vector<std::vector<std::size_t>> node_of(manifest.lines_.size()); // per line, per input
+        for (std::size_t l{}; l < manifest.lines_.size(); ++l)
+        {
+            const auto &current{manifest.lines_[l]};
+            const std::size_t copies{per_input[l] ? files.size() : 1};
+            for (std::size_t f{}; f < copies; ++f)
+            {
+                node instance{l, per_input[l] ? std::format("{}[{}]", current.name, files[f].second) : current.name,
+                              current.literals, {}, {}};
+                if (per_input[l])
+                {
+                    const auto &[path, name] = files[f];
+                    const auto stem{std::filesystem::path{name}.replace_extension().generic_string()};
+                    for (auto &literal : instance.literals)
+                    {
+                        literal = replace_all(literal, "{path}", path.string());
+                        literal = replace_all(replace_all(std::move(literal), "{name}", name), "{stem}", stem);
+                    }
+                }
+                for (const auto source : current.inputs)
+                {
+                    const auto id{node_of[source][per_input[source] ? f : 0]};
+                    instance.inputs.push_back(id);
+                    manifest.nodes_[id].dependents.push_back(manifest.nodes_.size());
+                }
+                node_of[l].push_back(manifest.nodes_.size());
+                manifest.nodes_.push_back(std::move(instance));
+            }
+        }
+        return manifest;
+    }
+
+    [[nodiscard]] std::size_t node_count() const noexcept
+    {
+        return nodes_.size();
+    }
+
+    /**
+     * @brief Run every node once all the nodes it reads have run, independent nodes in parallel on the executor
+     *
+     * Results stay in memory, and each is released as soon as its last reader has run. A node whose operation and
+     * input hashes match a cached result reuses it; loads and writes always run. A failing node fails only the nodes
+     * downstream of it, and the rest of the job carries on
+     *
+     */
+    [[nodiscard]] job_report run(job_cache &cache, const cancellation_token &token = {}) const noexcept
+    {
+        job_report report{nodes_.size(), 0, 0, 0, {}};
+        if (nodes_.empty())
+        {
+            return report;
+        }
+
+        struct state
+        {
+            oresult<job_value> result;
+            std::atomic<std::size_t> waiting; // inputs yet to run
+            std::atomic<std::size_t> readers; // dependents yet to run
+            std::atomic<bool> failed;
+        };
+        std::vector<state> states(nodes_.size());
+        for (std::size_t i{}; i < nodes_.size(); ++i)
+        {
+            states[i].waiting = nodes_[i].inputs.size();
+            states[i].readers = nodes_[i].dependents.size();
+        }
+
+        std::mutex mutex;
+        std::condition_variable all_done;
+        std::size_t finished{};
+        std::atomic<std::size_t> computed{}, cached{}, skipped{};
+        std::function<void(std::size_t)> run_node{[&](const std::size_t i) {
+            const auto &current{nodes_[i]};
+            const auto &declared{lines_[current.line]};
+            auto &own{states[i]};
+
+            const bool upstream_failed{std::ranges::any_of(current.inputs, [&](const std::size_t input) {
+                return states[input].failed.load(std::memory_order_acquire);
+            })};
+            std::string error{};
+            if (upstream_failed || token.cancelled())
+            {
+                skipped++;
+                own.failed.store(true, std::memory_order_release);
+            }
+            else
+            {
+                std::vector<const job_value *> inputs;
+                std::uint64_t key{content_hash(operation_name(declared.op))};
+                for (const auto &literal : current.literals)
+                {
+                    key = content_hash(literal, key);
+                }
+                for (const auto input : current.inputs)
+                {
+                    inputs.push_back(&*states[input].result);
+                    key = mix64(key, inputs.back()->hash);
+                }
+                // Ciphers are made before the lookup, as their configuration covers what the key only names, such
+                // as the state of a running-key file
+                oresult<eresult<cipher_choice>> cipher{};
+                if (declared.op == operation::encrypt || declared.op == operation::decrypt)
+                {
+                    cipher = make_cipher(trim(*inputs[1]->data), trim(*inputs[2]->data),
+                                         declared.op == operation::decrypt);
+                    key = *cipher ? content_hash((*cipher)->configuration, key) : key;
+                }
+                const bool cacheable{declared.op != operation::load && declared.op != operation::write &&
+                                     (!cipher || *cipher)};
+                if (const auto hit{cacheable ? cache.find(key) : std::nullopt})
+                {
+                    own.result = *hit;
+                    cached++;
+                }
+                else if (auto value{evaluate(declared.op, current.literals, inputs, cipher)}; value)
+                {
+                    const auto hash{content_hash(*value)};
+                    own.result = job_value{std::make_shared<const std::string>(std::move(*value)), hash};
+                    if (cacheable)
+                    {
+                        cache.insert(key, *own.result);
+                    }
+                    computed++;
+                }
+                else
+                {
+                    error = std::format("{}: {}", current.label, value.error());
+                    own.failed.store(true, std::memory_order_release);
+                }
+            }
+
+            // Release what nobody else will read, then start whatever this node was the last input of
+            for (const auto input : current.inputs)
+            {
+                if (states[input].readers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    states[input].result.reset();
+                }
+            }
+            if (current.dependents.empty())
+            {
+                own.result.reset();
+            }
+            for (const auto dependent : current.dependents)
+            {
+                if (states[dependent].waiting.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    executor::instance().submit([&run_node, dependent] { run_node(dependent); });
+                }
+            }
+
+            std::lock_guard<std::mutex> guard{mutex};
+            if (!error.empty())
+            {
+                report.errors.push_back(std::move(error));
+            }
+            if (++finished == nodes_.size())
+            {
+                all_done.notify_all(); // under the lock, so `run` cannot return while this thread still uses it
+            }
+        }};
+
+        for (std::size_t i{}; i < nodes_.size(); ++i)
+        {
+            if (nodes_[i].inputs.empty())
+            {
+                executor::instance().submit([&run_node, i] { run_node(i); });
+            }
+        }
+        std::unique_lock<std::mutex> lock{mutex};
+        all_done.wait(lock, [&] { return finished == nodes_.size(); });
+        report.computed = computed;
+        report.cached = cached;
+        report.skipped = skipped;
+        std::ranges::sort(report.errors);
+        return report;
+    }
+
+  private:
+    enum class operation : std::uint8_t
+    {
+        load,
+        value,
+        detect,
+        recover,
+        encrypt,
+        decrypt,
+        analyze,
+        write,
+    };
+
+    struct operation_kind
+    {
+        std::string_view name;
+        operation op;
+        std::string_view signature; // per argument: 'n' for a node, 'p' for a path
+        std::size_t minimum;        // arguments
+    };
+
+    static constexpr std::array<operation_kind, 8> operations{{
+        {"load", operation::load, "p", 1},
+        {"value", operation::value, "", 0},
+        {"detect", operation::detect, "n", 1},
+        {"recover", operation::recover, "nnn", 2},
+        {"encrypt", operation::encrypt, "nnn", 3},
+        {"decrypt", operation::decrypt, "nnn", 3},
+        {"analyze", operation::analyze, "n", 1},
+        {"write", operation::write, "np", 2},
+    }};
+
+    struct definition
+    {
+        std::string name;
+        operation op;
+        std::vector<std::string> literals;
+        std::vector<std::size_t> inputs; // lines
+    };
+
+    struct node
+    {
+        std::size_t line;
+        std::string label; // for errors
+        std::vector<std::string> literals;
+        std::vector<std::size_t> inputs; // nodes
+        std::vector<std::size_t> dependents;
+    };
+
+    [[nodiscard]] static const operation_kind *find_operation(const std::string_view name) noexcept
+    {
+        const auto it{std::ranges::find(operations, name, &operation_kind::name)};
+        return it == operations.end() ? nullptr : &*it;
+    }
+
+    [[nodiscard]] static std::string_view operation_name(const operation op) noexcept
+    {
+        return operations[static_cast<std::size_t>(op)].name;
+    }
+
+    [[nodiscard]] static std::string_view trim(const std::string_view text) noexcept
+    {
+        const auto first{text.find_first_not_of(" \t\r\n")};
+        if (first == std::string_view::npos)
+        {
+            return {};
+        }
+        return text.substr(first, text.find_last_not_of(" \t\r\n") - first + 1);
+    }
+
+    [[nodiscard]] static std::vector<std::string_view> split(const std::string_view line) noexcept
+    {
+        std::vector<std::string_view> words;
+        for (std::size_t at{line.find_first_not_of(" \t\r")}; at != std::string_view::npos;
+             at = line.find_first_not_of(" \t\r", at))
+        {
+            const auto end{std::min(line.find_first_of(" \t\r", at), line.size())};
+            words.push_back(line.substr(at, end - at));
+            at = end;
+        }
+        return words;
+    }
+
+    [[nodiscard]] static std::string replace_all(std::string text, const std::string_view from,
+                                                 const std::string_view to) noexcept
+    {
+        for (auto at{text.find(from)}; at != std::string::npos; at = text.find(from, at + to.size()))
+        {
+            text.replace(at, from.size(), to);
+        }
+        return text;
+    }
+
+    [[nodiscard]] static eresult<std::string> evaluate(const operation op, const std::vector<std::string> &literals,
+                                                       const std::vector<const job_value *> &inputs,
+                                                       const oresult<eresult<cipher_choice>> &cipher) noexcept
+    {
+        const auto input{[&](const std::size_t i) -> std::string_view { return *inputs[i]->data; }};
+        switch (op)
+        {
+        case operation::load:
+            return read_decoded_file(literals[0]).transform_error(&compact_error::message);
+        case operation::value:
+            return literals[0];
+        case operation::detect:
+            if (const auto name{cipher::detect_cipher(input(0))}; !name.empty())
+            {
+                return std::string{name};
+            }
+            return std::unexpected{"There are no letters to detect a cipher from"};
+        case operation::recover:
+            return recover(input(0), trim(input(1)), inputs.size() > 2 ? input(2) : std::string_view{});
+        case operation::encrypt:
+        case operation::decrypt:
+            return cipher->and_then([&](const cipher_choice &choice) {
+                return choice.transform(input(0)).transform_error(&compact_error::message);
+            });
+        case operation::analyze:
+            return analyze(input(0));
+        case operation::write:
+            return write(literals[0], input(0));
+        }
+        return std::unexpected{"Unknown operation"};
+    }
+
+    [[nodiscard]] static eresult<std::string> recover(const std::string_view text, const std::string_view name,
+                                                      const std::string_view aid) noexcept
+    {
+        if (name == "transposition")
+        {
+            return std::to_string(cipher::best_shift(text));
+        }
+        if (name == "affine")
+        {
+            const auto key{cipher::affine_cipher::recover(text)};
+            return std::format("{} {}", key.a, key.b);
+        }
+        if (name == "homophonic")
+        {
+            const auto model{cipher::ngram_model::from_text(aid)};
+            if (!model.trained())
+            {
+                return std::unexpected{"Recovering a homophonic key needs a reference text of the language"};
+            }
+            return cipher::homophonic_solver::solve(text, model, {}).key;
+        }
+        if (name == "hill")
+        {
+            for (std::size_t order{2}; order <= cipher::modular_matrix::max_order && !aid.empty(); ++order)
+            {
+                if (const auto found{cipher::recover_hill_key(text, aid, order)})
+                {
+                    return cipher::hill_cipher::to_string(found->key);
+                }
+            }
+            return std::unexpected{"The crib was not found under any Hill key"};
+        }
+        return std::unexpected{std::format("There is no key recovery for the {} cipher", name)};
+    }
+
+    [[nodiscard]] static std::string analyze(const std::string_view text) noexcept
+    {
+        const auto statistics{cipher::letter_statistics::of(text)};
+        std::string report{std::format("letters: {}\nindex of coincidence: {:.4f}\ndetected cipher: {}\n",
+                                       statistics.letters, cipher::letter_statistics::coincidence(statistics.folded()),
+                                       cipher::detect_cipher(text))};
+        for (const auto &frequency : cipher::frequency_analyzer::analyze(text))
+        {
+            report += std::format("{} {:6.2f}% {}\n", frequency.letter, frequency.percentage, frequency.count);
+        }
+        return report;
+    }
+
+    [[nodiscard]] static eresult<std::string> write(const std::filesystem::path &path,
+                                                    const std::string_view contents) noexcept
+    {
+        std::error_code error;
+        if (path.has_parent_path())
+        {
+            std::filesystem::create_directories(path.parent_path(), error);
+        }
+        const auto temporary{std::filesystem::path{path} += ".tprotect-tmp"};
+        {
+            std::ofstream ofs{temporary, std::ios::binary | std::ios::trunc};
+            ofs.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+            if (!ofs.flush())
+            {
+                return std::unexpected{std::format("Failed to write {}", path.string())};
+            }
+        }
+        std::filesystem::rename(temporary, path, error);
+        if (error)
+        {
+            std::filesystem::remove(temporary, error);
+            return std::unexpected{std::format("{}: {}", path.string(), error.message())};
+        }
+        return path.string();
+    }
+
+    std::vector<definition> lines_;
+    std::vector<node> nodes_;
+};
+} // namespace tprotect
@@ -0,0 +1,603 @@
+// key_search.hpp: Sharded Multi-Process Key Search Over Unix Domain Sockets
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <tprotect/checkpoint.hpp>
+#include <tprotect/cipher/ngram_model.hpp>
+#include <tprotect/cipher/substitution_solver.hpp>
+#include <tprotect/global.hpp>
+#include <tprotect/parallel.hpp>
+
+#ifdef __linux__
+extern char **environ;
+#endif
+
+namespace tprotect
+{
+struct key_search_options
+{
+    std::size_t workers{};               // worker processes to spawn; 0 for one per core
+    bool spawn{true};                    // otherwise wait for workers started separately with `search-worker`
+    std::size_t shards{64};              // restarts handed out, one at a time, to whichever worker asks
+    std::size_t iterations{20'000};      // moves per shard
+    std::size_t patience{16};            // stop once this many shards finish without improving; 0 never stops early
+    std::optional<double> target{};      // stop as soon as any worker reports a score per trigram this high
+    std::filesystem::path socket_path{}; // empty for one in a private temporary directory
+};
+
+struct key_search_report
+{
+    cipher::substitution_solution best;
+    std::size_t shards_finished;
+    std::size_t workers; // that connected
+    bool stopped_early;
+};
+
+namespace key_search_detail
+{
+/**
+ * @brief What the coordinator and its workers say to each other
+ *
+ * A worker is sent the job when it connects, then repeatedly claims a shard, streams its progress and reports it
+ * finished. The coordinator answers a claim with a shard or with `stop`, and sends `stop` unprompted to every worker
+ * to end the search early; a worker only checks for it between moves, and answers it with its shard's best so far
+ *
+ */
+enum class message : std::uint8_t
+{
+    job,      // iterations, ciphertext, reference text
+    claim,    // (empty)
+    assign,   // shard
+    progress, // shard, score, mapping
+    finished, // shard, score, mapping
+    stop,     // (empty)
+};
+
+#ifdef __linux__
+/**
+ * @brief One end of a stream socket carrying frames: a 32-bit length, the message type and its payload
+ *
+ * Payloads are laid out by `binary_writer` and read back by `binary_reader`, as checkpoints are, so the format does
+ * not depend on the process or the machine at the other end
+ *
+ */
+class channel
+{
+  public:
+    channel() noexcept = default;
+
+    explicit channel(const int fd) noexcept : fd_{fd}
+    {
+    }
+
+    ~channel()
+    {
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+        }
+    }
+
+    // Disable copying and enable moving
+    channel(const channel &) noexcept = delete;
+    channel &operator=(const channel &) noexcept = delete;
+    channel(channel &&other) noexcept : fd_{std::exchange(other.fd_, -1)}
+    {
+    }
+    channel &operator=(channel &&other) noexcept
+    {
+        std::swap(fd_, other.fd_);
+        return *this;
+    }
+
+    [[nodiscard]] int fd() const noexcept
+    {
+        return fd_;
+    }
+
+    // Whether a frame, or the end of the stream, can be read within `timeout`
+    [[nodiscard]] bool readable(const std::chrono::milliseconds timeout) const noexcept
+    {
+        pollfd entry{fd_, POLLIN, 0};
+        return ::poll(&entry, 1, static_cast<int>(timeout.count())) > 0;
+    }
+
+    // False once the peer has gone; never raises SIGPIPE
+    bool send(const message type, const std::string_view payload = {}) const noexcept
+    {
+        binary_writer header{};
+        header.put(static_cast<std::uint32_t>(payload.size() + 1)).put(type);
+        return write_all(header.bytes()) && write_all(payload);
+    }
+
+    // The next frame, waiting for it if need be, or nothing once the peer has gone or sent something malformed
+    [[nodiscard]] oresult<std::pair<message, std::string>> receive() const noexcept
+    {
+        std::string header(sizeof(std::uint32_t) + 1, '\0');
+        if (!read_all(header))
+        {
+            return std::nullopt;
+        }
+        binary_reader reader{header};
+        const auto size{reader.get<std::uint32_t>()};
+        const auto type{reader.get<message>()};
+        if (!size || !type || *size == 0 || *type > message::stop)
+        {
+            return std::nullopt;
+        }
+        std::string payload(*size - 1, '\0');
+        if (!read_all(payload))
+        {
+            return std::nullopt;
+        }
+        return std::pair{*type, std::move(payload)};
+    }
+
+  private:
+    [[nodiscard]] bool write_all(std::string_view bytes) const noexcept
+    {
+        while (!bytes.empty())
+        {
+            const auto written{::send(fd_, bytes.data(), bytes.size(), MSG_NOSIGNAL)};
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                return false;
+            }
+            bytes.remove_prefix(static_cast<std::size_t>(written));
+        }
+        return true;
+    }
+
+    [[nodiscard]] bool read_all(std::string &bytes) const noexcept
+    {
+        for (std::size_t done{}; done < bytes.size();)
+        {
+            const auto got{::recv(fd_, bytes.data() + done, bytes.size() - done, 0)};
+            if (got < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (got <= 0)
+            {
+                return false;
+            }
+            done += static_cast<std::size_t>(got);
+        }
+        return true;
+    }
+
+    int fd_{-1};
+};
+
+[[nodiscard]] inline oresult<sockaddr_un> address_of(const std::filesystem::path &path) noexcept
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.native().size() >= sizeof address.sun_path)
+    {
+        return std::nullopt;
+    }
+    std::ranges::copy(path.native(), address.sun_path);
+    return address;
+}
+
+/**
+ * @brief Where the coordinator listens, removed again when it is done
+ *
+ * Without a path, the socket goes in a directory of its own that only this user can enter, so no one else can connect
+ * and report forged scores. A given path, for workers started separately, may replace a socket an earlier search left
+ * behind, but nothing else
+ *
+ */
+class socket_file
+{
+  public:
+    [[nodiscard]] static eresult<socket_file> claim(const std::filesystem::path &requested) noexcept
+    {
+        socket_file file{};
+        if (requested.empty())
+        {
+            std::error_code error;
+            auto pattern{(std::filesystem::temp_directory_path(error) / "tprotect-search-XXXXXX").string()};
+            if (error || ::mkdtemp(pattern.data()) == nullptr) // mode 0700
+            {
+                return std::unexpected{std::format("Failed to create a directory for the socket: {}",
+                                                   error ? error.message() : std::generic_category().message(errno))};
+            }
+            file.directory_ = pattern;
+            file.path_ = file.directory_ / "search.sock";
+            return file;
+        }
+
+        struct stat status{};
+        if (::lstat(requested.c_str(), &status) == 0)
+        {
+            if (!S_ISSOCK(status.st_mode))
+            {
+                return std::unexpected{
+                    std::format("Refusing to replace {}, which is not a socket", requested.string())};
+            }
+            ::unlink(requested.c_str());
+        }
+        file.path_ = requested;
+        return file;
+    }
+
+    ~socket_file()
+    {
+        if (path_.empty())
+        {
+            return;
+        }
+        if (struct stat status{}; ::lstat(path_.c_str(), &status) == 0 && S_ISSOCK(status.st_mode))
+        {
+            ::unlink(path_.c_str());
+        }
+        if (!directory_.empty())
+        {
+            ::rmdir(directory_.c_str());
+        }
+    }
+
+    // Disable copying and enable moving
+    socket_file(const socket_file &) noexcept = delete;
+    socket_file &operator=(const socket_file &) noexcept = delete;
+    socket_file(socket_file &&other) noexcept
+        : path_{std::exchange(other.path_, {})}, directory_{std::exchange(other.directory_, {})}
+    {
+    }
+    socket_file &operator=(socket_file &&other) noexcept
+    {
+        std::swap(path_, other.path_);
+        std::swap(directory_, other.directory_);
+        return *this;
+    }
+
+    [[nodiscard]] const std::filesystem::path &path() const noexcept
+    {
+        return path_;
+    }
+
+  private:
+    socket_file() noexcept = default;
+
+    std::filesystem::path path_;
+    std::filesystem::path directory_; // private to this search, if no path was given
+};
+
+[[nodiscard]] inline std::string solution_payload(const cipher::substitution_solution &solution) noexcept
+{
+    binary_writer writer{};
+    writer.put(solution.shard).put(solution.score).put_bytes(solution.mapping);
+    return writer.bytes();
+}
+
+[[nodiscard]] inline oresult<cipher::substitution_solution> read_solution(const std::string_view payload) noexcept
+{
+    binary_reader reader{payload};
+    const auto shard{reader.get<std::uint64_t>()};
+    const auto score{reader.get<double>()};
+    const auto mapping{reader.get_bytes()};
+    if (!mapping || mapping->size() != cipher::substitution_solver::symbol_count)
+    {
+        return std::nullopt;
+    }
+    return cipher::substitution_solution{std::string{*mapping}, *score, *shard};
+}
+#endif
+} // namespace key_search_detail
+
+/**
+ * @brief Serve shards of a key search to the coordinator listening at `socket_path`, until it says to stop
+ *
+ * The worker holds the whole job in memory, so it needs nothing but the socket; one process runs one shard at a time
+ *
+ */
+[[nodiscard]] inline eresult<void> run_key_search_worker(const std::filesystem::path &socket_path) noexcept
+{
+#ifdef __linux__
+    using namespace key_search_detail;
+    const auto address{address_of(socket_path)};
+    if (!address)
+    {
+        return std::unexpected{std::format("Socket path too long: {}", socket_path.string())};
+    }
+    channel coordinator{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if (coordinator.fd() < 0 ||
+        ::connect(coordinator.fd(), reinterpret_cast<const sockaddr *>(&*address), sizeof *address) != 0)
+    {
+        return std::unexpected{
+            std::format("Failed to connect to {}: {}", socket_path.string(), std::generic_category().message(errno))};
+    }
+
+    const auto job{coordinator.receive()};
+    if (!job || job->first != message::job)
+    {
+        return std::unexpected{"The coordinator did not send a job"};
+    }
+    binary_reader reader{job->second};
+    const auto iterations{reader.get<std::uint64_t>()};
+    const auto ciphertext{reader.get_bytes()};
+    const auto reference{reader.get_bytes()};
+    if (!iterations || !ciphertext || !reference)
+    {
+        return std::unexpected{"The coordinator sent a malformed job"};
+    }
+    const auto model{cipher::ngram_model::from_text(*reference)};
+    const cipher::substitution_solver solver{*ciphertext, model};
+
+    for (bool stopped{}; !stopped && coordinator.send(message::claim);)
+    {
+        const auto reply{coordinator.receive()};
+        binary_reader shard_reader{reply ? std::string_view{reply->second} : std::string_view{}};
+        const auto shard{shard_reader.get<std::uint64_t>()};
+        if (!reply || reply->first != message::assign || !shard)
+        {
+            break; // told to stop, or the coordinator has gone
+        }
+        const auto solution{solver.solve_shard(
+            *shard, static_cast<std::size_t>(*iterations),
+            [&] {
+                // Anything arriving mid-shard is a stop, or the coordinator going away
+                stopped = coordinator.readable(std::chrono::milliseconds{0});
+                return stopped;
+            },
+            [&](const cipher::substitution_solution &best) {
+                (void)coordinator.send(message::progress, solution_payload(best));
+            })};
+        (void)coordinator.send(message::finished, solution_payload(solution));
+    }
+    return {};
+#else
+    (void)socket_path;
+    return std::unexpected{"Key search workers need Unix domain sockets and /proc, which only Linux has here"};
+#endif
+}
+
+/**
+ * @brief Search for a `substitution_cipher` key with worker processes, coordinating them over a Unix domain socket
+ *
+ * The coordinator only hands out shards and keeps the best solution; each worker process runs whole shards of
+ * `substitution_solver`, as many at once as there are workers. Shards are claimed one at a time, so faster workers
+ * take more of them, and a worker that dies has its shard handed out again. Workers stream their best scores as
+ * they go, so the search ends as soon as one reaches `target`, or once `patience` shards in a row finish without
+ * improving on the best; every worker is then told to stop and abandons its shard within a few hundred moves.
+ *
+ * Spawned workers are this executable run as `search-worker --socket PATH`, which is also how workers on other
+ * machines would join through a forwarded socket
+ *
+ * @param on_progress called with every new best solution, e.g. to show it
+ */
+[[nodiscard]] inline eresult<key_search_report> run_key_search(
+    const std::string_view ciphertext, const std::string_view reference, const key_search_options &options,
+    const std::function<void(const cipher::substitution_solution &)> &on_progress = {}) noexcept
+{
+#ifdef __linux__
+    using namespace key_search_detail;
+    const auto socket{socket_file::claim(options.socket_path)};
+    if (!socket)
+    {
+        return std::unexpected{socket.error()};
+    }
+    const auto &socket_path{socket->path()};
+    const auto address{address_of(socket_path)};
+    if (!address)
+    {
+        return std::unexpected{std::format("Socket path too long: {}", socket_path.string())};
+    }
+    const auto system_error{[&](const std::string &what) -> eresult<key_search_report> {
+        return std::unexpected{std::format("{} {}: {}", what, socket_path.string(),
+                                           std::generic_category().message(errno))};
+    }};
+
+    channel listener{::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if (listener.fd() < 0 ||
+        ::bind(listener.fd(), reinterpret_cast<const sockaddr *>(&*address), sizeof *address) != 0 ||
+        ::chmod(socket_path.c_str(), S_IRUSR | S_IWUSR) != 0 || ::listen(listener.fd(), SOMAXCONN) != 0)
+    {
+        return system_error("Failed to listen on");
+    }
+
+    // The job every worker is sent when it connects
+    binary_writer job{};
+    job.put(static_cast<std::uint64_t>(options.iterations)).put_bytes(ciphertext).put_bytes(reference);
+
+    std::vector<pid_t> children;
+    if (options.spawn)
+    {
+        const std::string executable{"/proc/self/exe"}, command{"search-worker"}, flag{"--socket"};
+        const std::string path{socket_path.string()};
+        char *const arguments[]{const_cast<char *>(executable.c_str()), const_cast<char *>(command.c_str()),
+                                const_cast<char *>(flag.c_str()), const_cast<char *>(path.c_str()), nullptr};
+        for (std::size_t i{}, count{options.workers > 0 ? options.workers : worker_count()}; i < count; ++i)
+        {
+            if (pid_t pid{}; ::posix_spawn(&pid, executable.c_str(), nullptr, nullptr, arguments, environ) == 0)
+            {
+                children.push_back(pid);
+            }
+        }
+        if (children.empty())
+        {
+            return system_error("Failed to spawn workers for");
+        }
+    }
+
+    struct worker
+    {
+        channel connection;
+        std::optional<std::uint64_t> shard; // claimed and not yet finished
+    };
+    std::vector<worker> workers;
+    std::deque<std::uint64_t> requeued; // shards whose worker died
+    std::uint64_t next_shard{};
+    std::size_t since_improvement{};
+    key_search_report report{{{}, -1e300, 0}, 0, 0, false};
+
+    const auto improve{[&](const cipher::substitution_solution &solution) {
+        if (solution.score > report.best.score)
+        {
+            report.best = solution;
+            if (on_progress)
+            {
+                on_progress(report.best);
+            }
+        }
+    }};
+    const auto stop_all{[&] {
+        if (!std::exchange(report.stopped_early, true))
+        {
+            for (const auto &peer : workers)
+            {
+                (void)peer.connection.send(message::stop);
+            }
+        }
+    }};
+    const auto search_done{[&] {
+        return report.stopped_early || (report.shards_finished >= options.shards && requeued.empty());
+    }};
+
+    while (true)
+    {
+        // Reap exited workers; without any left, nothing can finish the search
+        std::erase_if(children, [](const pid_t pid) { return ::waitpid(pid, nullptr, WNOHANG) == pid; });
+        if (workers.empty() && (search_done() || (options.spawn && children.empty())))
+        {
+            break;
+        }
+
+        std::vector<pollfd> entries{{listener.fd(), POLLIN, 0}};
+        for (const auto &peer : workers)
+        {
+            entries.push_back({peer.connection.fd(), POLLIN, 0});
+        }
+        if (::poll(entries.data(), static_cast<nfds_t>(entries.size()), 100) < 0 && errno != EINTR)
+        {
+            break;
+        }
+
+        if (entries[0].revents & POLLIN)
+        {
+            if (channel peer{::accept4(listener.fd(), nullptr, nullptr, SOCK_CLOEXEC)}; peer.fd() >= 0)
+            {
+                if (peer.send(message::job, job.bytes()))
+                {
+                    report.workers++;
+                    workers.push_back({std::move(peer), std::nullopt});
+                    if (report.stopped_early)
+                    {
+                        (void)workers.back().connection.send(message::stop);
+                    }
+                }
+            }
+        }
+
+        // Serve each worker that has something to say; the new one, if any, has not been polled yet
+        for (std::size_t i{entries.size() - 1}; i > 0; --i)
+        {
+            if (!(entries[i].revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                continue;
+            }
+            auto &peer{workers[i - 1]};
+            const auto received{peer.connection.receive()};
+            if (!received)
+            {
+                if (peer.shard)
+                {
+                    requeued.push_back(*peer.shard);
+                }
+                workers.erase(workers.begin() + static_cast<std::ptrdiff_t>(i - 1));
+                continue;
+            }
+
+            const auto &[type, payload]{*received};
+            if (type == message::claim)
+            {
+                std::optional<std::uint64_t> shard{};
+                if (!search_done() && !requeued.empty())
+                {
+                    shard = requeued.front();
+                    requeued.pop_front();
+                }
+                else if (!search_done() && next_shard < options.shards)
+                {
+                    shard = next_shard++;
+                }
+                peer.shard = shard;
+                if (shard)
+                {
+                    binary_writer assignment{};
+                    assignment.put(*shard);
+                    (void)peer.connection.send(message::assign, assignment.bytes());
+                }
+                else
+                {
+                    (void)peer.connection.send(message::stop);
+                }
+            }
+            else if (const auto solution{read_solution(payload)};
+                     solution && (type == message::progress || type == message::finished))
+            {
+                improve(*solution);
+                if (type == message::finished)
+                {
+                    // The shard may have taken the lead with its progress already
+                    peer.shard.reset();
+                    report.shards_finished++;
+                    since_improvement = report.best.shard == solution->shard ? 0 : since_improvement + 1;
+                }
+                if ((options.target && report.best.score >= *options.target) ||
+                    (options.patience > 0 && since_improvement >= options.patience))
+                {
+                    stop_all();
+                }
+            }
+        }
+    }
+
+    for (const pid_t pid : children)
+    {
+        ::waitpid(pid, nullptr, 0);
+    }
+    if (report.best.mapping.empty())
+    {
+        return std::unexpected{"No worker finished a shard"};
+    }
+    return report;
+#else
+    (void)ciphertext, (void)reference, (void)options, (void)on_progress;
+    return std::unexpected{"The key search coordinator needs Unix domain sockets and /proc, which only Linux has here"};
+#endif
+}
+} // namespace tprotect
@@ -0,0 +1,86 @@
+// latency_histogram.hpp: Fixed-Memory Latency Percentiles
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace tprotect
+{
+/**
+ * @brief Counts latencies in log-linear buckets, so percentiles cost constant memory however many are recorded
+ *
+ * Each power of two of nanoseconds is split into 8 buckets, which bounds the error of a reported percentile to
+ * 12.5%; `max()` is exact
+ *
+ */
+class latency_histogram
+{
+  public:
+    void record(const std::chrono::nanoseconds latency, const std::uint64_t count = 1) noexcept
+    {
+        const auto value{static_cast<std::uint64_t>(std::max<std::int64_t>(0, latency.count()))};
+        buckets_[bucket_of(value)] += count;
+        total_ += count;
+        max_ = std::max(max_, value);
+    }
+
+    [[nodiscard]] std::uint64_t count() const noexcept
+    {
+        return total_;
+    }
+
+    [[nodiscard]] std::chrono::nanoseconds max() const noexcept
+    {
+        return std::chrono::nanoseconds{max_};
+    }
+
+    // The upper edge of the bucket holding the `fraction` quantile, e.g. 0.99; zero if nothing was recorded
+    [[nodiscard]] std::chrono::nanoseconds percentile(const double fraction) const noexcept
+    {
+        const auto rank{static_cast<std::uint64_t>(std::clamp(fraction, 0., 1.) * static_cast<double>(total_))};
+        std::uint64_t seen{};
+        for (std::size_t bucket{}; bucket < buckets_.size(); ++bucket)
+        {
+            seen += buckets_[bucket];
+            if (seen > rank || (seen == total_ && total_ > 0))
+            {
+                return std::chrono::nanoseconds{std::min(max_, upper_edge(bucket))};
+            }
+        }
+        return {};
+    }
+
+  private:
+    static constexpr std::size_t sub_buckets{8};
+
+    // Values below 8 get a bucket each; above, bucket = 8 * (bit width - 3) + the three bits after the leading one
+    static constexpr std::size_t bucket_of(const std::uint64_t value) noexcept
+    {
+        if (value < sub_buckets)
+        {
+            return static_cast<std::size_t>(value);
+        }
+        const auto width{static_cast<std::size_t>(std::bit_width(value))};
+        return sub_buckets * (width - 3) + static_cast<std::size_t>((value >> (width - 4)) & (sub_buckets - 1));
+    }
+
+    static constexpr std::uint64_t upper_edge(const std::size_t bucket) noexcept
+    {
+        if (bucket < sub_buckets)
+        {
+            return bucket;
+        }
+        const std::size_t width{bucket / sub_buckets + 3}, sub{bucket % sub_buckets};
+        return ((sub_buckets + sub + 1) << (width - 4)) - 1;
+    }
+
+    std::array<std::uint64_t, sub_buckets * 62> buckets_{};
+    std::uint64_t total_{};
+    std::uint64_t max_{};
+};
+} // namespace tprotect
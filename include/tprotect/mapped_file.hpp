@@ -0,0 +1,141 @@
+// mapped_file.hpp: Read-Only Memory-Mapped Files
+
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TPROTECT_HAS_MMAP 1
+#endif
+
+#include <tprotect/global.hpp>
+
+namespace tprotect
+{
+/**
+ * @brief A read-only view of a whole file
+ *
+ * The file is mapped into memory where the platform supports it, otherwise it is read into an owned buffer. Either
+ * way `view()` stays valid for the lifetime of the object
+ *
+ */
+class mapped_file
+{
+  public:
+    mapped_file() noexcept = default;
+
+    /**
+     * @brief Map the file at the given path
+     *
+     * @return cresult<mapped_file> the mapping, or the reason it failed, with the path as context
+     */
+    [[nodiscard]] static cresult<mapped_file> open(const std::string &file_name) noexcept
+    {
+        mapped_file file{};
+#ifdef TPROTECT_HAS_MMAP
+        const int fd{::open(file_name.c_str(), O_RDONLY | O_CLOEXEC)};
+        if (fd < 0)
+        {
+            return std::unexpected{compact_error{errc::open_failed, file_name}};
+        }
+        struct stat st{};
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return std::unexpected{compact_error{errc::stat_failed, file_name}};
+        }
+        file.size_ = static_cast<std::size_t>(st.st_size);
+        if (file.size_ > 0) // zero-length mappings are invalid
+        {
+            void *const address{::mmap(nullptr, file.size_, PROT_READ, MAP_PRIVATE, fd, 0)};
+            if (address == MAP_FAILED)
+            {
+                ::close(fd);
+                return std::unexpected{compact_error{errc::map_failed, file_name}};
+            }
+            ::madvise(address, file.size_, MADV_SEQUENTIAL); // every consumer so far scans front to back
+            file.data_ = static_cast<const char *>(address);
+        }
+        ::close(fd); // the mapping keeps its own reference
+#else
+        std::ifstream ifs{file_name, std::ios::binary};
+        if (!ifs)
+        {
+            return std::unexpected{compact_error{errc::open_failed, file_name}};
+        }
+        file.fallback_.assign(std::istreambuf_iterator{ifs}, {});
+        if (!ifs && !ifs.eof())
+        {
+            return std::unexpected{compact_error{errc::read_failed, file_name}};
+        }
+        file.data_ = file.fallback_.data();
+        file.size_ = file.fallback_.size();
+#endif
+        return {std::move(file)};
+    }
+
+    [[nodiscard]] std::string_view view() const noexcept
+    {
+        return {data_, size_};
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    ~mapped_file()
+    {
+        release();
+    }
+
+    // Disable copying and enable moving
+    mapped_file(const mapped_file &) noexcept = delete;
+    mapped_file &operator=(const mapped_file &) noexcept = delete;
+    mapped_file(mapped_file &&other) noexcept
+    {
+        *this = std::move(other);
+    }
+    mapped_file &operator=(mapped_file &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            fallback_ = std::move(other.fallback_);
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            if (!fallback_.empty())
+            {
+                data_ = fallback_.data(); // the small-string buffer may have moved
+            }
+        }
+        return *this;
+    }
+
+  private:
+    void release() noexcept
+    {
+#ifdef TPROTECT_HAS_MMAP
+        if (data_ != nullptr && fallback_.empty())
+        {
+            ::munmap(const_cast<char *>(data_), size_);
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+        fallback_.clear();
+    }
+
+    const char *data_{};
+    std::size_t size_{};
+    std::string fallback_; // only used where mmap is unavailable
+};
+} // namespace tprotect
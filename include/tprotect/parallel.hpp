@@ -0,0 +1,118 @@
+// parallel.hpp: Parallel Loop Helpers
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <tprotect/executor.hpp>
+#include <tprotect/global.hpp>
+
+namespace tprotect
+{
+/**
+ * @brief Get the number of slots a parallel loop may hand to its body
+ *
+ * Every pool worker plus the calling thread, so per-slot accumulators sized by this never collide
+ *
+ * @return std::size_t at least one
+ */
+[[nodiscard]] inline std::size_t worker_count() noexcept
+{
+    return executor::instance().worker_count() + 1;
+}
+
+/**
+ * @brief Run `body(index, slot)` for every index in [0, count) on the shared executor
+ *
+ * Indices are handed out dynamically, so uneven work items still balance. `slot` is in [0, worker_count()) and can
+ * be used to address per-thread accumulators without locking. Work runs at the calling thread's priority and stops
+ * taking new indices once `token` is cancelled
+ *
+ */
+template <typename F>
+void parallel_for(const std::size_t count, F &&body, const cancellation_token &token = {}) noexcept
+{
+    executor::instance().for_each_index(count, body, token);
+}
+
+/**
+ * @brief Make a string of `size` bytes, all of which `fill(data)` writes, without clearing them first
+ *
+ * Callers fill the bytes from the pool, so each chunk's pages are first touched by the worker that writes them
+ *
+ */
+template <typename F> [[nodiscard]] std::string fill_string(const std::size_t size, F &&fill) noexcept
+{
+    std::string output;
+    // The callback's own size argument is not used, as some standard libraries (libstdc++ 12) pass the capacity there
+    output.resize_and_overwrite(size, [&](char *const data, std::size_t) {
+        fill(data);
+        return size;
+    });
+    return output;
+}
+
+/**
+ * @brief Apply a length-preserving, position-independent transform (e.g. a substitution) to `input` in parallel
+ *
+ * The output is allocated but never written by the calling thread, so each chunk's pages are first touched by the
+ * thread that transforms the chunk; with a multi-node topology that places them on the node that will also process
+ * them in later passes of the same chunking. A transform that changes a chunk's length is rerun on the whole input
+ *
+ * @param transform `cresult<std::string>(std::string_view)`
+ */
+template <typename F>
+[[nodiscard]] cresult<std::string> parallel_transform(const std::string_view input, F &&transform,
+                                                      const std::size_t chunk_size = 1 << 20) noexcept
+{
+    const std::size_t chunks{(input.size() + chunk_size - 1) / chunk_size};
+    if (chunks <= 1)
+    {
+        return transform(input);
+    }
+
+    // A `compact_error`'s context is only readable on the worker that raised it, so it is copied out there
+    std::mutex error_mutex;
+    std::optional<std::pair<errc, std::string>> error{};
+    std::atomic<bool> resized{};
+    const std::size_t size{input.size()};
+    auto output{fill_string(size, [&](char *const data) {
+        parallel_for(chunks, [&](const std::size_t i, std::size_t) {
+            const std::size_t begin{i * chunk_size}, length{std::min(chunk_size, size - begin)};
+            auto result{transform(input.substr(begin, length))};
+            if (!result)
+            {
+                std::lock_guard<std::mutex> guard{error_mutex};
+                if (!error)
+                {
+                    error.emplace(result.error().code(), result.error().context());
+                }
+            }
+            else if (result->size() != length)
+            {
+                resized.store(true, std::memory_order_relaxed);
+            }
+            else
+            {
+                std::ranges::copy(*result, data + begin);
+            }
+        });
+    })};
+    if (error)
+    {
+        return std::unexpected{compact_error{error->first, error->second}}; // raised again on this thread
+    }
+    if (resized)
+    {
+        return transform(input);
+    }
+    return output;
+}
+} // namespace tprotect
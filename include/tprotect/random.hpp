@@ -0,0 +1,63 @@
+// random.hpp: Fast Deterministic Pseudo-Random Numbers
+
+#pragma once
+
+#include <cstdint>
+
+namespace tprotect
+{
+/**
+ * @brief Hash a (seed, counter) pair to 64 random-looking bits (the SplitMix64 finalizer)
+ *
+ * Counter-based, so element `i` of a stream can be generated independently of the others, e.g. by whichever thread
+ * handles the chunk it falls in
+ *
+ */
+[[nodiscard]] constexpr std::uint64_t mix64(const std::uint64_t seed, const std::uint64_t counter) noexcept
+{
+    std::uint64_t z{seed + (counter + 1) * 0x9E3779B97F4A7C15ull};
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief A small sequential generator for search heuristics; not for anything security-related
+ *
+ */
+class splitmix64
+{
+  public:
+    explicit constexpr splitmix64(const std::uint64_t seed, const std::uint64_t counter = 0) noexcept
+        : seed_{seed}, counter_{counter}
+    {
+    }
+
+    // With the seed, where the sequence stands, e.g. to resume it from a checkpoint
+    [[nodiscard]] constexpr std::uint64_t counter() const noexcept
+    {
+        return counter_;
+    }
+
+    constexpr std::uint64_t next() noexcept
+    {
+        return mix64(seed_, counter_++);
+    }
+
+    // Uniform in [0, bound), by multiply-shift rather than modulo
+    constexpr std::uint32_t below(const std::uint32_t bound) noexcept
+    {
+        return static_cast<std::uint32_t>(((next() >> 32) * bound) >> 32);
+    }
+
+    // Uniform in [0, 1)
+    constexpr double unit() noexcept
+    {
+        return static_cast<double>(next() >> 11) * 0x1.0p-53;
+    }
+
+  private:
+    std::uint64_t seed_;
+    std::uint64_t counter_;
+};
+} // namespace tprotect
@@ -0,0 +1,160 @@
+// startup_timeline.hpp: Wall And CPU Time Of Startup Phases
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <format>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <tprotect/global.hpp>
+
+namespace tprotect
+{
+/**
+ * @brief Records how long each startup phase took, on whichever thread it ran, and the time to the first frame
+ *
+ * The singleton should be acquired by `startup_timeline::instance()`; its first acquisition is time zero, so it
+ * should happen as early in `main` as possible. Phases may be recorded concurrently
+ *
+ */
+class startup_timeline final
+{
+  public:
+    using clock = std::chrono::steady_clock;
+
+    struct phase_record
+    {
+        std::string name;
+        clock::duration begin; // since time zero
+        clock::duration wall;
+        std::chrono::nanoseconds cpu; // of the recording thread
+        bool on_main_thread;
+    };
+
+    /**
+     * @brief Times one phase from construction to destruction
+     *
+     */
+    class scope
+    {
+      public:
+        scope(startup_timeline &timeline, std::string name) noexcept
+            : timeline_{&timeline}, name_{std::move(name)}, wall_{clock::now()}, cpu_{thread_cpu_time()}
+        {
+        }
+
+        ~scope()
+        {
+            if (timeline_ != nullptr)
+            {
+                timeline_->record(std::move(name_), wall_, clock::now(), thread_cpu_time() - cpu_);
+            }
+        }
+
+        // Disable copying and enable moving
+        scope(const scope &) noexcept = delete;
+        scope &operator=(const scope &) noexcept = delete;
+        scope(scope &&other) noexcept
+            : timeline_{std::exchange(other.timeline_, nullptr)}, name_{std::move(other.name_)}, wall_{other.wall_},
+              cpu_{other.cpu_}
+        {
+        }
+        scope &operator=(scope &&) noexcept = delete;
+
+      private:
+        startup_timeline *timeline_;
+        std::string name_;
+        clock::time_point wall_;
+        std::chrono::nanoseconds cpu_;
+    };
+
+    static startup_timeline &instance() noexcept
+    {
+        static startup_timeline instance{};
+        return instance;
+    }
+
+    [[nodiscard]] scope phase(std::string name) noexcept
+    {
+        return scope{*this, std::move(name)};
+    }
+
+    // Only the first call counts
+    void mark_first_frame() noexcept
+    {
+        std::lock_guard<std::mutex> guard{mutex_};
+        if (!first_frame_)
+        {
+            first_frame_ = clock::now() - origin_;
+        }
+    }
+
+    [[nodiscard]] oresult<clock::duration> time_to_first_frame() const noexcept
+    {
+        std::lock_guard<std::mutex> guard{mutex_};
+        return first_frame_;
+    }
+
+    [[nodiscard]] std::vector<phase_record> phases() const noexcept
+    {
+        std::lock_guard<std::mutex> guard{mutex_};
+        return phases_;
+    }
+
+    // One line per phase in start order, then the time to first frame
+    [[nodiscard]] std::string report() const noexcept
+    {
+        const auto milliseconds{[](const auto duration) {
+            return std::chrono::duration<double, std::milli>{duration}.count();
+        }};
+        std::lock_guard<std::mutex> guard{mutex_};
+        std::string result{std::format("{:<24}{:>10}{:>10}{:>10}  thread\n", "phase", "start ms", "wall ms", "cpu ms")};
+        for (const auto &phase : phases_)
+        {
+            result += std::format("{:<24}{:>10.1f}{:>10.1f}{:>10.1f}  {}\n", phase.name, milliseconds(phase.begin),
+                                  milliseconds(phase.wall), milliseconds(phase.cpu),
+                                  phase.on_main_thread ? "main" : "worker");
+        }
+        if (first_frame_)
+        {
+            result += std::format("time_to_first_frame_ms {:.1f}\n", milliseconds(*first_frame_));
+        }
+        return result;
+    }
+
+  private:
+    startup_timeline() noexcept = default;
+
+    static std::chrono::nanoseconds thread_cpu_time() noexcept
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        timespec now{};
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+        return std::chrono::seconds{now.tv_sec} + std::chrono::nanoseconds{now.tv_nsec};
+#else
+        return std::chrono::nanoseconds{std::clock() * (1'000'000'000 / CLOCKS_PER_SEC)}; // process-wide
+#endif
+    }
+
+    void record(std::string name, const clock::time_point begin, const clock::time_point end,
+                const std::chrono::nanoseconds cpu) noexcept
+    {
+        std::lock_guard<std::mutex> guard{mutex_};
+        const auto at{std::ranges::upper_bound(phases_, begin - origin_, {}, &phase_record::begin)};
+        phases_.insert(at, {std::move(name), begin - origin_, end - begin, cpu,
+                            std::this_thread::get_id() == main_thread_});
+    }
+
+    const clock::time_point origin_{clock::now()};
+    const std::thread::id main_thread_{std::this_thread::get_id()};
+    mutable std::mutex mutex_;
+    std::vector<phase_record> phases_;
+    oresult<clock::duration> first_frame_;
+};
+} // namespace tprotect
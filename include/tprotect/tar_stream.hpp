@@ -0,0 +1,329 @@
+// tar_stream.hpp: Streaming Transformation Of Tar Archives
+
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <format>
+#include <functional>
+#include <future>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <tprotect/checkpoint.hpp>
+#include <tprotect/executor.hpp>
+#include <tprotect/global.hpp>
+
+namespace tprotect
+{
+struct tar_report
+{
+    std::size_t members;     // every header, including directories and extended headers
+    std::size_t transformed; // regular files whose payload went through the transform
+    std::uint64_t bytes;     // archive bytes written
+};
+
+/**
+ * @brief Apply `transform` to the payload of every regular file in a tar stream, copying everything else verbatim
+ *
+ * The archive is read once, front to back, and never held whole: payloads are cut into chunks that are transformed
+ * on the executor while later ones are still being read, and written in archive order as they complete, with at
+ * most `window` chunks in flight. Headers, padding and the end-of-archive blocks are copied unchanged, which is only
+ * valid because the transform must preserve length; one that does not fails the run. ustar, GNU and pax archives
+ * are understood, including pax size overrides and base-256 sizes
+ *
+ * With a `checkpoint`, the input and output offsets are saved at member boundaries, after draining the chunks in
+ * flight, so an interrupted run resumes by seeking both streams; they must then be seekable files, and the output must
+ * be opened without truncation and cut to `bytes` afterwards
+ *
+ * @param transform `cresult<std::string>(std::string_view)`, applied to each chunk independently
+ */
+[[nodiscard]] inline eresult<tar_report> transform_tar(
+    std::istream &input, std::ostream &output, const std::function<cresult<std::string>(std::string_view)> &transform,
+    const std::size_t chunk_size = 1 << 20,
+    const std::size_t window = 2 * executor::instance().worker_count() + 2,
+    checkpointer *const checkpoint = nullptr) noexcept
+{
+    constexpr std::size_t block{512};
+
+    tar_report report{};
+    std::uint64_t offset{}; // of the next byte to read
+    if (const auto saved{checkpoint ? checkpoint->load() : std::nullopt})
+    {
+        binary_reader reader{*saved};
+        const auto input_offset{reader.get<std::uint64_t>()};
+        const auto output_offset{reader.get<std::uint64_t>()};
+        const auto members{reader.get<std::uint64_t>()};
+        const auto transformed{reader.get<std::uint64_t>()};
+        if (input_offset && output_offset && members && transformed)
+        {
+            if (!input.seekg(static_cast<std::streamoff>(*input_offset)) ||
+                !output.seekp(static_cast<std::streamoff>(*output_offset)))
+            {
+                return std::unexpected{"Resuming from a checkpoint needs seekable files"};
+            }
+            offset = *input_offset;
+            report = {static_cast<std::size_t>(*members), static_cast<std::size_t>(*transformed), *output_offset};
+        }
+    }
+
+    std::deque<std::future<eresult<std::string>>> in_flight;
+    std::string first_error{};
+
+    // Write the oldest chunk once it is ready, keeping archive order
+    const auto drain_one{[&] {
+        auto result{in_flight.front().get()};
+        in_flight.pop_front();
+        if (!result)
+        {
+            first_error = first_error.empty() ? std::move(result.error()) : first_error;
+            return;
+        }
+        if (first_error.empty() && !output.write(result->data(), static_cast<std::streamsize>(result->size())))
+        {
+            first_error = "Failed to write the output archive";
+        }
+        report.bytes += result->size();
+    }};
+    // Block only when the window is full, but write whatever is already done
+    const auto enqueue{[&](std::future<eresult<std::string>> chunk) {
+        in_flight.push_back(std::move(chunk));
+        const auto front_ready{[&] {
+            return !in_flight.empty() &&
+                   in_flight.front().wait_for(std::chrono::seconds{0}) == std::future_status::ready;
+        }};
+        while (in_flight.size() > std::max<std::size_t>(1, window) || front_ready())
+        {
+            drain_one();
+        }
+    }};
+    const auto verbatim{[&](std::string bytes) {
+        std::promise<eresult<std::string>> ready;
+        ready.set_value(std::move(bytes));
+        enqueue(ready.get_future());
+    }};
+    const auto read_exactly{[&](const std::size_t size) -> eresult<std::string> {
+        std::string bytes(size, '\0');
+        if (!input.read(bytes.data(), static_cast<std::streamsize>(size)))
+        {
+            return std::unexpected{std::format("Truncated tar archive at byte {}", offset)};
+        }
+        offset += size;
+        return bytes;
+    }};
+
+    // A numeric field: octal digits padded with spaces or NULs, or big-endian base-256 if the top bit is set
+    const auto parse_number{[](const std::string_view field) -> oresult<std::uint64_t> {
+        std::uint64_t value{};
+        if (!field.empty() && (static_cast<unsigned char>(field[0]) & 0x80) != 0)
+        {
+            for (std::size_t i{}; i < field.size(); ++i)
+            {
+                value = value << 8 | static_cast<unsigned char>(i == 0 ? field[i] & 0x7f : field[i]);
+            }
+            return value;
+        }
+        const auto first{field.find_first_not_of(' ')};
+        const auto digits{field.substr(std::min(first, field.size()))};
+        const auto end{std::min(digits.find_first_of(std::string_view{" \0", 2}), digits.size())};
+        if (end == 0)
+        {
+            return std::uint64_t{};
+        }
+        if (const auto parsed{std::from_chars(digits.data(), digits.data() + end, value, 8)};
+            parsed.ec != std::errc{} || parsed.ptr != digits.data() + end)
+        {
+            return std::nullopt;
+        }
+        return value;
+    }};
+
+    // The size record of a pax extended header, if any; records are "<length> <key>=<value>\n", where the length
+    // counts the whole record and values may hold anything, so each record is split at its own length
+    const auto parse_pax_size{[](std::string_view text) -> eresult<oresult<std::uint64_t>> {
+        oresult<std::uint64_t> size{};
+        while (!text.empty())
+        {
+            std::size_t length{};
+            const auto parsed{std::from_chars(text.data(), text.data() + text.size(), length)};
+            const auto prefix{static_cast<std::size_t>(parsed.ptr - text.data())};
+            if (parsed.ec != std::errc{} || prefix == 0 || length <= prefix + 1 || length > text.size() ||
+                *parsed.ptr != ' ' || text[length - 1] != '\n')
+            {
+                return std::unexpected{"Malformed pax record"};
+            }
+            const auto record{text.substr(prefix + 1, length - prefix - 2)};
+            text.remove_prefix(length);
+            const auto equals{record.find('=')};
+            if (equals == std::string_view::npos)
+            {
+                return std::unexpected{"Malformed pax record"};
+            }
+            if (record.substr(0, equals) != "size")
+            {
+                continue;
+            }
+            const auto digits{record.substr(equals + 1)};
+            std::uint64_t value{};
+            if (const auto number{std::from_chars(digits.data(), digits.data() + digits.size(), value)};
+                digits.empty() || number.ec != std::errc{} || number.ptr != digits.data() + digits.size())
+            {
+                return std::unexpected{"Malformed pax size"};
+            }
+            size = value; // decimal, unlike the header fields
+        }
+        return size;
+    }};
+
+    oresult<std::uint64_t> pax_size{}; // from an extended header, applying to the next member only
+    while (first_error.empty())
+    {
+        if (checkpoint && !pax_size && checkpoint->due())
+        {
+            // Between members, with everything before `offset` written, the archive can be resumed from here
+            while (!in_flight.empty())
+            {
+                drain_one();
+            }
+            if (first_error.empty() && output.flush())
+            {
+                binary_writer writer{};
+                writer.put(offset).put(report.bytes).put<std::uint64_t>(report.members).put<std::uint64_t>(
+                    report.transformed);
+                [[maybe_unused]] const auto saved{checkpoint->save(writer.bytes())}; // a failed save costs redoing
+            }
+        }
+
+        auto header{read_exactly(block)};
+        if (!header)
+        {
+            if (input.gcount() == 0 && input.eof())
+            {
+                break; // no end-of-archive blocks, which some writers omit
+            }
+            first_error = header.error();
+            break;
+        }
+        const std::string_view fields{*header};
+        if (fields.find_first_not_of('\0') == std::string_view::npos)
+        {
+            // End of archive: copy it and whatever follows verbatim
+            verbatim(std::move(*header));
+            std::string rest(chunk_size, '\0');
+            while (input.read(rest.data(), static_cast<std::streamsize>(rest.size())) || input.gcount() > 0)
+            {
+                verbatim(rest.substr(0, static_cast<std::size_t>(input.gcount())));
+            }
+            break;
+        }
+
+        unsigned checksum{};
+        for (std::size_t i{}; i < block; ++i)
+        {
+            checksum += i >= 148 && i < 156 ? ' ' : static_cast<unsigned char>(fields[i]);
+        }
+        const auto stored_checksum{parse_number(fields.substr(148, 8))};
+        const auto header_size{parse_number(fields.substr(124, 12))};
+        if (!stored_checksum || *stored_checksum != checksum || !header_size)
+        {
+            first_error = std::format("Corrupt tar header at byte {}", offset - block);
+            break;
+        }
+
+        const char type{fields[156]};
+        const std::uint64_t size{pax_size.value_or(*header_size)};
+        pax_size.reset();
+        report.members++;
+        verbatim(std::move(*header));
+
+        const std::uint64_t padded{(size + block - 1) / block * block};
+        if (type == 'x')
+        {
+            // pax extended header; only the size matters here
+            auto records{read_exactly(static_cast<std::size_t>(padded))};
+            if (!records)
+            {
+                first_error = records.error();
+                break;
+            }
+            const auto parsed{parse_pax_size(std::string_view{*records}.substr(0, static_cast<std::size_t>(size)))};
+            if (!parsed)
+            {
+                first_error = std::format("{} in the tar header at byte {}", parsed.error(), offset - padded - block);
+                break;
+            }
+            pax_size = *parsed;
+            verbatim(std::move(*records));
+            continue;
+        }
+
+        const bool regular{type == '0' || type == '\0' || type == '7'};
+        for (std::uint64_t remaining{size}; remaining > 0 && first_error.empty();)
+        {
+            const auto length{static_cast<std::size_t>(std::min<std::uint64_t>(remaining, chunk_size))};
+            auto payload{read_exactly(length)};
+            if (!payload)
+            {
+                first_error = payload.error();
+                break;
+            }
+            remaining -= length;
+            if (!regular)
+            {
+                verbatim(std::move(*payload));
+                continue;
+            }
+            enqueue(executor::instance().async([&transform, chunk = std::move(*payload)]() -> eresult<std::string> {
+                return transform(chunk)
+                    .transform_error(&compact_error::message) // on this worker, where the context lives
+                    .and_then([&](std::string result) -> eresult<std::string> {
+                        if (result.size() != chunk.size())
+                        {
+                            return std::unexpected{"The cipher changes the length of the text, which tar cannot hold"};
+                        }
+                        return result;
+                    });
+            }));
+        }
+        if (regular)
+        {
+            report.transformed++;
+        }
+        if (padded > size && first_error.empty())
+        {
+            auto padding{read_exactly(static_cast<std::size_t>(padded - size))};
+            if (!padding)
+            {
+                first_error = padding.error();
+                break;
+            }
+            verbatim(std::move(*padding));
+        }
+    }
+
+    while (!in_flight.empty())
+    {
+        drain_one();
+    }
+    if (first_error.empty() && !output.flush())
+    {
+        first_error = "Failed to write the output archive";
+    }
+    if (!first_error.empty())
+    {
+        return std::unexpected{std::move(first_error)};
+    }
+    if (checkpoint)
+    {
+        checkpoint->remove();
+    }
+    return report;
+}
+} // namespace tprotect
@@ -0,0 +1,565 @@
+// text_encoding.hpp: Detecting And Transcoding UTF-16 And Latin-1 Text
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <tprotect/global.hpp>
+#include <tprotect/parallel.hpp>
+
+namespace tprotect
+{
+enum class text_encoding : std::uint8_t
+{
+    utf8,
+    utf16le,
+    utf16be,
+    latin1,
+};
+
+/**
+ * @brief How a text file was stored, so that it can be saved back the same way
+ *
+ */
+struct text_format
+{
+    text_encoding encoding{text_encoding::utf8};
+    bool bom{};  // starts with a byte order mark
+    bool crlf{}; // lines end in CR LF
+};
+
+namespace text_encoding_detail
+{
+constexpr std::size_t chunk_size{1 << 20};
+constexpr std::size_t block_size{32};
+constexpr std::string_view replacement{"\xef\xbf\xbd"}; // U+FFFD
+
+[[nodiscard]] constexpr bool is_continuation(const std::uint8_t byte) noexcept
+{
+    return (byte & 0xc0) == 0x80;
+}
+
+// Chunk starts over `units` units, each moved past up to `max_skip` units that continue the character before them
+template <typename Inside>
+[[nodiscard]] std::vector<std::size_t> chunk_starts(const std::size_t units, const std::size_t max_skip,
+                                                    Inside &&inside) noexcept
+{
+    const std::size_t chunks{(units + chunk_size - 1) / chunk_size};
+    std::vector<std::size_t> starts(chunks + 1, units);
+    for (std::size_t c{}; c < chunks; ++c)
+    {
+        starts[c] = std::max(c > 0 ? starts[c - 1] : 0, c * chunk_size);
+        for (std::size_t skipped{}; skipped < max_skip && starts[c] < units && inside(starts[c]); ++skipped)
+        {
+            starts[c]++;
+        }
+    }
+    return starts;
+}
+
+/**
+ * @brief Transcode chunks in parallel: `measure(begin, end)` sizes each chunk's output, then `write(begin, end, out)`
+ * writes it at its place after `prefix`
+ *
+ */
+template <typename Measure, typename Write>
+[[nodiscard]] std::string transcode(const std::vector<std::size_t> &starts, const std::string_view prefix,
+                                    Measure &&measure, Write &&write) noexcept
+{
+    const std::size_t chunks{starts.size() - 1};
+    std::vector<std::size_t> offsets(chunks + 1, prefix.size());
+    parallel_for(chunks, [&](const std::size_t c, std::size_t) {
+        offsets[c + 1] = measure(starts[c], starts[c + 1]);
+    });
+    for (std::size_t c{1}; c < offsets.size(); ++c)
+    {
+        offsets[c] += offsets[c - 1];
+    }
+
+    const std::size_t size{offsets.back()};
+    return fill_string(size, [&](char *const data) {
+        std::ranges::copy(prefix, data);
+        parallel_for(chunks, [&](const std::size_t c, std::size_t) {
+            write(starts[c], starts[c + 1], reinterpret_cast<std::uint8_t *>(data) + offsets[c]);
+        });
+    });
+}
+
+// Whether `bytes` is well-formed UTF-8: no stray continuations, overlong forms, surrogates or values past U+10FFFF
+[[nodiscard]] inline bool valid_utf8(const std::string_view bytes) noexcept
+{
+    const auto *const in{reinterpret_cast<const std::uint8_t *>(bytes.data())};
+    const std::size_t size{bytes.size()};
+    const auto starts{chunk_starts(size, 3, [&](const std::size_t i) { return is_continuation(in[i]); })};
+    std::atomic<bool> valid{true};
+    parallel_for(starts.size() - 1, [&](const std::size_t c, std::size_t) {
+        std::size_t i{starts[c]};
+        if (i < size && is_continuation(in[i]))
+        {
+            valid.store(false, std::memory_order_relaxed); // more than three continuations in a row
+            return;
+        }
+        while (i < starts[c + 1])
+        {
+            // Eight ASCII bytes at a time
+            if (i + 8 <= size)
+            {
+                std::uint64_t word{};
+                std::memcpy(&word, in + i, sizeof(word));
+                if ((word & 0x8080808080808080) == 0)
+                {
+                    i += 8;
+                    continue;
+                }
+            }
+            const std::uint8_t lead{in[i]};
+            if (lead < 0x80)
+            {
+                i++;
+                continue;
+            }
+            const std::size_t length{lead >= 0xc2 && lead <= 0xdf   ? 2u
+                                     : lead >= 0xe0 && lead <= 0xef ? 3u
+                                     : lead >= 0xf0 && lead <= 0xf4 ? 4u
+                                                                    : 0u};
+            bool ok{length > 0 && i + length <= size};
+            for (std::size_t k{1}; ok && k < length; ++k)
+            {
+                ok = is_continuation(in[i + k]);
+            }
+            // The second byte's range rules out overlong forms, surrogates and values past U+10FFFF
+            ok = ok && !(lead == 0xe0 && in[i + 1] < 0xa0) && !(lead == 0xed && in[i + 1] >= 0xa0) &&
+                 !(lead == 0xf0 && in[i + 1] < 0x90) && !(lead == 0xf4 && in[i + 1] >= 0x90);
+            if (!ok)
+            {
+                valid.store(false, std::memory_order_relaxed);
+                return;
+            }
+            i += length;
+        }
+    });
+    return valid.load();
+}
+
+// UTF-8 or Latin-1 to UTF-8 with LF line endings
+[[nodiscard]] inline std::string decode_bytes(const std::string_view bytes, const bool latin1) noexcept
+{
+    const auto *const in{reinterpret_cast<const std::uint8_t *>(bytes.data())};
+    const std::size_t size{bytes.size()};
+    if (!latin1 && bytes.find('\r') == std::string_view::npos)
+    {
+        return std::string{bytes};
+    }
+    // A CR right before an LF is dropped, so chunks only ever look one byte past their end
+    const auto dropped{[&](const std::size_t i) { return in[i] == '\r' && i + 1 < size && in[i + 1] == '\n'; }};
+    return transcode(
+        chunk_starts(size, 0, [](std::size_t) { return false; }), {},
+        [&](const std::size_t begin, const std::size_t end) {
+            std::size_t count{end - begin};
+            for (std::size_t i{begin}; i < end; ++i)
+            {
+                count += latin1 && in[i] >= 0x80;
+                count -= dropped(i);
+            }
+            return count;
+        },
+        [&](std::size_t i, const std::size_t end, std::uint8_t *out) {
+            while (i < end)
+            {
+                // Blocks of ASCII, which needs no transcoding, only drop the CR of each CR LF, without branches; the
+                // block stops short of the end so the byte after it can be read
+                if (i + block_size < size && i + block_size <= end)
+                {
+                    bool ascii{true};
+                    for (std::size_t k{}; k < block_size; ++k)
+                    {
+                        ascii &= !latin1 || in[i + k] < 0x80;
+                    }
+                    if (ascii)
+                    {
+                        for (std::size_t k{i}; k < i + block_size; ++k)
+                        {
+                            *out = in[k];
+                            out += in[k] != '\r' || in[k + 1] != '\n';
+                        }
+                        i += block_size;
+                        continue;
+                    }
+                }
+                if (latin1 && in[i] >= 0x80)
+                {
+                    *out++ = static_cast<std::uint8_t>(0xc0 | in[i] >> 6);
+                    *out++ = static_cast<std::uint8_t>(0x80 | (in[i] & 0x3f));
+                }
+                else if (!dropped(i))
+                {
+                    *out++ = in[i];
+                }
+                i++;
+            }
+        });
+}
+
+// UTF-16 to UTF-8 with LF line endings; unpaired surrogates and a trailing odd byte become U+FFFD
+[[nodiscard]] inline std::string decode_utf16(const std::string_view bytes, const bool big_endian) noexcept
+{
+    const auto *const in{reinterpret_cast<const std::uint8_t *>(bytes.data())};
+    const std::size_t units{bytes.size() / 2};
+    const auto unit{[&](const std::size_t i) -> std::uint32_t {
+        return big_endian ? (in[2 * i] << 8 | in[2 * i + 1]) : (in[2 * i] | in[2 * i + 1] << 8);
+    }};
+    const auto high{[](const std::uint32_t u) { return u >= 0xd800 && u <= 0xdbff; }};
+    const auto low{[](const std::uint32_t u) { return u >= 0xdc00 && u <= 0xdfff; }};
+    const auto paired{[&](const std::size_t i) { return high(unit(i)) && i + 1 < units && low(unit(i + 1)); }};
+    const auto dropped{[&](const std::size_t i) { return unit(i) == '\r' && i + 1 < units && unit(i + 1) == '\n'; }};
+    auto output{transcode(
+        chunk_starts(units, 1, [&](const std::size_t i) { return low(unit(i)); }), {},
+        [&](const std::size_t begin, const std::size_t end) {
+            // Per unit and without branches: each half of a surrogate pair spells two of its four bytes
+            std::size_t count{};
+            for (std::size_t i{begin}; i < end; ++i)
+            {
+                const auto u{unit(i)}, previous{i > 0 ? unit(i - 1) : 0}, next{i + 1 < units ? unit(i + 1) : 0};
+                count += 1 + (u >= 0x80) + (u >= 0x800) - (high(u) && low(next)) - (low(u) && high(previous)) -
+                         (u == '\r' && next == '\n');
+            }
+            return count;
+        },
+        [&](std::size_t i, const std::size_t end, std::uint8_t *out) {
+            while (i < end)
+            {
+                // Blocks of ASCII narrow unit by unit and drop the CR of each CR LF, without branches
+                if (i + block_size < units && i + block_size <= end)
+                {
+                    bool ascii{true};
+                    for (std::size_t k{}; k < block_size; ++k)
+                    {
+                        ascii &= unit(i + k) < 0x80;
+                    }
+                    if (ascii)
+                    {
+                        for (std::size_t k{i}; k < i + block_size; ++k)
+                        {
+                            *out = static_cast<std::uint8_t>(unit(k));
+                            out += unit(k) != '\r' || unit(k + 1) != '\n';
+                        }
+                        i += block_size;
+                        continue;
+                    }
+                }
+                std::uint32_t code_point{unit(i)};
+                if (paired(i))
+                {
+                    code_point = 0x10000 + ((code_point - 0xd800) << 10) + (unit(i + 1) - 0xdc00);
+                    ++i;
+                }
+                else if (high(code_point) || low(code_point))
+                {
+                    code_point = 0xfffd;
+                }
+                if (code_point < 0x80)
+                {
+                    if (!dropped(i))
+                    {
+                        *out++ = static_cast<std::uint8_t>(code_point);
+                    }
+                }
+                else if (code_point < 0x800)
+                {
+                    *out++ = static_cast<std::uint8_t>(0xc0 | code_point >> 6);
+                    *out++ = static_cast<std::uint8_t>(0x80 | (code_point & 0x3f));
+                }
+                else if (code_point < 0x10000)
+                {
+                    *out++ = static_cast<std::uint8_t>(0xe0 | code_point >> 12);
+                    *out++ = static_cast<std::uint8_t>(0x80 | (code_point >> 6 & 0x3f));
+                    *out++ = static_cast<std::uint8_t>(0x80 | (code_point & 0x3f));
+                }
+                else
+                {
+                    *out++ = static_cast<std::uint8_t>(0xf0 | code_point >> 18);
+                    *out++ = static_cast<std::uint8_t>(0x80 | (code_point >> 12 & 0x3f));
+                    *out++ = static_cast<std::uint8_t>(0x80 | (code_point >> 6 & 0x3f));
+                    *out++ = static_cast<std::uint8_t>(0x80 | (code_point & 0x3f));
+                }
+                i++;
+            }
+        })};
+    if (bytes.size() % 2 != 0)
+    {
+        output += replacement;
+    }
+    return output;
+}
+
+// The code point of the well-formed UTF-8 sequence at `in[i]`, with its length
+[[nodiscard]] inline std::pair<std::uint32_t, std::size_t> code_point_at(const std::uint8_t *const in,
+                                                                         const std::size_t i) noexcept
+{
+    const std::uint8_t lead{in[i]};
+    const std::size_t length{lead < 0x80 ? 1u : lead < 0xe0 ? 2u : lead < 0xf0 ? 3u : 4u};
+    std::uint32_t code_point{length == 1 ? lead : lead & (0x7fu >> length)};
+    for (std::size_t k{1}; k < length; ++k)
+    {
+        code_point = code_point << 6 | (in[i + k] & 0x3fu);
+    }
+    return {code_point, length};
+}
+} // namespace text_encoding_detail
+
+/**
+ * @brief Guess how `bytes` were stored
+ *
+ * A byte order mark settles the encoding. Without one, text with many zero bytes, nearly all at either even or odd
+ * offsets, is UTF-16 in the byte order that puts them there, and anything else is UTF-8 if it is well-formed UTF-8,
+ * or Latin-1 if not, which every byte sequence is. The line endings are those of the first line
+ *
+ */
+[[nodiscard]] inline text_format detect_text_format(const std::string_view bytes) noexcept
+{
+    text_format format{};
+    if (bytes.starts_with("\xef\xbb\xbf"))
+    {
+        format = {text_encoding::utf8, true};
+    }
+    else if (bytes.starts_with("\xff\xfe"))
+    {
+        format = {text_encoding::utf16le, true};
+    }
+    else if (bytes.starts_with("\xfe\xff"))
+    {
+        format = {text_encoding::utf16be, true};
+    }
+    else
+    {
+        const std::size_t sample{std::min<std::size_t>(bytes.size(), 64 * 1024) & ~std::size_t{1}};
+        std::size_t even_zeros{}, odd_zeros{};
+        for (std::size_t i{}; i < sample; i += 2)
+        {
+            even_zeros += bytes[i] == '\0';
+            odd_zeros += bytes[i + 1] == '\0';
+        }
+        const std::size_t pairs{sample / 2};
+        if (odd_zeros * 10 > pairs * 3 && even_zeros * 4 < odd_zeros)
+        {
+            format.encoding = text_encoding::utf16le;
+        }
+        else if (even_zeros * 10 > pairs * 3 && odd_zeros * 4 < even_zeros)
+        {
+            format.encoding = text_encoding::utf16be;
+        }
+        else if (!text_encoding_detail::valid_utf8(bytes))
+        {
+            format.encoding = text_encoding::latin1;
+        }
+    }
+
+    if (format.encoding == text_encoding::utf16le || format.encoding == text_encoding::utf16be)
+    {
+        const std::string_view line_feed{format.encoding == text_encoding::utf16le ? std::string_view{"\n\0", 2}
+                                                                                    : std::string_view{"\0\n", 2}};
+        for (auto position{bytes.find(line_feed)}; position != std::string_view::npos;
+             position = bytes.find(line_feed, position + 1))
+        {
+            if (position % 2 == 0)
+            {
+                format.crlf = position >= 2 && bytes.substr(position - 2, 2) ==
+                                                   (format.encoding == text_encoding::utf16le
+                                                        ? std::string_view{"\r\0", 2}
+                                                        : std::string_view{"\0\r", 2});
+                break;
+            }
+        }
+    }
+    else if (const auto position{bytes.find('\n')}; position != std::string_view::npos)
+    {
+        format.crlf = position > 0 && bytes[position - 1] == '\r';
+    }
+    return format;
+}
+
+/**
+ * @brief `bytes` stored as `format` in UTF-8, without a byte order mark and with LF line endings
+ *
+ * Transcoding and dropping the CR of every CR LF happen in the same pass, over chunks in parallel; blocks of plain
+ * ASCII, the bulk of most text, are checked in bulk and copied or narrowed without branches
+ *
+ */
+[[nodiscard]] inline std::string decode_text(std::string_view bytes, const text_format &format) noexcept
+{
+    switch (format.encoding)
+    {
+    case text_encoding::utf8:
+        if (format.bom && bytes.starts_with("\xef\xbb\xbf"))
+        {
+            bytes.remove_prefix(3);
+        }
+        return text_encoding_detail::decode_bytes(bytes, false);
+    case text_encoding::latin1:
+        return text_encoding_detail::decode_bytes(bytes, true);
+    case text_encoding::utf16le:
+    case text_encoding::utf16be:
+        if (format.bom && bytes.size() >= 2)
+        {
+            bytes.remove_prefix(2);
+        }
+        return text_encoding_detail::decode_utf16(bytes, format.encoding == text_encoding::utf16be);
+    }
+    return std::string{bytes};
+}
+
+/**
+ * @brief UTF-8 `text` with LF line endings stored as `format`, the inverse of `decode_text()`
+ *
+ * @return the bytes, or `errc::corrupt_data` if the text is not well-formed UTF-8 when it needs decoding, or holds
+ * characters that Latin-1 cannot represent
+ */
+[[nodiscard]] inline cresult<std::string> encode_text(const std::string_view text, const text_format &format) noexcept
+{
+    using namespace text_encoding_detail;
+    const auto *const in{reinterpret_cast<const std::uint8_t *>(text.data())};
+    const std::size_t size{text.size()};
+    const bool crlf{format.crlf};
+    const auto starts{chunk_starts(size, 3, [&](const std::size_t i) { return is_continuation(in[i]); })};
+    if (format.encoding != text_encoding::utf8 && !valid_utf8(text))
+    {
+        return std::unexpected{compact_error{errc::corrupt_data, "the text is not well-formed UTF-8"}};
+    }
+
+    switch (format.encoding)
+    {
+    case text_encoding::utf8: {
+        const std::string_view bom{format.bom ? "\xef\xbb\xbf" : ""};
+        if (!crlf)
+        {
+            return std::string{bom}.append(text);
+        }
+        return transcode(
+            starts, bom,
+            [&](const std::size_t begin, const std::size_t end) {
+                return end - begin + static_cast<std::size_t>(std::count(in + begin, in + end, '\n'));
+            },
+            [&](const std::size_t begin, const std::size_t end, std::uint8_t *out) {
+                for (std::size_t i{begin}; i < end; ++i)
+                {
+                    *out = '\r';
+                    out += in[i] == '\n';
+                    *out++ = in[i];
+                }
+            });
+    }
+    case text_encoding::latin1: {
+        // Every character below U+0100 has a lead byte below 0xc4
+        std::atomic<bool> representable{true};
+        auto bytes{transcode(
+            starts, {},
+            [&](const std::size_t begin, const std::size_t end) {
+                std::size_t count{};
+                bool beyond{};
+                for (std::size_t i{begin}; i < end; ++i)
+                {
+                    count += !is_continuation(in[i]) + (crlf && in[i] == '\n');
+                    beyond |= in[i] >= 0xc4;
+                }
+                if (beyond)
+                {
+                    representable.store(false, std::memory_order_relaxed);
+                }
+                return count;
+            },
+            [&](const std::size_t begin, const std::size_t end, std::uint8_t *out) {
+                for (std::size_t i{begin}; i < end; ++i)
+                {
+                    if (in[i] < 0x80)
+                    {
+                        *out = '\r';
+                        out += crlf && in[i] == '\n';
+                        *out++ = in[i];
+                    }
+                    else if (!is_continuation(in[i]))
+                    {
+                        *out++ = static_cast<std::uint8_t>((in[i] & 0x03) << 6 | (in[i + 1] & 0x3f));
+                    }
+                }
+            })};
+        if (!representable.load())
+        {
+            return std::unexpected{compact_error{errc::corrupt_data, "the text is not representable in Latin-1"}};
+        }
+        return bytes;
+    }
+    case text_encoding::utf16le:
+    case text_encoding::utf16be: {
+        const bool big_endian{format.encoding == text_encoding::utf16be};
+        const std::string_view bom{!format.bom ? "" : big_endian ? "\xfe\xff" : "\xff\xfe"};
+        const auto put{[big_endian](std::uint8_t *const out, const std::uint32_t unit) {
+            out[big_endian ? 1 : 0] = static_cast<std::uint8_t>(unit);
+            out[big_endian ? 0 : 1] = static_cast<std::uint8_t>(unit >> 8);
+        }};
+        return transcode(
+            starts, bom,
+            [&](const std::size_t begin, const std::size_t end) {
+                std::size_t units{};
+                for (std::size_t i{begin}; i < end; ++i)
+                {
+                    units += !is_continuation(in[i]) + (in[i] >= 0xf0) + (crlf && in[i] == '\n');
+                }
+                return 2 * units;
+            },
+            [&](std::size_t i, const std::size_t end, std::uint8_t *out) {
+                while (i < end)
+                {
+                    // Blocks of ASCII widen byte by byte, putting a CR before each LF without branches
+                    if (i + block_size <= end)
+                    {
+                        bool ascii{true};
+                        for (std::size_t k{}; k < block_size; ++k)
+                        {
+                            ascii &= in[i + k] < 0x80;
+                        }
+                        if (ascii)
+                        {
+                            for (std::size_t k{i}; k < i + block_size; ++k)
+                            {
+                                put(out, '\r');
+                                out += crlf && in[k] == '\n' ? 2 : 0;
+                                put(out, in[k]);
+                                out += 2;
+                            }
+                            i += block_size;
+                            continue;
+                        }
+                    }
+                    const auto [code_point, length]{code_point_at(in, i)};
+                    if (crlf && code_point == '\n')
+                    {
+                        put(out, '\r');
+                        out += 2;
+                    }
+                    if (code_point >= 0x10000)
+                    {
+                        put(out, 0xd800 + ((code_point - 0x10000) >> 10));
+                        put(out + 2, 0xdc00 + ((code_point - 0x10000) & 0x3ff));
+                        out += 4;
+                    }
+                    else
+                    {
+                        put(out, code_point);
+                        out += 2;
+                    }
+                    i += length;
+                }
+            });
+    }
+    }
+    return std::string{text};
+}
+} // namespace tprotect
@@ -0,0 +1,260 @@
+// text_snapshot.hpp: Copy-On-Write Chunked Text With Constant-Time Snapshots
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace tprotect
+{
+namespace text_snapshot_detail
+{
+// The chunks of a text, in order, with the offset of each and the size at the end
+struct chunk_table
+{
+    std::vector<std::shared_ptr<const std::string>> chunks;
+    std::vector<std::size_t> offsets{0};
+};
+} // namespace text_snapshot_detail
+
+/**
+ * @brief An immutable view of a `text_buffer` as it was when taken, safe to read from any thread
+ *
+ * Copying one copies a pointer; the chunks are shared with the buffer and every other snapshot, and outlive the
+ * buffer if need be. Chunks never split a UTF-8 sequence, so each can be transcoded or normalized on its own
+ *
+ */
+class text_snapshot
+{
+  public:
+    text_snapshot() noexcept = default;
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return table_ ? table_->offsets.back() : 0;
+    }
+
+    [[nodiscard]] std::size_t chunk_count() const noexcept
+    {
+        return table_ ? table_->chunks.size() : 0;
+    }
+
+    [[nodiscard]] std::string_view chunk(const std::size_t index) const noexcept
+    {
+        return *table_->chunks[index];
+    }
+
+    // Where chunk `index` starts in the text
+    [[nodiscard]] std::size_t offset(const std::size_t index) const noexcept
+    {
+        return table_->offsets[index];
+    }
+
+    // The whole text in one string, for consumers that need it contiguous
+    [[nodiscard]] std::string to_string() const noexcept
+    {
+        std::string result;
+        result.reserve(size());
+        for (std::size_t i{}; i < chunk_count(); ++i)
+        {
+            result += chunk(i);
+        }
+        return result;
+    }
+
+  private:
+    friend class text_buffer;
+
+    explicit text_snapshot(std::shared_ptr<const text_snapshot_detail::chunk_table> table) noexcept
+        : table_{std::move(table)}
+    {
+    }
+
+    std::shared_ptr<const text_snapshot_detail::chunk_table> table_;
+};
+
+/**
+ * @brief Text held as reference-counted immutable chunks, so background work can take snapshots of it for free
+ *
+ * `snapshot()` shares the chunk table. Changing the text afterwards copies the table, a pointer per chunk, and
+ * replaces the chunks that changed; the chunks before and after them stay shared with every snapshot, which keeps
+ * reading the text as it was.
+ *
+ * A text widget edits its own contiguous copy of the text, so the buffer follows it in two steps: `edited()` records
+ * how far each edit left the start and the end of the text alone, and `update()` then re-cuts only the chunks between
+ * those bounds, comparing them first in case the bounds were loose. Neither looks at the rest of the text, so keeping
+ * a large text in sync costs in proportion to what was edited. Results computed from a snapshot, already in chunks,
+ * are taken over by `adopt()` without copying
+ *
+ */
+class text_buffer
+{
+  public:
+    static constexpr std::size_t chunk_size{256 * 1024};
+
+    text_buffer() noexcept = default;
+
+    explicit text_buffer(const std::string_view text) noexcept
+    {
+        assign(text);
+    }
+
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        return table_->offsets.back();
+    }
+
+    // The text as it is now, in constant time
+    [[nodiscard]] text_snapshot snapshot() const noexcept
+    {
+        return text_snapshot{table_};
+    }
+
+    void assign(const std::string_view text) noexcept
+    {
+        auto table{std::make_shared<text_snapshot_detail::chunk_table>()};
+        append_chunks(*table, text);
+        table_ = std::move(table);
+        clean();
+    }
+
+    // Take `chunks` as they are, skipping empty ones; each must hold whole UTF-8 sequences
+    void assign(std::vector<std::string> chunks) noexcept
+    {
+        auto table{std::make_shared<text_snapshot_detail::chunk_table>()};
+        for (auto &chunk : chunks)
+        {
+            if (!chunk.empty())
+            {
+                table->offsets.push_back(table->offsets.back() + chunk.size());
+                table->chunks.push_back(std::make_shared<const std::string>(std::move(chunk)));
+            }
+        }
+        table_ = std::move(table);
+        clean();
+    }
+
+    // Hold the text of `snapshot`, sharing its chunks
+    void adopt(const text_snapshot &snapshot) noexcept
+    {
+        // Every table is made mutable by some `text_buffer`, and is only changed in place while it is not shared
+        table_ = snapshot.table_ ? std::const_pointer_cast<text_snapshot_detail::chunk_table>(snapshot.table_)
+                                 : std::make_shared<text_snapshot_detail::chunk_table>();
+        clean();
+    }
+
+    // The edited text matches the buffer in at least its first `prefix` and its last `suffix` bytes
+    void edited(const std::size_t prefix, const std::size_t suffix) noexcept
+    {
+        prefix_ = std::min(prefix_, prefix);
+        suffix_ = std::min(suffix_, suffix);
+    }
+
+    // The edited text may differ anywhere, e.g. after it was loaded from a file
+    void replaced() noexcept
+    {
+        edited(0, 0);
+    }
+
+    // Make the buffer hold `text`, the edited copy, replacing only the chunks that differ from it
+    void update(const std::string_view text) noexcept
+    {
+        if (prefix_ == unedited && suffix_ == unedited)
+        {
+            return;
+        }
+        const auto &chunks{table_->chunks};
+        const auto &offsets{table_->offsets};
+        const std::size_t count{chunks.size()};
+        const std::size_t prefix{std::min({prefix_, size(), text.size()})};
+        const std::size_t suffix{std::min({suffix_, size() - prefix, text.size() - prefix})};
+        clean();
+
+        // Chunks within the bounds are kept unseen; those across them are compared, as edits are reported loosely
+        auto first{static_cast<std::size_t>(std::ranges::upper_bound(offsets, prefix) - offsets.begin() - 1)};
+        auto last{static_cast<std::size_t>(std::ranges::lower_bound(offsets, size() - suffix) - offsets.begin())};
+        first = std::min(first, count);
+        last = std::max(first, std::min(last, count));
+        std::size_t tail{size() - offsets[last]};
+        while (first < last && offsets[first + 1] + tail <= text.size() &&
+               text.substr(offsets[first], chunks[first]->size()) == *chunks[first])
+        {
+            first++;
+        }
+        while (last > first && offsets[first] + tail + chunks[last - 1]->size() <= text.size() &&
+               text.substr(text.size() - tail - chunks[last - 1]->size(), chunks[last - 1]->size()) ==
+                   *chunks[last - 1])
+        {
+            tail += chunks[last - 1]->size();
+            last--;
+        }
+        if (first == last && offsets[first] + tail == text.size())
+        {
+            return; // unchanged
+        }
+
+        // A small change takes its next chunk along, so deleting text does not leave slivers behind
+        if (text.size() - tail - offsets[first] < chunk_size / 2 && last < count)
+        {
+            tail -= chunks[last]->size();
+            last++;
+        }
+
+        // Copy the table only if a snapshot shares it; the chunks themselves are never written
+        auto table{table_.use_count() == 1 ? std::move(table_)
+                                           : std::make_shared<text_snapshot_detail::chunk_table>(*table_)};
+        text_snapshot_detail::chunk_table replaced{};
+        append_chunks(replaced, text.substr(table->offsets[first], text.size() - tail - table->offsets[first]));
+        table->chunks.erase(table->chunks.begin() + static_cast<std::ptrdiff_t>(first),
+                            table->chunks.begin() + static_cast<std::ptrdiff_t>(last));
+        table->chunks.insert(table->chunks.begin() + static_cast<std::ptrdiff_t>(first),
+                             std::make_move_iterator(replaced.chunks.begin()),
+                             std::make_move_iterator(replaced.chunks.end()));
+        table->offsets.resize(table->chunks.size() + 1);
+        for (std::size_t i{first}; i < table->chunks.size(); ++i)
+        {
+            table->offsets[i + 1] = table->offsets[i] + table->chunks[i]->size();
+        }
+        table_ = std::move(table);
+    }
+
+  private:
+    static constexpr std::size_t unedited{static_cast<std::size_t>(-1)};
+
+    void clean() noexcept
+    {
+        prefix_ = suffix_ = unedited;
+    }
+
+    [[nodiscard]] static constexpr bool is_continuation(const char byte) noexcept
+    {
+        return (static_cast<std::uint8_t>(byte) & 0xc0) == 0x80;
+    }
+
+    // Cut `text` into chunks of about `chunk_size` and append them, moving each cut past any UTF-8 sequence it splits
+    static void append_chunks(text_snapshot_detail::chunk_table &table, std::string_view text) noexcept
+    {
+        while (!text.empty())
+        {
+            std::size_t cut{std::min(text.size(), chunk_size)};
+            while (cut < text.size() && is_continuation(text[cut]))
+            {
+                cut++;
+            }
+            table.chunks.push_back(std::make_shared<const std::string>(text.substr(0, cut)));
+            table.offsets.push_back(table.offsets.back() + cut);
+            text.remove_prefix(cut);
+        }
+    }
+
+    std::shared_ptr<text_snapshot_detail::chunk_table> table_{std::make_shared<text_snapshot_detail::chunk_table>()};
+    std::size_t prefix_{unedited}; // bytes at the start of the edited text known to match, since the last update
+    std::size_t suffix_{unedited}; // and at its end
+};
+} // namespace tprotect
@@ -0,0 +1,197 @@
+// topology.hpp: CPU And Memory Node Topology
+
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <format>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace tprotect
+{
+/**
+ * @brief Which CPUs share a memory node
+ *
+ * Detected from sysfs on Linux. Machines without NUMA, other platforms and unreadable sysfs all give a single node
+ * holding every CPU, so callers never need a separate code path for them
+ *
+ */
+class cpu_topology
+{
+  public:
+    // A single node with CPUs 0 to hardware_concurrency - 1
+    cpu_topology() noexcept : nodes_{std::vector<int>(std::max(1u, std::thread::hardware_concurrency()))}
+    {
+        for (std::size_t cpu{}; cpu < nodes_.front().size(); ++cpu)
+        {
+            nodes_.front()[cpu] = static_cast<int>(cpu);
+        }
+    }
+
+    [[nodiscard]] static cpu_topology detect() noexcept
+    {
+        cpu_topology topology{};
+#ifdef __linux__
+        std::vector<std::vector<int>> nodes;
+        for (int node{};; ++node)
+        {
+            std::ifstream ifs{std::format("/sys/devices/system/node/node{}/cpulist", node)};
+            std::string list;
+            if (!ifs || !std::getline(ifs, list))
+            {
+                break;
+            }
+            if (auto cpus{parse_cpu_list(list)}; !cpus.empty())
+            {
+                nodes.push_back(std::move(cpus));
+            }
+        }
+        if (!nodes.empty())
+        {
+            topology.nodes_ = std::move(nodes);
+        }
+#endif
+        return topology;
+    }
+
+    /**
+     * @brief Pretend to have `node_count` nodes of `cpus_per_node` consecutive CPUs each
+     *
+     * For exercising node-local scheduling on single-node machines; the CPU numbers need not exist unless workers
+     * are also pinned
+     *
+     */
+    [[nodiscard]] static cpu_topology simulate(const std::size_t node_count, const std::size_t cpus_per_node) noexcept
+    {
+        cpu_topology topology{};
+        topology.nodes_.assign(std::max<std::size_t>(1, node_count), {});
+        int cpu{};
+        for (auto &node : topology.nodes_)
+        {
+            for (std::size_t i{}; i < std::max<std::size_t>(1, cpus_per_node); ++i)
+            {
+                node.push_back(cpu++);
+            }
+        }
+        return topology;
+    }
+
+    // Parse the kernel's CPU list format, e.g. "0-3,8-11"
+    [[nodiscard]] static std::vector<int> parse_cpu_list(const std::string_view list) noexcept
+    {
+        std::vector<int> cpus;
+        for (std::size_t position{}; position < list.size();)
+        {
+            const auto next{std::min(list.find(',', position), list.size())};
+            const auto range{list.substr(position, next - position)};
+            position = next + 1;
+
+            int first{}, last{};
+            const auto dash{range.find('-')};
+            const auto parsed{std::from_chars(range.data(), range.data() + std::min(dash, range.size()), first)};
+            if (parsed.ec != std::errc{})
+            {
+                continue;
+            }
+            last = first;
+            if (dash != std::string_view::npos &&
+                std::from_chars(range.data() + dash + 1, range.data() + range.size(), last).ec != std::errc{})
+            {
+                continue;
+            }
+            for (int cpu{first}; cpu <= last; ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    [[nodiscard]] std::size_t node_count() const noexcept
+    {
+        return nodes_.size();
+    }
+
+    [[nodiscard]] const std::vector<int> &cpus(const std::size_t node) const noexcept
+    {
+        return nodes_[node];
+    }
+
+    // The node of `cpu`, or node 0 if it is unknown
+    [[nodiscard]] std::size_t node_of(const int cpu) const noexcept
+    {
+        for (std::size_t node{}; node < nodes_.size(); ++node)
+        {
+            if (std::ranges::find(nodes_[node], cpu) != nodes_[node].end())
+            {
+                return node;
+            }
+        }
+        return 0;
+    }
+
+    // The node the calling thread is running on right now
+    [[nodiscard]] std::size_t current_node() const noexcept
+    {
+#ifdef __linux__
+        if (nodes_.size() > 1)
+        {
+            if (const int cpu{::sched_getcpu()}; cpu >= 0)
+            {
+                return node_of(cpu);
+            }
+        }
+#endif
+        return 0;
+    }
+
+    /**
+     * @brief Spread `count` threads over the CPUs, filling the nodes in turn so neighbours share a node
+     *
+     * @return std::vector<int> the CPU for each thread
+     */
+    [[nodiscard]] std::vector<int> assign(const std::size_t count) const noexcept
+    {
+        std::vector<int> order;
+        for (const auto &node : nodes_)
+        {
+            order.insert(order.end(), node.begin(), node.end());
+        }
+        std::vector<int> result(count);
+        for (std::size_t i{}; i < count; ++i)
+        {
+            result[i] = order[i % order.size()];
+        }
+        return result;
+    }
+
+    // Pin the calling thread to `cpu`; a no-op where affinity is unsupported
+    static bool pin_current_thread(const int cpu) noexcept
+    {
+#ifdef __linux__
+        if (cpu < 0 || cpu >= CPU_SETSIZE)
+        {
+            return false;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return ::sched_setaffinity(0, sizeof set, &set) == 0;
+#else
+        return false;
+#endif
+    }
+
+  private:
+    std::vector<std::vector<int>> nodes_; // CPUs per node, never empty
+};
+} // namespace tprotect
@@ -2,12 +2,29 @@
 
 #include <cstdlib>
 #include <print>
+#include <string_view>
+#include <vector>
 
+#include <tprotect/cli.hpp>
 #include <tprotect/gui.hpp>
+#include <tprotect/startup_timeline.hpp>
 
-int main()
+int main(int argc, char *argv[])
 {
     using namespace tprotect;
+    if (argc > 1) // any arguments select the headless mode
+    {
+        const std::vector<std::string_view> args{argv + 1, argv + argc};
+        return cli::run(args)
+            .transform([] { return EXIT_SUCCESS; })
+            .or_else([](const std::string &error) {
+                std::println(stderr, "[CLI] {}", error);
+                return std::expected<int, std::string>{EXIT_FAILURE};
+            })
+            .value_or(EXIT_FAILURE);
+    }
+
+    startup_timeline::instance(); // time zero for the startup timeline
     return gui::create(1000, 720, "TProtect") // create singleton
         .and_then([] {                        // if succeeding, enter the main loop and destroy the singleton
             const auto result{gui::instance().main_loop()};
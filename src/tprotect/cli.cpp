@@ -0,0 +1,1014 @@
+// cli.cpp: Headless Command Line Interface
+
+#include <tprotect/batch.hpp>
+#include <tprotect/checkpoint.hpp>
+#include <tprotect/cipher/affine_cipher.hpp>
+#include <tprotect/cipher/corpus_analyzer.hpp>
+#include <tprotect/cipher/entropy_map.hpp>
+#include <tprotect/cipher/hill_cipher.hpp>
+#include <tprotect/cipher/homophonic_cipher.hpp>
+#include <tprotect/cipher/ngram_model.hpp>
+#include <tprotect/cipher/playfair_cipher.hpp>
+#include <tprotect/cipher/running_key_cipher.hpp>
+#include <tprotect/cipher/sequential_ranker.hpp>
+#include <tprotect/cipher/shift_index.hpp>
+#include <tprotect/cipher/substitution_cipher.hpp>
+#include <tprotect/cipher/substitution_solver.hpp>
+#include <tprotect/cipher/text_normalizer.hpp>
+#include <tprotect/cipher/transposition_cipher.hpp>
+#include <tprotect/cipher_factory.hpp>
+#include <tprotect/cli.hpp>
+#include <tprotect/content_hash.hpp>
+#include <tprotect/durable_output.hpp>
+#include <tprotect/executor.hpp>
+#include <tprotect/file_io.hpp>
+#include <tprotect/follow.hpp>
+#include <tprotect/job.hpp>
+#include <tprotect/key_search.hpp>
+#include <tprotect/parallel.hpp>
+#include <tprotect/tar_stream.hpp>
+#include <tprotect/topology.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <charconv>
+#include <csignal>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <iostream>
+#include <print>
+#include <string>
+#include <vector>
+
+namespace tprotect::cli
+{
+namespace
+{
+/**
+ * @brief The parsed arguments of a command
+ *
+ * Options are `--name value` pairs or bare `--flag`s; everything else is positional
+ *
+ */
+struct arguments
+{
+    std::vector<std::string> positional;
+    std::vector<std::pair<std::string_view, std::string_view>> options;
+
+    [[nodiscard]] bool has(const std::string_view name) const noexcept
+    {
+        return std::ranges::any_of(options, [&](const auto &option) { return option.first == name; });
+    }
+
+    [[nodiscard]] oresult<std::string_view> get(const std::string_view name) const noexcept
+    {
+        for (const auto &[key, value] : options)
+        {
+            if (key == name)
+            {
+                return value;
+            }
+        }
+        return std::nullopt;
+    }
+
+    template <typename T>
+    [[nodiscard]] eresult<T> get_number(const std::string_view name, const T fallback) const noexcept
+    {
+        const auto value{get(name)};
+        if (!value)
+        {
+            return fallback;
+        }
+        T result{};
+        if (const auto [end, error]{std::from_chars(value->data(), value->data() + value->size(), result)};
+            error != std::errc{} || end != value->data() + value->size())
+        {
+            return std::unexpected{std::format("Invalid value for --{}: {}", name, *value)};
+        }
+        return result;
+    }
+};
+
+// Each command declares the options that take a value and the bare flags it accepts; any other option is an error,
+// so a mistyped key option cannot silently fall back to a default key
+[[nodiscard]] eresult<arguments> parse(const std::span<const std::string_view> args,
+                                       const std::span<const std::string_view> options,
+                                       const std::span<const std::string_view> flags = {}) noexcept
+{
+    arguments result{};
+    for (std::size_t i{}; i < args.size(); ++i)
+    {
+        if (args[i].starts_with("--"))
+        {
+            const auto name{args[i].substr(2)};
+            if (std::ranges::find(flags, name) != flags.end())
+            {
+                result.options.emplace_back(name, std::string_view{});
+            }
+            else if (std::ranges::find(options, name) == options.end())
+            {
+                return std::unexpected{std::format("Unknown option: --{}", name)};
+            }
+            else if (i + 1 == args.size())
+            {
+                return std::unexpected{std::format("Missing value for --{}", name)};
+            }
+            else
+            {
+                result.options.emplace_back(name, args[++i]);
+            }
+        }
+        else
+        {
+            result.positional.emplace_back(args[i]);
+        }
+    }
+    return result;
+}
+
+// The options of every list, in order
+template <std::size_t... N>
+[[nodiscard]] constexpr auto join_options(const std::array<std::string_view, N> &...lists) noexcept
+{
+    std::array<std::string_view, (N + ...)> joined{};
+    std::size_t at{};
+    ((std::ranges::copy(lists, joined.begin() + at), at += N), ...);
+    return joined;
+}
+
+// Options shared by several commands
+constexpr std::array<std::string_view, 8> cipher_options{"cipher", "key",     "multiplier", "mapping",
+                                                         "seed",   "keyword", "key-file",   "key-offset"};
+constexpr std::array<std::string_view, 2> format_options{"groups", "line-groups"};
+constexpr std::array<std::string_view, 2> checkpoint_options{"checkpoint", "checkpoint-interval"};
+
+// corpus <files...> [--clusters N] [--reference <text>] [--restarts N] [--iterations N]
+[[nodiscard]] eresult<void> run_corpus(const std::span<const std::string_view> args) noexcept
+{
+    constexpr std::array<std::string_view, 4> accepted{"clusters", "reference", "restarts", "iterations"};
+    const auto parsed{parse(args, accepted)};
+    if (!parsed)
+    {
+        return std::unexpected{parsed.error()};
+    }
+    if (parsed->positional.empty())
+    {
+        return std::unexpected{"Usage: tprotect corpus <files...> [--clusters N] [--reference <text>] [--restarts N] "
+                               "[--iterations N]"};
+    }
+
+    // With a reference text, each cluster's substitution key is solved from its pooled trigrams
+    std::size_t cluster_count{}, restarts{}, iterations{};
+    oresult<cipher::ngram_model> model{};
+    return parsed->get_number<std::size_t>("clusters", 1)
+        .and_then([&](const std::size_t clusters) {
+            cluster_count = clusters;
+            return parsed->get_number<std::size_t>("restarts", 16);
+        })
+        .and_then([&](const std::size_t shards) {
+            restarts = shards;
+            return parsed->get_number<std::size_t>("iterations", 20'000);
+        })
+        .and_then([&](const std::size_t moves) -> eresult<void> {
+            iterations = moves;
+            const auto reference{parsed->get("reference")};
+            if (!reference)
+            {
+                return {};
+            }
+            return read_decoded_file(std::string{*reference})
+                .transform_error(&compact_error::message)
+                .and_then([&](const std::string &reference_text) -> eresult<void> {
+                    model = cipher::ngram_model::from_text(reference_text);
+                    if (!model->trained())
+                    {
+                        return std::unexpected{"The reference text must contain at least three letters"};
+                    }
+                    return {};
+                });
+        })
+        .and_then([&] { return cipher::corpus_analyzer::from_files(parsed->positional); })
+        .and_then([&](const cipher::corpus_analyzer &analyzer) -> eresult<void> {
+            const auto &pooled{analyzer.pooled()};
+            std::println("Messages: {}, letters: {}, index of coincidence: {:.4f}", analyzer.messages().size(),
+                         pooled.total_letters, pooled.index_of_coincidence());
+
+            const auto clusters{analyzer.cluster(cluster_count)};
+            for (std::size_t i{}; i < clusters.size(); ++i)
+            {
+                const auto &cluster{clusters[i]};
+                std::println("Cluster {}: {} messages, {} letters, index of coincidence {:.4f}", i + 1,
+                             cluster.members.size(), cluster.pooled.total_letters,
+                             cluster.pooled.index_of_coincidence());
+                std::println("  shift key: {}", cluster.shift);
+                std::println("  substitution mapping: {}", cluster.mapping);
+                if (model)
+                {
+                    const auto trigrams{analyzer.trigrams(cluster)};
+                    if (!trigrams)
+                    {
+                        return std::unexpected{trigrams.error()};
+                    }
+                    const auto solution{
+                        cipher::corpus_analyzer::solve_substitution(*trigrams, *model, restarts, iterations)};
+                    std::println("  solved substitution key: {} ({:.4f} per trigram)", solution.mapping,
+                                 solution.score);
+                }
+                std::print("  members:");
+                for (const std::size_t member : cluster.members)
+                {
+                    std::print(" {}", parsed->positional[member]);
+                }
+                std::println("");
+            }
+            return {};
+        });
+}
+
+// index-build <index> <files...> [--block-size N]
+[[nodiscard]] eresult<void> run_index_build(const std::span<const std::string_view> args) noexcept
+{
+    constexpr std::array<std::string_view, 1> accepted{"block-size"};
+    auto parsed{parse(args, accepted)};
+    if (!parsed)
+    {
+        return std::unexpected{parsed.error()};
+    }
+    if (parsed->positional.size() < 2)
+    {
+        return std::unexpected{"Usage: tprotect index-build <index> <files...> [--block-size N]"};
+    }
+
+    const auto index_name{parsed->positional.front()};
+    parsed->positional.erase(parsed->positional.begin());
+    return parsed->get_number<std::size_t>("block-size", cipher::shift_index::default_block_size)
+        .and_then([&](const std::size_t block_size) {
+            return cipher::shift_index::build(index_name, parsed->positional, block_size);
+        })
+        .transform([&] { std::println("Indexed {} files into {}", parsed->positional.size(), index_name); });
+}
+
+// index-search <index> <term> [--max-hits N]
+[[nodiscard]] eresult<void> run_index_search(const std::span<const std::string_view> args) noexcept
+{
+    constexpr std::array<std::string_view, 1> accepted{"max-hits"};
+    const auto parsed{parse(args, accepted)};
+    if (!parsed)
+    {
+        return std::unexpected{parsed.error()};
+    }
+    if (parsed->positional.size() != 2)
+    {
+        return std::unexpected{"Usage: tprotect index-search <index> <term> [--max-hits N]"};
+    }
+
+    return parsed->get_number<std::size_t>("max-hits", 1000).and_then([&](const std::size_t max_hits) {
+        return cipher::shift_index::open(parsed->positional[0])
+            .and_then([&](const cipher::shift_index &index) { return index.search(parsed->positional[1], max_hits); })
+            .transform([](const std::vector<cipher::shift_hit> &hits) {
+                for (const auto &hit : hits)
+                {
+                    std::println("{}:{}: shift {}", hit.file_name, hit.offset, hit.shift);
+                }
+            });
+    });
+}
+
+// solve-homophonic <ciphertext> --reference <text> [--restarts N] [--iterations N] [--seed N]
+[[nodiscard]] eresult<void> run_solve_homophonic(const std::span<const std::string_view> args) noexcept
+{
+    constexpr auto accepted{join_options(std::array<std::string_view, 4>{"reference", "restarts", "iterations", "seed"},
+                                         checkpoint_options)};
+    const auto parsed{parse(args, accepted)};
+    if (!parsed)
+    {
+        return std::unexpected{parsed.error()};
+    }
+    const auto reference{parsed->get("reference")};
+    if (parsed->positional.size() != 1 || !reference)
+    {
+        return std::unexpected{"Usage: tprotect solve-homophonic <ciphertext> --reference <text> [--restarts N] "
+                               "[--iterations N] [--seed N] [--checkpoint PATH] [--checkpoint-interval S]"};
+    }
+
+    cipher::homophonic_solver::options settings{};
+    std::chrono::seconds interval{};
+    return parsed->get_number<std::size_t>("restarts", settings.restarts)
+        .and_then([&](const std::size_t restarts) {
+            settings.restarts = restarts;
+            return parsed->get_number<std::size_t>("iterations", settings.iterations);
+        })
+        .and_then([&](const std::size_t iterations) {
+            settings.iterations = iterations;
+            return parsed->get_number<std::uint64_t>("seed", settings.seed);
+        })
+        .and_then([&](const std::uint64_t seed) {
+            settings.seed = seed;
+            return parsed->get_number<std::size_t>("checkpoint-interval", 30);
+        })
+        .and_then([&](const std::size_t checkpoint_interval) {
+            interval = std::chrono::seconds{checkpoint_interval};
+            return read_decoded_file(std::string{*reference}).transform_error(&compact_error::message);
+        })
+        .and_then([&](const std::string &reference_text) -> eresult<void> {
+            const auto model{cipher::ngram_model::from_text(reference_text)};
+            if (!model.trained())
+            {
+                return std::unexpected{"The reference text must contain at least three letters"};
+            }
+            return read_decoded_file(parsed->positional[0])
+                .and_then([&](const std::string &ciphertext) {
+                    // A checkpoint only resumes the same search of the same text
+                    const auto fingerprint{content_hash(
+                        std::format("{} {} {} {}", settings.restarts, settings.iterations, settings.seed,
+                                    content_hash(reference_text)),
+                        content_hash(ciphertext))};
+                    checkpointer checkpoint{parsed->get("checkpoint").value_or(""), "solve-homophonic", fingerprint,
+                                            interval};
+                    const auto solution{cipher::homophonic_solver::solve(ciphertext, model, settings,
+                                                                         checkpoint.enabled() ? &checkpoint : nullptr)};
+                    std::println("Key: {}", solution.key);
+                    std::println("Score: {:.1f}", solution.score);
+                    return cipher::homophonic_cipher{solution.key}.decrypt(ciphertext);
+                })
+                .transform([](const std::string &plaintext) { std::println("{}", plaintext); })
+                .transform_error(&compact_error::message);
+        });
+}
+
+// search-substitution <ciphertext> --reference <text> [--workers N] [--shards N] [--iterations N] [--patience N]
+// [--target S] [--socket PATH] [--external]
+[[nodiscard]] eresult<void> run_search_substitution(const std::span<const std::string_view> args) noexcept
+{
+    constexpr std::array<std::string_view, 7> accepted{"reference",  "socket",   "workers", "shards",
+                                                       "iterations", "patience", "target"};
+    constexpr std::array<std::string_view, 1> flags{"external"};
+    const auto parsed{parse(args, accepted, flags)};
+    if (!parsed)
+    {
+        return std::unexpected{parsed.error()};
+    }
+    const auto reference{parsed->get("reference")};
+    if (parsed->positional.size() != 1 || !reference)
+    {
+        return std::unexpected{"Usage: tprotect search-substitution <ciphertext> --reference <text> [--workers N] "
+                               "[--shards N] [--iterations N] [--patience N] [--target S] [--socket PATH] "
+                               "[--external]"};
+    }
+
+    key_search_options settings{};
+    settings.spawn = !parsed->has("external");
+    settings.socket_path = parsed->get("socket").value_or("");
+    return parsed->get_number<std::size_t>("workers", settings.workers)
+        .and_then([&](const std::size_t workers) {
+            settings.workers = workers;
+            return parsed->get_number<std::size_t>("shards", settings.shards);
+        })
+        .and_then([&](const std::size_t shards) {
+            settings.shards = shards;
+            return parsed->get_number<std::size_t>("iterations", settings.iterations);
+        })
+        .and_then([&](const std::size_t iterations) {
+            settings.iterations = iterations;
+            return parsed->get_number<std::size_t>("patience", settings.patience);
+        })
+        .and_then([&](const std::size_t patience) {
+            settings.patience = patience;
+            return parsed->get_number<double>("target", 0.);
+        })
+        .and_then([&](const double target) {
+            if (parsed->has("target"))
+            {
+                settings.target = target;
+            }
+            return read_decoded_file(std::string{*reference}).transform_error(&compact_error::message);
+        })
+        .and_then([&](const std::string &reference_text) -> eresult<void> {
+            if (!cipher::ngram_model::from_text(reference_text).trained())
+            {
+                return std::unexpected{"The reference text must contain at least three letters"};
+            }
+            return read_decoded_file(parsed->positional[0])
+                .transform_error(&compact_error::message)
+                .and_then([&](const std::string &ciphertext) {
+                    return run_key_search(ciphertext, reference_text, settings,
+                                          [](const cipher::substitution_solution &best) {
+                                              std::println(stderr, "Shard {}: {:.4f} per trigram", best.shard,
+                                                           best.score);
+                                          })
+                        .and_then([&](const key_search_report &report) {
+                            std::println("Key: {}", report.best.mapping);
+                            std::println("Score: {:.4f} per trigram, from shard {}", report.best.score,
+                                         report.best.shard);
+                            std::println("Shards: {} finished by {} workers{}", report.shards_finished,
+                                         report.workers, report.stopped_early ? ", stopped early" : "");
+                            return cipher::substitution_cipher{report.best.mapping}
+                                .decrypt(ciphertext)
+                                .transform_error(&compact_error::message);
+                        });
+                })
+                .transform([](const std::string &plaintext) { std::println("{}", plaintext); });
+        });
+}
+
+// search-worker --socket PATH
+[[nodiscard]] eresult<void> run_search_worker(const std::span<const std::string_view> args) noexcept
+{
+    constexpr std::array<std::string_view, 1> accepted{"socket"};
+    const auto parsed{parse(args, accepted)};
+    if (!parsed)
+    {
+        return std::unexpected{parsed.error()};
+    }
+    const auto socket{parsed->get("socket")};
+    if (!socket)
+    {
+        return std::unexpected{"Usage: tprotect search-worker --socket PATH"};
+    }
+    return run_key_search_worker(std::filesystem::path{*socket});
+}
+
+// recover-hill <ciphertext> --crib <text> [--order N]
+[[nodiscard]] eresult<void> run_recover_hill(const std::span<const std::string_view> args) noexcept
+{
+    constexpr std::array<std::string_view, 2> accepted{"crib", "order"};
+    const auto parsed{parse(args, accepted)};
+    if (!parsed)
+    {
+        return std::unexpected{parsed.error()};
+    }
+    const auto crib{parsed->get("crib")};
+    if (parsed->positional.size() != 1 || !crib)
+    {
+        return std::unexpected{"Usage: tprotect recover-hill <ciphertext> --crib <text> [--order N]"};
+    }
+
+    return parsed->get_number<std::size_t>("order", 2).and_then([&](const std::size_t order) {
+        return read_decoded_file(parsed->positional[0])
+            .transform_error(&compact_error::message)
+            .and_then([&](const std::string &ciphertext) -> eresult<void> {
+                const auto recovery{cipher::recover_hill_key(ciphertext, *crib, order)};
+                if (!recovery)
+                {
+                    return std::unexpected{std::format("No order {} Hill key maps the crib onto the ciphertext; "
+                                                       "it needs at least {} letters",
+                                                       order, order * (order + 2) - 1)};
+                }
+                std::println("Key: {}", cipher::hill_cipher::to_string(recovery->key));
+                std::println("Crib offset: {} letters", recovery->offset);
+                return {};
+            });
+    });
+}
+
+// recover-affine <ciphertext>
+[[nodiscard]] eresult<void> run_recover_affine(const std::span<const std::string_view> args) noexcept
+{
+    const auto parsed{parse(args, {})};
+    if (!parsed)
+    {
+        return std::unexpected{parsed.error()};
+    }
+    if (parsed->positional.size() != 1)
+    {
+        return std::unexpected{"Usage: tprotect recover-affine <ciphertext>"};
+    }
+
+    return read_decoded_file(parsed->positional[0])
+        .and_then([](const std::string &ciphertext) {
+            const auto key{cipher::affine_cipher::recover(ciphertext)};
+            std::println("Key: a = {}, b = {} (distance from English {:.3f})", key.a, key.b, key.fit);
+            return cipher::affine_cipher{key.a, key.b}.decrypt(ciphertext);
+        })
+        .transform([](const std::string &plaintext) { std::println("{}", plaintext); })
+        .transform_error(&compact_error::message);
+}
+
+// rank-keys <ciphertext> --reference <text> [--keys <file>] [--confidence Z] [--keep N]
+[[nodiscard]] eresult<void> run_rank_keys(const std::span<const std::string_view> args) noexcept
+{
+    constexpr std::array<std::string_view, 4> accepted{"reference", "keys", "confidence", "keep"};
+    const auto parsed{parse(args, accepted)};
+    if (!parsed)
+    {
+        return std::unexpected{parsed.error()};
+    }
+    const auto reference{parsed->get("reference")};
+    if (parsed->positional.size() != 1 || !reference)
+    {
+        return std::unexpected{"Usage: tprotect rank-keys <ciphertext> --reference <text> [--keys <file>] "
+                               "[--confidence Z] [--keep N]"};
+    }
+
+    // The 25 shifts, in `decrypt_all_shifts` order, unless a file of substitution mappings, one a line, is given
+    std::vector<std::string> names;
+    std::vector<cipher::byte_map> tables;
+    if (const auto keys{parsed->get("keys")})
+    {
+        const auto text{read_decoded_file(std::string{*keys})};
+        if (!text)
+        {
+            return std::unexpected{text.error().message()};
+        }
+        for (std::string_view rest{*text}; !rest.empty();)
+        {
+            const auto end{std::min(rest.find('\n'), rest.size())};
+            auto mapping{rest.substr(0, end)};
+            rest.remove_prefix(std::min(end + 1, rest.size()));
+            if (mapping.ends_with('\r'))
+            {
+                mapping.remove_suffix(1);
+            }
+            if (!mapping.empty())
+            {
+                names.push_back(std::format("Key {}", mapping));
+                tables.push_back(cipher::substitution_cipher{mapping}.decryption_table());
+            }
+        }
+    }
+    else
+    {
+        for (int shift{1}; shift <= 25; ++shift)
+        {
+            names.push_back(std::format("Shift {}", shift));
+            tables.push_back(cipher::transposition_cipher{shift}.decryption_table());
+        }
+    }
+    if (tables.empty())
+    {
+        return std::unexpected{"The key file holds no mappings"};
+    }
+
+    cipher::sequential_ranker::options settings{};
+    return parsed->get_number<double>("confidence", settings.confidence)
+        .and_then([&](const double confidence) {
+            settings.confidence = confidence;
+            return parsed->get_number<std::size_t>("keep", settings.keep);
+        })
+        .and_then([&](const std::size_t keep) {
+            settings.keep = keep;
+            return read_decoded_file(std::string{*reference}).transform_error(&compact_error::message);
+        })
+        .and_then([&](const std::string &reference_text) -> eresult<void> {
+            const auto model{cipher::ngram_model::from_text(reference_text)};
+            if (!model.trained())
+            {
+                return std::unexpected{"The reference text must contain at least three letters"};
+            }
+            return read_decoded_file(parsed->positional[0])
+                .transform([&](const std::string &ciphertext) {
+                    const auto ranking{cipher::sequential_ranker::rank(ciphertext, tables, model, settings)};
+                    std::println("Scored {} of {} bytes", ranking.scored, ciphertext.size());
+                    for (const auto &candidate : ranking.candidates)
+                    {
+                        std::println("{}: {:.4f} per trigram over {} trigrams{}", names[candidate.index],
+                                     candidate.score, candidate.trigrams, candidate.rejected ? ", rejected" : "");
+                    }
+                    std::string plaintext(ciphertext.size(), '\0');
+                    tables[ranking.candidates.front().index].apply(ciphertext.data(), plaintext.data(),
+                                                                   ciphertext.size());
+                    std::println("{}", plaintext);
+                })
+                .transform_error(&compact_error::message);
+        });
+}
+
+// entropy-map <file> [--block-size N]
+[[nodiscard]] eresult<void> run_entropy_map(const std::span<const std::string_view> args) noexcept
+{
+    constexpr std::array<std::string_view, 1> accepted{"block-size"};
+    const auto parsed{parse(args, accepted)};
+    if (!parsed)
+    {
+        return std::unexpected{parsed.error()};
+    }
+    if (parsed->positional.size() != 1)
+    {
+        return std::unexpected{"Usage: tprotect entropy-map <file> [--block-size N]"};
+    }
+
+    return parsed->get_number<std::size_t>("block-size", cipher::entropy_map::default_block_size)
+        .and_then([&](const std::size_t block_size) {
+            return cipher::entropy_map::open(parsed->positional[0], block_size)
+                .transform_error(&compact_error::message);
+        })
+        .transform([](const cipher::entropy_map &map) {
+            const auto blocks{map.blocks()};
+            std::println("Blocks: {} of {} bytes", blocks.size(), map.block_size());
+            // Runs are reported in file order, so stop once the search wraps around
+            for (auto run{map.next_text(0)}; run; run = map.next_text(run->second))
+            {
+                const auto [first, end]{*run};
+                double entropy{}, coincidence{};
+                for (std::size_t i{first}; i < end; ++i)
+                {
+                    entropy += blocks[i].entropy;
+                    coincidence += blocks[i].coincidence;
+                }
+                const auto count{static_cast<double>(end - first)};
+                std::println("Text at bytes {}-{}: entropy {:.2f} bits, index of coincidence {:.4f}",
+                             first * map.block_size(), std::min(map.size(), end * map.block_size()),
+                             entropy / count, coincidence / count);
+                if (end == blocks.size() || map.next_text(end)->first < end)
+                {
+                    break;
+                }
+            }
+        });
+}
+
+// --cipher substitution|transposition|affine|homophonic|playfair|hill|running-key [--key N] [--multiplier A]
+// [--mapping M] [--seed N] [--keyword K] [--key-file PATH] [--key-offset N] [--decrypt]
+[[nodiscard]] eresult<cipher_choice> choose_plain_cipher(const arguments &parsed) noexcept
+{
+    // The options become the key text `make_cipher` takes, as a job manifest would give it
+    const bool decrypt{parsed.has("decrypt")};
+    const auto name{parsed.get("cipher").value_or("substitution")};
+    const auto key{[&]() -> eresult<std::string> {
+        if (name == "substitution")
+        {
+            return std::string{parsed.get("mapping").value_or(initial_mapping)};
+        }
+        if (name == "transposition")
+        {
+            return parsed.get_number<int>("key", initial_key).transform([](const int key) {
+                return std::to_string(key);
+            });
+        }
+        if (name == "affine")
+        {
+            // The key is the offset b, as for the shift cipher that affine generalises
+            return parsed.get_number<int>("multiplier", 5).and_then([&](const int a) {
+                return parsed.get_number<int>("key", 8).transform([&](const int b) {
+                    return std::format("{} {}", a, b);
+                });
+            });
+        }
+        if (name == "running-key")
+        {
+            const auto key_file{parsed.get("key-file")};
+            if (!key_file)
+            {
+                return std::unexpected{"The running-key cipher needs --key-file PATH"};
+            }
+            return parsed.get_number<std::uint64_t>("key-offset", 0).transform([&](const std::uint64_t offset) {
+                return std::format("{} {}", *key_file, offset);
+            });
+        }
+        if (name == "homophonic")
+        {
+            // The mapping gives the letter of each symbol A-Za-z; the seed picks homophones, or generates a mapping
+            return parsed.get_number<std::uint64_t>("seed", 0).transform([&](const std::uint64_t seed) {
+                const auto generated{cipher::homophonic_cipher::generate_key(seed)};
+                return std::format("{} {}", parsed.get("mapping").value_or(generated), seed);
+            });
+        }
+        if (name == "playfair" || name == "hill")
+        {
+            return std::string{parsed.get("keyword").value_or(name == "hill" ? "GYBNQKURP" : "PLAYFAIR")};
+        }
+        return std::unexpected{std::format("Unknown cipher: {}", name)};
+    }()};
+    return key.and_then([&](const std::string &text) { return make_cipher(name, text, decrypt); });
+}
+
+// The cipher options, plus [--normalize] [--transliterate] [--groups N] [--line-groups N] for the classic format:
+// uppercase letters only, accents transliterated, in groups of N (usually 5) and lines of so many groups
+[[nodiscard]] eresult<cipher_choice> choose_cipher(const arguments &parsed) noexcept
+{
+    const bool normalize{parsed.has("normalize")};
+    cipher::normalize_options options{
+        .uppercase = normalize, .letters_only = normalize, .transliterate = parsed.has("transliterate")};
+    return parsed.get_number<std::size_t>("groups", 0)
+        .and_then([&](const std::size_t groups) {
+            options.group_size = groups;
+            return parsed.get_number<std::size_t>("line-groups", 0);
+        })
+        .and_then([&](const std::size_t line_groups) {
+            options.line_groups = line_groups;
+            return choose_plain_cipher(parsed);
+        })
+        .transform([&](cipher_choice choice) {
+            if (!options.changes_text())
+            {
+                return choice;
+            }
+            choice.configuration += std::format(" format {} {} {} {}", normalize, options.transliterate,
+                                                options.group_size, options.line_groups);
+            if (choice.table)
+            {
+                // Normalization, the cipher and grouping in one pass over the text
+                choice.transform = [normalizer = cipher::text_normalizer{options, *choice.table}](
+                                       const std::string_view input) -> cresult<std::string> {
+                    return normalizer.apply(input);
+                };
+                return choice;
+            }
+            auto grouping{options};
+            grouping.uppercase = grouping.letters_only = grouping.transliterate = false;
+            options.group_size = options.line_groups = 0;
+            choice.transform = [before = cipher::text_normalizer{options}, after = cipher::text_normalizer{grouping},
+                                transform = std::move(choice.transform)](const std::string_view input) {
+                const auto normalized{before.options().changes_text() ? before.apply(input) : std::string{}};
+                return transform(before.options().changes_text() ? normalized : input)
+                    .transform([&](std::string output) {
+                        return after.options().changes_text() ? after.apply(output) : std::move(output);
+                    });
+            };
+            return choice;
+        });
+}
+
+// batch <input-dir> <output-dir> [cipher options] [--manifest PATH] [--durable] [--durability-window MS]
+//       [--checkpoint PATH] [--checkpoint-interval S]
+[[nodiscard]] eresult<void> run_batch_command(const std::span<const std::string_view> args) noexcept
+{
+    constexpr auto accepted{join_options(cipher_options, format_options, checkpoint_options,
+                                         std::array<std::string_view, 2>{"manifest", "durability-window"})};
+    constexpr std::array<std::string_view, 4> flags{"decrypt", "durable", "normalize", "transliterate"};
+    const auto parsed{parse(args, accepted, flags)};
+    if (!parsed)
+    {
+        return std::unexpected{parsed.error()};
+    }
+    if (parsed->positional.size() != 2)
+    {
+        return std::unexpected{"Usage: tprotect batch <input-dir> <output-dir> "
+                               "[--cipher substitution|transposition|affine|homophonic|playfair|hill] "
+                               "[--key N] [--multiplier A] [--mapping M] [--seed N] [--keyword K] [--decrypt] "
+                               "[--normalize] [--transliterate] [--groups N] [--line-groups N] [--manifest PATH] "
+                               "[--durable] [--durability-window MS] [--checkpoint PATH] [--checkpoint-interval S]"};
+    }
+
+    const std::filesystem::path input_root{parsed->positional[0]}, output_root{parsed->positional[1]};
+    const auto default_manifest{(output_root / ".tprotect-manifest").string()};
+    const std::filesystem::path manifest{parsed->get("manifest").value_or(default_manifest)};
+    durability_options durability{.enabled = parsed->has("durable")};
+    std::chrono::seconds interval{};
+    return parsed->get_number<std::size_t>("durability-window", static_cast<std::size_t>(durability.window.count()))
+        .and_then([&](const std::size_t window) {
+            durability.window = std::chrono::milliseconds{window};
+            return parsed->get_number<std::size_t>("checkpoint-interval", 30);
+        })
+        .and_then([&](const std::size_t checkpoint_interval) {
+            interval = std::chrono::seconds{checkpoint_interval};
+            return choose_cipher(*parsed);
+        })
+        .and_then([&](const cipher_choice &choice) -> eresult<batch_report> {
+            if (choice.keystream)
+            {
+                return std::unexpected{"A running key cannot encrypt a batch, as every file would reuse it"};
+            }
+            // The inputs themselves are checked against the checkpoint by `run_batch`
+            checkpointer checkpoint{parsed->get("checkpoint").value_or(""), "batch",
+                                    content_hash(std::format("{}\n{}\n{}", input_root.generic_string(),
+                                                             output_root.generic_string(), choice.configuration)),
+                                    interval};
+            return run_batch(input_root, output_root, manifest, choice.configuration, choice.transform, durability,
+                             checkpoint.enabled() ? &checkpoint : nullptr);
+        })
+        .transform([](const batch_report &report) {
+            std::println("Unchanged: {}, rehashed: {}, transformed: {}, linked: {}, resumed: {}", report.unchanged,
+                         report.rehashed, report.transformed, report.linked, report.resumed);
+            std::println("Wrote {:.0f} files/s ({})", report.files_per_second(),
+                         report.durable ? "durable" : "not synced");
+        });
+}
+
+// tar <input> <output> [cipher options] [--checkpoint PATH] [--checkpoint-interval S], where - is standard input or
+// output
+[[nodiscard]] eresult<void> run_tar_command(const std::span<const std::string_view> args) noexcept
+{
+    constexpr auto accepted{join_options(cipher_options, checkpoint_options)};
+    constexpr std::array<std::string_view, 1> flags{"decrypt"};
+    const auto parsed{parse(args, accepted, flags)};
+    if (!parsed)
+    {
+        return std::unexpected{parsed.error()};
+    }
+    if (parsed->positional.size() != 2)
+    {
+        return std::unexpected{"Usage: tprotect tar <input.tar|-> <output.tar|-> "
+                               "[--cipher substitution|transposition|affine|homophonic] [--key N] [--multiplier A] "
+                               "[--mapping M] [--seed N] [--decrypt] [--checkpoint PATH] [--checkpoint-interval S]"};
+    }
+    const auto checkpoint_path{parsed->get("checkpoint").value_or("")};
+    if (!checkpoint_path.empty() && (parsed->positional[0] == "-" || parsed->positional[1] == "-"))
+    {
+        return std::unexpected{"Resuming a tar stream needs seekable files, not standard input or output"};
+    }
+
+    // Members are transformed a chunk at a time, so the cipher must keep each chunk's length and need nothing from the
+    // chunks before it. Checked before the output is opened, so a refused cipher leaves no partial archive behind
+    const auto interval{parsed->get_number<std::size_t>("checkpoint-interval", 30)};
+    const auto choice{interval.and_then([&](std::size_t) { return choose_plain_cipher(*parsed); })};
+    if (!choice)
+    {
+        return std::unexpected{choice.error()};
+    }
+    if (choice->resizes || choice->keystream)
+    {
+        return std::unexpected{"A tar stream needs a cipher that keeps each chunk's length and state: substitution, "
+                               "transposition, affine or homophonic"};
+    }
+    if (const auto probe{choice->transform({})}; !probe)
+    {
+        return std::unexpected{probe.error().message()}; // an invalid key fails on any input, even none
+    }
+
+    std::ifstream input_file;
+    std::ofstream output_file;
+    if (parsed->positional[0] != "-")
+    {
+        input_file.open(parsed->positional[0], std::ios::binary);
+        if (!input_file)
+        {
+            return std::unexpected{compact_error{errc::open_failed, parsed->positional[0]}.message()};
+        }
+    }
+    if (parsed->positional[1] != "-")
+    {
+        // A resumed run writes into the output it was interrupted on, so it is only truncated at the end
+        std::error_code exists_error;
+        const bool keep{!checkpoint_path.empty() && std::filesystem::exists(parsed->positional[1], exists_error)};
+        output_file.open(parsed->positional[1],
+                         keep ? std::ios::binary | std::ios::in | std::ios::out : std::ios::binary | std::ios::out);
+        if (!output_file)
+        {
+            return std::unexpected{compact_error{errc::open_failed, parsed->positional[1]}.message()};
+        }
+    }
+    auto &input{parsed->positional[0] == "-" ? static_cast<std::istream &>(std::cin) : input_file};
+    auto &output{parsed->positional[1] == "-" ? static_cast<std::ostream &>(std::cout) : output_file};
+    std::error_code size_error;
+    const auto input_size{checkpoint_path.empty() ? 0 : std::filesystem::file_size(parsed->positional[0], size_error)};
+    checkpointer checkpoint{checkpoint_path, "tar",
+                            content_hash(std::format("{}\n{}\n{}\n{}", parsed->positional[0], input_size,
+                                                     parsed->positional[1], choice->configuration)),
+                            std::chrono::seconds{*interval}};
+    return transform_tar(input, output, choice->transform, 1 << 20, 2 * executor::instance().worker_count() + 2,
+                         checkpoint.enabled() ? &checkpoint : nullptr)
+        .and_then([&](const tar_report &report) -> eresult<tar_report> {
+            if (!checkpoint_path.empty())
+            {
+                // Drop whatever an interrupted run wrote past the end
+                output_file.close();
+                std::error_code resize_error;
+                std::filesystem::resize_file(parsed->positional[1], report.bytes, resize_error);
+                if (resize_error)
+                {
+                    return std::unexpected{std::format("{}: {}", parsed->positional[1], resize_error.message())};
+                }
+            }
+            return report;
+        })
+        .transform([&](const tar_report &report) {
+            // Standard output may be the archive, so the summary goes to standard error
+            std::println(stderr, "Members: {}, transformed: {}, bytes: {}", report.members, report.transformed,
+                         report.bytes);
+        });
+}
+
+cancellation_source interrupted{}; // SIGINT ends a follow cleanly, so its report is still printed
+
+// follow <file> <output|-> [cipher options] [--from-start] [--idle-exit MS]
+[[nodiscard]] eresult<void> run_follow_command(const std::span<const std::string_view> args) noexcept
+{
+    constexpr auto accepted{join_options(cipher_options, std::array<std::string_view, 1>{"idle-exit"})};
+    constexpr std::array<std::string_view, 2> flags{"decrypt", "from-start"};
+    const auto parsed{parse(args, accepted, flags)};
+    if (!parsed)
+    {
+        return std::unexpected{parsed.error()};
+    }
+    if (parsed->positional.size() != 2)
+    {
+        return std::unexpected{"Usage: tprotect follow <file> <output|-> [--cipher substitution|transposition|affine] "
+                               "[--key N] [--multiplier A] [--mapping M] [--decrypt] [--from-start] [--idle-exit MS]"};
+    }
+
+    follow_options options{.from_start = parsed->has("from-start")};
+    const std::filesystem::path output{parsed->positional[1] == "-" ? "" : parsed->positional[1]};
+    return parsed->get_number<std::size_t>("idle-exit", 0)
+        .and_then([&](const std::size_t idle_exit) {
+            options.idle_exit = std::chrono::milliseconds{idle_exit};
+            return choose_plain_cipher(*parsed);
+        })
+        .and_then([&](const cipher_choice &choice) -> eresult<follow_report> {
+            // Lines go through the byte table alone; ciphers that pad, group or key by position would depend on where
+            // batches happen to end. An invalid affine key has no table either, and its own error says more
+            if (!choice.table)
+            {
+                return choice.transform({}).transform_error(&compact_error::message).and_then([](const std::string &) {
+                    return eresult<follow_report>{std::unexpected{
+                        "Follow needs a cipher that maps bytes one to one: substitution, transposition or affine"}};
+                });
+            }
+            std::signal(SIGINT, [](int) { interrupted.cancel(); });
+            return follow_file(parsed->positional[0], output,
+                               [table = *choice.table](const std::string_view lines) -> cresult<std::string> {
+                                   return table.apply(lines);
+                               },
+                               options, interrupted.token());
+        })
+        .transform([](const follow_report &report) {
+            const auto microseconds{[&](const double fraction) {
+                return std::chrono::duration<double, std::micro>{report.latency.percentile(fraction)}.count();
+            }};
+            std::println(stderr, "Lines: {}, bytes: {}, batches: {}, truncations: {}, rotations: {}", report.lines,
+                         report.bytes, report.batches, report.truncations, report.rotations);
+            std::println(stderr, "Latency per line (us): p50 {:.1f}, p90 {:.1f}, p99 {:.1f}, p99.9 {:.1f}, max {:.1f}",
+                         microseconds(.5), microseconds(.9), microseconds(.99), microseconds(.999),
+                         std::chrono::duration<double, std::micro>{report.latency.max()}.count());
+        });
+}
+
+// job <manifest>
+[[nodiscard]] eresult<void> run_job_command(const std::span<const std::string_view> args) noexcept
+{
+    const auto parsed{parse(args, {})};
+    if (!parsed)
+    {
+        return std::unexpected{parsed.error()};
+    }
+    if (parsed->positional.size() != 1)
+    {
+        return std::unexpected{"Usage: tprotect job <manifest>"};
+    }
+
+    return job_manifest::load(parsed->positional[0]).and_then([](const job_manifest &manifest) -> eresult<void> {
+        std::signal(SIGINT, [](int) { interrupted.cancel(); });
+        job_cache cache{};
+        const auto report{manifest.run(cache, interrupted.token())};
+        for (const auto &error : report.errors)
+        {
+            std::println(stderr, "{}", error);
+        }
+        std::println("Nodes: {}, computed: {}, cached: {}, skipped: {}, failed: {}", report.nodes, report.computed,
+                     report.cached, report.skipped, report.errors.size());
+        if (!report.errors.empty())
+        {
+            return std::unexpected{std::format("{} nodes failed", report.errors.size())};
+        }
+        return {};
+    });
+}
+
+struct command
+{
+    std::string_view name;
+    std::string_view description;
+    eresult<void> (*handler)(std::span<const std::string_view>) noexcept;
+};
+
+constexpr std::array commands{
+    command{"corpus", "Pool statistics over many short ciphertexts and recover their keys", run_corpus},
+    command{"index-build", "Build a shift-invariant search index over ciphertext files", run_index_build},
+    command{"index-search", "Search an index for a term under every shift", run_index_search},
+    command{"solve-homophonic", "Recover a homophonic key from ciphertext alone", run_solve_homophonic},
+    command{"search-substitution", "Recover a substitution key with a pool of worker processes",
+            run_search_substitution},
+    command{"search-worker", "Serve shards of a key search to a coordinator's socket", run_search_worker},
+    command{"recover-hill", "Recover a Hill key from ciphertext and a known plaintext crib", run_recover_hill},
+    command{"recover-affine", "Recover an affine key from ciphertext alone", run_recover_affine},
+    command{"rank-keys", "Rank shifts or stored keys, reading only as much ciphertext as it takes", run_rank_keys},
+    command{"entropy-map", "Find the text-like regions of a binary file by per-block entropy", run_entropy_map},
+    command{"follow", "Encrypt or decrypt the lines appended to a growing file, like tail -f", run_follow_command},
+    command{"tar", "Encrypt or decrypt the files inside a tar stream", run_tar_command},
+    command{"batch", "Encrypt or decrypt a directory tree, skipping unchanged files", run_batch_command},
+    command{"job", "Run a manifest of chained cipher operations over many inputs", run_job_command},
+};
+} // namespace
+
+[[nodiscard]] eresult<void> run(const std::span<const std::string_view> args) noexcept
+{
+    executor::set_thread_priority(priority::batch); // headless commands are bulk work
+    auto rest{args};
+    if (!rest.empty() && rest.front() == "--numa")
+    {
+        // Before anything touches the executor, which fixes its topology on first use
+        executor::use_topology(cpu_topology::detect(), true);
+        rest = rest.subspan(1);
+    }
+    if (!rest.empty())
+    {
+        if (const auto it{std::ranges::find(commands, rest.front(), &command::name)}; it != commands.end())
+        {
+            return it->handler(rest.subspan(1));
+        }
+    }
+
+    std::string usage{"Usage: tprotect [--numa] [command] [arguments...]\n"
+                      "  --numa              Pin workers per core and keep chunks on their memory node\nCommands:"};
+    for (const auto &command : commands)
+    {
+        usage += std::format("\n  {:<20}{}", command.name, command.description);
+    }
+    return std::unexpected{std::move(usage)};
+}
+} // namespace tprotect::cli
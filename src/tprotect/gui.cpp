@@ -1,11 +1,24 @@
 // gui.cpp: Dear ImGui User Interface Manager
 
 #include <fonts.hpp>
+#include <tprotect/cipher/letters.hpp>
+#include <tprotect/compressed_font.hpp>
 #include <tprotect/file_dialog.hpp>
 #include <tprotect/gui.hpp>
-
+#include <tprotect/mapped_file.hpp>
+#include <tprotect/parallel.hpp>
+#include <tprotect/startup_timeline.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <filesystem>
-#include <ranges>
+#include <format>
+#include <print>
+#include <span>
+#include <tuple>
+#include <utility>
 
 #include <imgui_additions.hpp>
 
@@ -61,64 +74,107 @@ bool gui::is_initialized() const noexcept
 
     title_ = std::move(title);
 
-    // Initialize GLFW
-    if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_GAMEPAD))
+    // Work submitted from the GUI thread is what the user is waiting on
+    executor::set_thread_priority(priority::interactive);
+    auto &timeline{startup_timeline::instance()};
+
+    // Decode the fonts on workers while SDL and the renderer come up; the CJK fallback is shared, so decoded once
+    const auto decode{[&timeline](const char *const name, const std::span<const unsigned char> data) {
+        return executor::instance().async([&timeline, name, data] {
+            const auto phase{timeline.phase(std::format("decode {}", name))};
+            return decompress_font(data);
+        });
+    }};
+    auto futura_medium_ttf{decode("futura_medium", futura_medium_compressed_data)};
+    auto jetbrains_mono_regular_ttf{decode("jetbrains_mono_regular", jetbrains_mono_regular_compressed_data)};
+    auto noto_sans_cjk_regular_ttf{decode("noto_sans_cjk_regular", noto_sans_cjk_regular_compressed_data)};
+
+    // Initialize SDL; gamepads are initialized after the first frame
     {
-        return std::unexpected{std::format("Failed to initialize SDL: {}", SDL_GetError())};
+        const auto phase{timeline.phase("sdl_init")};
+        if (!SDL_Init(SDL_INIT_VIDEO))
+        {
+            return std::unexpected{std::format("Failed to initialize SDL: {}", SDL_GetError())};
+        }
     }
 
     // Create window
     const float main_scale{SDL_GetDisplayContentScale(SDL_GetPrimaryDisplay())};
-    window_ =
-        SDL_CreateWindow(title_.c_str(), static_cast<int>(width * main_scale), static_cast<int>(height * main_scale),
-                         SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIDDEN | SDL_WINDOW_HIGH_PIXEL_DENSITY);
-    if (window_ == nullptr)
     {
-        return std::unexpected{std::format("Failed to create SDL window: {}", SDL_GetError())};
+        const auto phase{timeline.phase("create_window")};
+        window_ = SDL_CreateWindow(title_.c_str(), static_cast<int>(width * main_scale),
+                                   static_cast<int>(height * main_scale),
+                                   SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIDDEN | SDL_WINDOW_HIGH_PIXEL_DENSITY);
+        if (window_ == nullptr)
+        {
+            return std::unexpected{std::format("Failed to create SDL window: {}", SDL_GetError())};
+        }
     }
 
     // Create renderer
-    renderer_ = SDL_CreateRenderer(window_, nullptr);
-    if (renderer_ == nullptr)
     {
-        return std::unexpected{std::format("Failed to create SDL renderer: {}", SDL_GetError())};
+        const auto phase{timeline.phase("create_renderer")};
+        renderer_ = SDL_CreateRenderer(window_, nullptr);
+        if (renderer_ == nullptr)
+        {
+            return std::unexpected{std::format("Failed to create SDL renderer: {}", SDL_GetError())};
+        }
+        SDL_SetRenderVSync(renderer_, 1);
     }
-    SDL_SetRenderVSync(renderer_, 1);
 
     // Show window
     SDL_SetWindowPosition(window_, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
     SDL_ShowWindow(window_);
 
     // Setup Dear ImGui
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    auto &io{ImGui::GetIO()};
-    io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
-    io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;
-    io.IniFilename = nullptr;
-
-    // Setup style
-    ImGui::StyleColorsComfortableDark();
-
-    // Setup scaling
-    auto &style{ImGui::GetStyle()};
-    style.ScaleAllSizes(main_scale);
-    style.FontScaleDpi = main_scale;
-
-    // Setup backends
-    ImGui_ImplSDL3_InitForSDLRenderer(window_, renderer_);
-    ImGui_ImplSDLRenderer3_Init(renderer_);
-
-    // Setup fonts
-    ImFontConfig font_cfg{};
-    font_cfg.MergeMode = true;
-    io.Fonts->AddFontFromMemoryCompressedTTF(futura_medium_compressed_data, sizeof futura_medium_compressed_data);
-    futura_medium = io.Fonts->AddFontFromMemoryCompressedTTF(
-        noto_sans_cjk_regular_compressed_data, sizeof noto_sans_cjk_regular_compressed_data, 0.f, &font_cfg);
-    io.Fonts->AddFontFromMemoryCompressedTTF(jetbrains_mono_regular_compressed_data,
-                                             sizeof jetbrains_mono_regular_compressed_data);
-    jetbrains_mono_regular = io.Fonts->AddFontFromMemoryCompressedTTF(
-        noto_sans_cjk_regular_compressed_data, sizeof noto_sans_cjk_regular_compressed_data, 0.f, &font_cfg);
+    {
+        const auto phase{timeline.phase("imgui_setup")};
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        auto &io{ImGui::GetIO()};
+        io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
+        io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;
+        io.IniFilename = nullptr;
+
+        // Setup style
+        ImGui::StyleColorsComfortableDark();
+
+        // Setup scaling
+        auto &style{ImGui::GetStyle()};
+        style.ScaleAllSizes(main_scale);
+        style.FontScaleDpi = main_scale;
+
+        // Setup backends
+        ImGui_ImplSDL3_InitForSDLRenderer(window_, renderer_);
+        ImGui_ImplSDLRenderer3_Init(renderer_);
+    }
+
+    // Setup fonts, once decoded; the atlas only borrows the data, which the members keep alive
+    {
+        const auto phase{timeline.phase("wait_fonts")};
+        for (auto &[future, ttf] : {std::pair{&futura_medium_ttf, &futura_medium_ttf_},
+                                    std::pair{&jetbrains_mono_regular_ttf, &jetbrains_mono_regular_ttf_},
+                                    std::pair{&noto_sans_cjk_regular_ttf, &noto_sans_cjk_regular_ttf_}})
+        {
+            auto decoded{future->get()};
+            if (!decoded)
+            {
+                return std::unexpected{std::format("Failed to decode font: {}", decoded.error().message())};
+            }
+            *ttf = std::move(*decoded);
+        }
+    }
+    const auto phase{timeline.phase("add_fonts")};
+    const auto add_font{[&io = ImGui::GetIO()](std::vector<unsigned char> &ttf, const bool merge) {
+        ImFontConfig font_cfg{};
+        font_cfg.FontDataOwnedByAtlas = false;
+        font_cfg.MergeMode = merge;
+        return io.Fonts->AddFontFromMemoryTTF(ttf.data(), static_cast<int>(ttf.size()), 0.f, &font_cfg);
+    }};
+    add_font(futura_medium_ttf_, false);
+    futura_medium = add_font(noto_sans_cjk_regular_ttf_, true);
+    add_font(jetbrains_mono_regular_ttf_, false);
+    jetbrains_mono_regular = add_font(noto_sans_cjk_regular_ttf_, true);
 
     return {};
 }
@@ -240,6 +296,21 @@ void gui::shutdown() noexcept
         SDL_RenderClear(renderer_);
         ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), renderer_);
         SDL_RenderPresent(renderer_);
+
+        if (!first_frame_presented_)
+        {
+            first_frame_presented_ = true;
+            auto &timeline{startup_timeline::instance()};
+            timeline.mark_first_frame();
+            {
+                const auto phase{timeline.phase("gamepad_init")}; // deferred, nothing needs it before now
+                SDL_InitSubSystem(SDL_INIT_GAMEPAD);
+            }
+            if (const char *const value{std::getenv("TPROTECT_STARTUP_TIMELINE")}; value != nullptr && *value != '\0')
+            {
+                std::print(stderr, "{}", timeline.report());
+            }
+        }
     }
 #ifdef __EMSCRIPTEN__
     EMSCRIPTEN_MAINLOOP_END;
@@ -261,6 +332,10 @@ void gui::render_window() noexcept
     ImGui::Separator();
 
     std::string cipher_message{};
+    // The pane a job writes to stays read-only until the result replaces it, so no edit made meanwhile is lost
+    const bool encrypted_locked{cipher_job_.valid() && cipher_job_encrypting_};
+    const bool decrypted_locked{cipher_job_.valid() && !cipher_job_encrypting_};
+    constexpr ImGuiInputTextFlags pane_flags{ImGuiInputTextFlags_CallbackAlways | ImGuiInputTextFlags_CallbackEdit};
 
     if (ImGui::BeginTable("MainTable", 3, ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_NoBordersInBody))
     {
@@ -297,9 +372,12 @@ void gui::render_window() noexcept
 
             // Cell 3: Buttons (Right Aligned)
             ImGui::TableSetColumnIndex(2);
+            ImGui::BeginDisabled(decrypted_locked);
             if (ImGui::ButtonPadded("Clear"))
             {
                 decrypted_text_.clear();
+                decrypted_buffer_.replaced();
+                decrypted_index_dirty_ = true;
             }
             ImGui::SameLine();
             if (ImGui::ButtonPadded("Load"))
@@ -307,6 +385,7 @@ void gui::render_window() noexcept
                 ImGuiFileDialog::Instance()->OpenDialog("##LoadDecrypted", "Choose Decrypted Text To Load", ".txt",
                                                         {.path = "."});
             }
+            ImGui::EndDisabled();
             ImGui::SameLine();
             if (ImGui::ButtonPadded("Save"))
             {
@@ -347,9 +426,12 @@ void gui::render_window() noexcept
 
             // Cell 3: Buttons (Right Aligned)
             ImGui::TableSetColumnIndex(2);
+            ImGui::BeginDisabled(encrypted_locked);
             if (ImGui::ButtonPadded("Clear"))
             {
                 encrypted_text_.clear();
+                encrypted_buffer_.replaced();
+                encrypted_index_dirty_ = true;
             }
             ImGui::SameLine();
             if (ImGui::ButtonPadded("Load"))
@@ -357,6 +439,7 @@ void gui::render_window() noexcept
                 ImGuiFileDialog::Instance()->OpenDialog("##LoadEncrypted", "Choose Encrypted Text To Load", ".txt",
                                                         {.path = "."});
             }
+            ImGui::EndDisabled();
             ImGui::SameLine();
             if (ImGui::ButtonPadded("Save"))
             {
@@ -373,8 +456,22 @@ void gui::render_window() noexcept
         // Cell (2,1): Encrypted text input
         ImGui::TableSetColumnIndex(0);
         ImGui::PushFont(jetbrains_mono_regular, 0.f);
-        ImGui::InputTextMultiline("##Decrypted", &decrypted_text_, ImVec2{-1, -1});
+        if (ImGui::InputTextMultiline("##Decrypted", &decrypted_text_, ImVec2{-1, -1},
+                                      pane_flags | (decrypted_locked ? ImGuiInputTextFlags_ReadOnly : 0),
+                                      capture_selection, &decrypted_selection_))
+        {
+            // Any change the callback did not see as an edit may lie anywhere
+            if (!std::exchange(decrypted_selection_.edit_seen, false))
+            {
+                decrypted_buffer_.replaced();
+            }
+            decrypted_index_dirty_ = true;
+        }
         ImGui::PopFont();
+        if (std::exchange(decrypted_selection_.touched, false))
+        {
+            analyze_decrypted_selection_ = true;
+        }
 
         // Cell (2,2): Buttons and options
         ImGui::TableSetColumnIndex(1);
@@ -398,51 +495,51 @@ void gui::render_window() noexcept
             ImGui::SetTooltip("Letters of the message are rearranged according to a shifted pattern");
         }
         ImGui::Spacing();
+        ImGui::Checkbox("Normalize", &normalize_text_);
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip("Uppercase the text and drop everything but letters");
+        }
+        ImGui::Checkbox("Transliterate", &transliterate_text_);
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip("Turn accented letters into their base letters, such as \u00c9 into E");
+        }
+        ImGui::Checkbox("Groups Of Five", &group_text_);
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip("Write the encrypted text in the classic groups of five letters");
+        }
+        ImGui::Spacing();
         ImGui::Separator();
         ImGui::Spacing();
-        if (ImGui::Button("Encrypt", ImVec2{button_width, 0}))
+        // Both run in the background on a snapshot of their pane, so it stays editable meanwhile
+        const bool cipher_job_running{cipher_job_.valid()};
+        ImGui::BeginDisabled(cipher_job_running);
+        if (ImGui::Button(cipher_job_running && cipher_job_encrypting_ ? "Encrypting..." : "Encrypt",
+                          ImVec2{button_width, 0}))
         {
-            [this]() -> eresult<std::string> {
-                switch (selected_cipher_)
-                {
-                case cipher::substitution:
-                    return substitution_cipher.encrypt(decrypted_text_);
-                case cipher::transposition:
-                    return transposition_cipher.encrypt(decrypted_text_);
-                }
-            }()
-                            .and_then([this](const std::string value) -> eresult<void> {
-                                encrypted_text_ = std::move(value);
-                                return {};
-                            })
-                            .or_else([this, &cipher_message](const std::string error) -> eresult<void> {
-                                ImGui::OpenPopup("Error Encrypting");
-                                cipher_message = std::move(error);
-                                return std::unexpected{error};
-                            })
-                            .emplace();
-        }
-        if (ImGui::Button("Decrypt", ImVec2{button_width, 0}))
-        {
-            [this]() -> eresult<std::string> {
-                switch (selected_cipher_)
-                {
-                case cipher::substitution:
-                    return substitution_cipher.decrypt(encrypted_text_);
-                case cipher::transposition:
-                    return transposition_cipher.decrypt(encrypted_text_);
-                }
-            }()
-                            .and_then([this](const std::string value) -> eresult<void> {
-                                decrypted_text_ = std::move(value);
-                                return {};
-                            })
-                            .or_else([this, &cipher_message](const std::string error) -> eresult<void> {
-                                ImGui::OpenPopup("Error Decrypting");
-                                cipher_message = std::move(error);
-                                return std::unexpected{error};
-                            })
-                            .emplace();
+            start_cipher_job(true);
+        }
+        if (ImGui::Button(cipher_job_running && !cipher_job_encrypting_ ? "Decrypting..." : "Decrypt",
+                          ImVec2{button_width, 0}))
+        {
+            start_cipher_job(false);
+        }
+        ImGui::EndDisabled();
+        if (cipher_job_running && cipher_job_.wait_for(std::chrono::seconds{0}) == std::future_status::ready)
+        {
+            if (auto result{cipher_job_.get()})
+            {
+                (cipher_job_encrypting_ ? encrypted_text_ : decrypted_text_) = std::move(result->text);
+                (cipher_job_encrypting_ ? encrypted_buffer_ : decrypted_buffer_).adopt(result->chunks);
+                (cipher_job_encrypting_ ? encrypted_index_dirty_ : decrypted_index_dirty_) = true;
+            }
+            else
+            {
+                ImGui::OpenPopup(cipher_job_encrypting_ ? "Error Encrypting" : "Error Decrypting");
+                cipher_message = std::move(result.error());
+            }
         }
 
         if (selected_cipher_ == cipher::transposition)
@@ -475,6 +572,15 @@ void gui::render_window() noexcept
         {
             ImGui::SetTooltip("Toggle letter frequency analysis for cipher breaking");
         }
+        if (ImGui::Button("Triage File", ImVec2{button_width, 0}))
+        {
+            ImGuiFileDialog::Instance()->OpenDialog("##TriageFile", "Choose A File To Search For Text", ".*",
+                                                    {.path = "."});
+        }
+        if (ImGui::IsItemHovered())
+        {
+            ImGui::SetTooltip("Map the entropy of any file, however large, to find and load its text-like regions");
+        }
 
         ImGui::Spacing();
         ImGui::Separator();
@@ -492,8 +598,21 @@ void gui::render_window() noexcept
         // Cell (2,3): Decrypted text input
         ImGui::TableSetColumnIndex(2);
         ImGui::PushFont(jetbrains_mono_regular, 0.f);
-        ImGui::InputTextMultiline("##Encrypted", &encrypted_text_, ImVec2{-1, -1});
+        if (ImGui::InputTextMultiline("##Encrypted", &encrypted_text_, ImVec2{-1, -1},
+                                      pane_flags | (encrypted_locked ? ImGuiInputTextFlags_ReadOnly : 0),
+                                      capture_selection, &encrypted_selection_))
+        {
+            if (!std::exchange(encrypted_selection_.edit_seen, false))
+            {
+                encrypted_buffer_.replaced();
+            }
+            encrypted_index_dirty_ = true;
+        }
         ImGui::PopFont();
+        if (std::exchange(encrypted_selection_.touched, false))
+        {
+            analyze_decrypted_selection_ = false;
+        }
 
         ImGui::EndTable();
     }
@@ -501,93 +620,398 @@ void gui::render_window() noexcept
     // Frequency Analysis Panel
     if (show_frequency_analysis_)
     {
-        ImGui::Separator();
-        ImGui::Spacing();
+        render_frequency_analysis();
+    }
 
-        ImGui::TextCentered("Letter Frequency Analysis");
-        if (ImGui::IsItemHovered())
+    // File Triage Panel
+    if (triage_job_.valid() || triage_strip_.map())
+    {
+        render_triage();
+    }
+
+    // ImGui::PopFont();
+}
+
+void gui::render_frequency_analysis() noexcept
+{
+    ImGui::Separator();
+    ImGui::Spacing();
+
+    ImGui::TextCentered("Letter Frequency Analysis");
+    if (ImGui::IsItemHovered())
+    {
+        ImGui::SetTooltip("Analyze letter frequencies to help break substitution ciphers");
+    }
+
+    ImGui::Spacing();
+
+    // Analyze the selection of the last selected pane, or all of it when nothing is selected
+    const auto &text{analyze_decrypted_selection_ ? decrypted_text_ : encrypted_text_};
+    auto &index{analyze_decrypted_selection_ ? decrypted_index_ : encrypted_index_};
+    auto &dirty{analyze_decrypted_selection_ ? decrypted_index_dirty_ : encrypted_index_dirty_};
+    auto &job{analyze_decrypted_selection_ ? decrypted_index_job_ : encrypted_index_job_};
+
+    // The index is built on the executor from a snapshot; one the text was edited after is dropped unused
+    bool rebuilt{};
+    if (job.valid() && job.wait_for(std::chrono::seconds{0}) == std::future_status::ready)
+    {
+        auto built{job.get()};
+        if (!dirty)
         {
-            ImGui::SetTooltip("Analyze letter frequencies to help break substitution ciphers");
+            index = std::move(built);
+            rebuilt = true;
         }
+    }
+    if (dirty && !job.valid())
+    {
+        auto &buffer{analyze_decrypted_selection_ ? decrypted_buffer_ : encrypted_buffer_};
+        buffer.update(text);
+        job = executor::instance().async(
+            [snapshot = buffer.snapshot()] { return tprotect::cipher::histogram_index{snapshot.to_string()}; },
+            priority::interactive);
+        dirty = false;
+    }
 
-        ImGui::Spacing();
+    const auto &selection{analyze_decrypted_selection_ ? decrypted_selection_ : encrypted_selection_};
+    const std::string_view pane_name{analyze_decrypted_selection_ ? "decrypted" : "encrypted"};
+    const bool has_selection{selection.begin < selection.end && selection.end <= text.size()};
+    const std::size_t begin{has_selection ? selection.begin : 0}, end{has_selection ? selection.end : text.size()};
+
+    const auto source{has_selection ? std::format("Selection in {} text (bytes {}-{})", pane_name, selection.begin,
+                                                  selection.end)
+                                    : std::format("All of {} text", pane_name)};
+    ImGui::TextCentered(job.valid() ? std::format("{} (counting...)", source).c_str() : source.c_str());
+    if (ImGui::IsItemHovered())
+    {
+        ImGui::SetTooltip("Select text in either pane to analyze only that range");
+    }
+
+    // Until the index matches the text again the charts keep showing the last counts
+    if (!job.valid())
+    {
+        // Case-folded percentages; the chart keeps its geometry while these stay the same
+        const auto counts{index.counts(text, begin, end)};
+        std::uint64_t total{};
+        for (const auto count : counts)
+        {
+            total += count;
+        }
+        if (total == 0)
+        {
+            ImGui::TextCentered(std::format("No letters found in {} text", pane_name).c_str());
+            return;
+        }
+        std::array<float, 26> letters{};
+        for (std::size_t i{}; i < 26; ++i)
+        {
+            letters[i] = static_cast<float>(counts[i] + counts[26 + i]) * 100.f / static_cast<float>(total);
+        }
+        const auto english_frequencies{tprotect::cipher::frequency_analyzer::get_english_frequencies()};
+        letter_chart_.set_bars(letters, english_frequencies);
+
+        // The heatmap is only rebuilt when the analyzed range changes
+        if (const std::tuple source_key{analyze_decrypted_selection_, begin, end};
+            rebuilt || source_key != bigram_source_)
+        {
+            bigram_source_ = source_key;
+            const auto bigram_counts{index.bigrams(text, begin, end)};
+            std::uint64_t bigram_total{};
+            for (const auto count : bigram_counts)
+            {
+                bigram_total += count;
+            }
+            std::array<float, 26 * 26> bigrams{};
+            for (std::size_t i{}; i < bigrams.size() && bigram_total > 0; ++i)
+            {
+                bigrams[i] = static_cast<float>(bigram_counts[i]) * 100.f / static_cast<float>(bigram_total);
+            }
+            bigram_chart_.set_heatmap(bigrams, 26);
+        }
+    }
+
+    const float chart_height{ImGui::GetFontSize() * 14.f};
+    if (ImGui::BeginTable("FrequencyCharts", 2, ImGuiTableFlags_SizingStretchSame))
+    {
+        ImGui::TableNextColumn();
+        ImGui::TextCentered("Letters (markers: English)");
+        letter_chart_.draw("##LetterChart", {-1, chart_height});
+
+        ImGui::TableNextColumn();
+        ImGui::TextCentered("Bigrams (row: first letter)");
+        bigram_chart_.draw("##BigramChart", {-1, chart_height});
+
+        ImGui::EndTable();
+    }
+
+    ImGui::Spacing();
+    ImGui::TextWrapped(
+        "Tip: In English, the most common letters are E, T, A, O, I, N. Compare encrypted frequencies with "
+        "English frequencies to deduce the substitution mapping.");
+}
+
+void gui::render_triage() noexcept
+{
+    // The map is built off the GUI thread; until then only its progress shows
+    if (triage_job_.valid())
+    {
+        if (triage_job_.wait_for(std::chrono::seconds{0}) != std::future_status::ready)
+        {
+            ImGui::Separator();
+            ImGui::TextCentered(std::format("Mapping {}...", triage_path_).c_str());
+            return;
+        }
+        auto built{triage_job_.get()};
+        if (!built)
+        {
+            triage_message_ = std::move(built.error());
+            ImGui::OpenPopup("Error Triaging File");
+            triage_strip_.set_map(nullptr);
+        }
+        else
+        {
+            triage_strip_.set_map(std::make_shared<const tprotect::cipher::entropy_map>(std::move(*built)));
+            triage_next_ = 0;
+        }
+    }
+    ImGui::InformationPopup("Error Triaging File", triage_message_.c_str(), [] {});
+    const auto &map{triage_strip_.map()};
+    if (!map)
+    {
+        return;
+    }
 
-        // Analyze encrypted text
-        const auto frequencies{tprotect::cipher::frequency_analyzer::analyze(encrypted_text_)};
+    ImGui::Separator();
+    ImGui::Spacing();
+    ImGui::TextCentered(std::format("{}: {} blocks of {} bytes", triage_path_, map->blocks().size(),
+                                    map->block_size())
+                            .c_str());
+    if (ImGui::IsItemHovered())
+    {
+        ImGui::SetTooltip("Scroll to zoom, drag to pan, and click a block to load it into the encrypted pane");
+    }
 
-        if (frequencies.empty())
+    std::string message{};
+    if (const auto block{triage_strip_.draw("##EntropyStrip", {-1, ImGui::GetFontSize() * 3.f})})
+    {
+        if (auto loaded{load_triage_region(*block)}; !loaded)
+        {
+            message = std::move(loaded.error());
+        }
+    }
+    if (ImGui::ButtonPadded("Next Text"))
+    {
+        if (const auto run{map->next_text(triage_next_)})
         {
-            ImGui::TextCentered("No letters found in encrypted text");
+            triage_strip_.show(run->first, run->second);
+            if (auto loaded{load_triage_region(run->first)}; !loaded)
+            {
+                message = std::move(loaded.error());
+            }
         }
         else
         {
-            // Create two-column layout for frequency table
-            if (ImGui::BeginTable("FrequencyTable", 4,
-                                  ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp))
+            message = "No text-like region found";
+        }
+    }
+    if (ImGui::IsItemHovered())
+    {
+        ImGui::SetTooltip("Jump to the next run of text-like blocks and load it");
+    }
+    ImGui::SameLine();
+    if (ImGui::ButtonPadded("Close"))
+    {
+        triage_strip_.set_map(nullptr);
+    }
+    if (!message.empty())
+    {
+        triage_message_ = std::move(message);
+        ImGui::OpenPopup("Error Loading Region");
+    }
+    ImGui::InformationPopup("Error Loading Region", triage_message_.c_str(), [] {});
+}
+
+[[nodiscard]] eresult<void> gui::load_triage_region(const std::size_t block) noexcept
+{
+    if (cipher_job_.valid() && cipher_job_encrypting_)
+    {
+        return std::unexpected{"The encrypted pane is read-only until encryption finishes"};
+    }
+    // A text-like block loads with the rest of its run, within what a text pane comfortably holds
+    constexpr std::size_t max_region{4 << 20};
+    const auto &map{*triage_strip_.map()};
+    const auto blocks{map.blocks()};
+    std::size_t first{block}, end{block + 1};
+    if (blocks[block].text_like())
+    {
+        while (first > 0 && blocks[first - 1].text_like())
+        {
+            first--;
+        }
+        while (end < blocks.size() && blocks[end].text_like())
+        {
+            end++;
+        }
+    }
+    triage_next_ = end;
+
+    return mapped_file::open(triage_path_)
+        .transform([&](const mapped_file &file) {
+            const auto begin{std::min(file.size(), first * map.block_size())};
+            const auto bytes{file.view().substr(begin, std::min(end * map.block_size() - begin, max_region))};
+            encrypted_text_ = decode_text(bytes, detect_text_format(bytes));
+            encrypted_buffer_.replaced();
+            encrypted_format_ = {};
+            encrypted_index_dirty_ = true;
+        })
+        .transform_error(&compact_error::message);
+}
+
+void gui::start_cipher_job(const bool encrypting) noexcept
+{
+    // Only the chunks the pane's edits touched since the last job are cut again; the job shares them all
+    auto &buffer{encrypting ? decrypted_buffer_ : encrypted_buffer_};
+    buffer.update(encrypting ? decrypted_text_ : encrypted_text_);
+    const auto table{selected_cipher_ == cipher::substitution
+                         ? (encrypting ? substitution_cipher.encryption_table()
+                                       : substitution_cipher.decryption_table())
+                         : (encrypting ? transposition_cipher.encryption_table()
+                                       : transposition_cipher.decryption_table())};
+    cipher_job_encrypting_ = encrypting;
+    // A load into the target pane that is still choosing its file would be overwritten by the result
+    if (const auto dialog{ImGuiFileDialog::Instance()};
+        dialog->IsOpened(encrypting ? "##LoadEncrypted" : "##LoadDecrypted"))
+    {
+        dialog->Close();
+    }
+    // A long job, so it yields to the analysis the GUI waits on each frame
+    cipher_job_ = executor::instance().async(
+        [snapshot = buffer.snapshot(), table, options = format_options(encrypting)]() -> eresult<cipher_result> {
+            // Chunks hold whole UTF-8 sequences, so each is enciphered and normalized on its own into a chunk of the
+            // result, which the target pane's buffer takes over as it is
+            auto ungrouped{options};
+            ungrouped.group_size = ungrouped.line_groups = 0;
+            const tprotect::cipher::text_normalizer normalizer{ungrouped, table}, grouping{options};
+            std::vector<std::string> pieces(snapshot.chunk_count());
+            parallel_for(pieces.size(), [&](const std::size_t i, std::size_t) {
+                const auto chunk{snapshot.chunk(i)};
+                pieces[i] = options.changes_text() ? normalizer.apply(chunk) : table.apply(chunk);
+            });
+
+            // Groups depend on every letter before them, so each chunk is grouped from the count of those before it
+            if (options.group_size != 0)
             {
-                // Setup columns
-                ImGui::TableSetupColumn("Letter", ImGuiTableColumnFlags_WidthFixed, 60.0f);
-                ImGui::TableSetupColumn("Count", ImGuiTableColumnFlags_WidthFixed, 80.0f);
-                ImGui::TableSetupColumn("Frequency", ImGuiTableColumnFlags_WidthStretch, 1.0f);
-                ImGui::TableSetupColumn("English", ImGuiTableColumnFlags_WidthFixed, 80.0f);
-                ImGui::TableHeadersRow();
-
-                // Get English frequencies for comparison
-                const auto english_freq{tprotect::cipher::frequency_analyzer::get_english_frequencies()};
-
-                // Display frequency data
-                for (const auto &freq : frequencies)
+                std::vector<std::size_t> first(pieces.size());
+                for (std::size_t i{1}; i < pieces.size(); ++i)
                 {
-                    ImGui::TableNextRow();
-
-                    // Letter column
-                    ImGui::TableSetColumnIndex(0);
-                    ImGui::TextCentered(std::string{freq.letter}.c_str());
-
-                    // Count column
-                    ImGui::TableSetColumnIndex(1);
-                    ImGui::Text("%d", freq.count);
-
-                    // Frequency bar column
-                    ImGui::TableSetColumnIndex(2);
-                    const float bar_fraction{freq.percentage / 100.0f};
-                    ImGui::ProgressBar(bar_fraction, ImVec2{-1, 0}, std::format("{:.2f}%", freq.percentage).c_str());
-
-                    // English frequency column (for comparison)
-                    ImGui::TableSetColumnIndex(3);
-                    if (freq.letter >= 'A' && freq.letter <= 'Z')
-                    {
-                        ImGui::Text("%.2f%%", english_freq[freq.letter - 'A']);
-                    }
-                    else if (freq.letter >= 'a' && freq.letter <= 'z')
-                    {
-                        ImGui::Text("%.2f%%", english_freq[freq.letter - 'a']);
-                    }
+                    first[i] = first[i - 1] + pieces[i - 1].size();
                 }
-
-                ImGui::EndTable();
+                parallel_for(pieces.size(), [&](const std::size_t i, std::size_t) {
+                    pieces[i] = grouping.group(pieces[i], first[i]);
+                });
             }
+            text_buffer output;
+            output.assign(std::move(pieces));
+            auto chunks{output.snapshot()};
+            auto text{chunks.to_string()};
+            return cipher_result{std::move(chunks), std::move(text)};
+        },
+        priority::background);
+}
 
-            ImGui::Spacing();
-            ImGui::TextWrapped(
-                "Tip: In English, the most common letters are E, T, A, O, I, N. Compare encrypted frequencies with "
-                "English frequencies to deduce the substitution mapping.");
+tprotect::cipher::normalize_options gui::format_options(const bool encrypting) const noexcept
+{
+    // Decrypting drops the groups' separators with everything else when normalizing, and never groups again
+    return {.uppercase = normalize_text_,
+            .letters_only = normalize_text_,
+            .transliterate = transliterate_text_,
+            .group_size = encrypting && group_text_ ? std::size_t{5} : 0,
+            .line_groups = encrypting && group_text_ ? std::size_t{10} : 0};
+}
+
+int gui::capture_selection(ImGuiInputTextCallbackData *const data) noexcept
+{
+    auto &selection{*static_cast<text_selection *>(data->UserData)};
+    const auto cursor{static_cast<std::size_t>(data->CursorPos)};
+    const auto length{static_cast<std::size_t>(data->BufTextLen)};
+    if (data->EventFlag == ImGuiInputTextFlags_CallbackEdit)
+    {
+        // The callback runs once a frame, after every edit and cursor move the frame's input made. The edit is known
+        // to start no earlier than the selection or cursor seen on the frame before, and to leave what followed it,
+        // only if nothing this frame could have moved the cursor first (navigation keys, select all, the mouse, a
+        // drop) or changed anything anywhere (undo, redo, reverting with Escape), and the lengths agree; otherwise
+        // every chunk is cut again
+        constexpr std::array navigation{ImGuiKey_LeftArrow, ImGuiKey_RightArrow, ImGuiKey_UpArrow, ImGuiKey_DownArrow,
+                                        ImGuiKey_Home,      ImGuiKey_End,        ImGuiKey_PageUp,  ImGuiKey_PageDown};
+        const auto &io{ImGui::GetIO()};
+        const bool shortcut{io.KeyCtrl || io.KeySuper};
+        const bool moved{std::ranges::any_of(navigation, [](const auto key) { return ImGui::IsKeyDown(key); }) ||
+                         (shortcut && ImGui::IsKeyDown(ImGuiKey_A)) || ImGui::IsMouseDown(ImGuiMouseButton_Left) ||
+                         ImGui::GetDragDropPayload() != nullptr};
+        const bool undo{(shortcut && (ImGui::IsKeyDown(ImGuiKey_Z) || ImGui::IsKeyDown(ImGuiKey_Y))) ||
+                        ImGui::IsKeyDown(ImGuiKey_Escape)};
+        const std::size_t prefix{std::min(selection.first, cursor)}, suffix{length - cursor};
+        const bool known{!moved && !undo && selection.frame == ImGui::GetFrameCount() - 1 &&
+                         selection.last <= selection.length && suffix <= selection.length - selection.last};
+        if (known)
+        {
+            selection.buffer->edited(prefix, suffix);
+        }
+        else
+        {
+            selection.buffer->replaced();
         }
+        selection.edit_seen = true;
     }
-
-    // ImGui::PopFont();
+    selection.begin = static_cast<std::size_t>(std::min(data->SelectionStart, data->SelectionEnd));
+    selection.end = static_cast<std::size_t>(std::max(data->SelectionStart, data->SelectionEnd));
+    selection.first = std::min(selection.begin, cursor);
+    selection.last = std::max(selection.end, cursor);
+    selection.length = length;
+    selection.frame = ImGui::GetFrameCount();
+    selection.touched = true;
+    return 0;
 }
 
 [[nodiscard]] eresult<void> gui::process_file() noexcept
 {
-    return read_file_dialog("##LoadEncrypted", encrypted_text_)
-        .and_then([this] { return read_file_dialog("##LoadDecrypted", decrypted_text_); })
-        .and_then([this] { return write_file_dialog("##SaveEncrypted", encrypted_text_); })
-        .and_then([this] { return write_file_dialog("##SaveDecrypted", decrypted_text_); })
+    // Panes hold UTF-8 with LF line endings and are saved back as their files were stored
+    return read_file_dialog("##LoadEncrypted", encrypted_text_, encrypted_format_)
+        .and_then([this](const bool loaded) {
+            if (loaded)
+            {
+                encrypted_buffer_.replaced();
+                encrypted_index_dirty_ = true;
+            }
+            return read_file_dialog("##LoadDecrypted", decrypted_text_, decrypted_format_);
+        })
+        .and_then([this](const bool loaded) {
+            if (loaded)
+            {
+                decrypted_buffer_.replaced();
+                decrypted_index_dirty_ = true;
+            }
+            return write_file_dialog("##SaveEncrypted", encrypted_text_, encrypted_format_);
+        })
+        .and_then([this] { return write_file_dialog("##SaveDecrypted", decrypted_text_, decrypted_format_); })
+        .and_then([this]() -> eresult<void> {
+            // Large files are mapped on the executor; the panel picks the result up when it is ready
+            if (auto path{display_file_dialog("##TriageFile")})
+            {
+                triage_path_ = std::move(*path);
+                // The error's context lives on the worker that raised it, so it is formatted there
+                triage_job_ = executor::instance().async(
+                    [path = triage_path_] {
+                        return tprotect::cipher::entropy_map::open(path).transform_error(&compact_error::message);
+                    },
+                    priority::background);
+            }
+            return {};
+        })
         .and_then([this] {
             return display_file_dialog("##SaveDecryptedBrute")
                 .transform([this](const std::string path) -> eresult<void> {
-                    std::ranges::for_each(std::views::iota(1, 27), [&](const int i) {
+                    parallel_for(26, [&](const std::size_t index, std::size_t) { // one key per task
+                        const int i{static_cast<int>(index) + 1};
                         tprotect::cipher::transposition_cipher cipher{i};
                         std::filesystem::path fs_path{path}, fs_extention{fs_path.extension()};
                         return cipher.decrypt(encrypted_text_).and_then([&](const std::string decrypted_text) {